@@ -0,0 +1,549 @@
+#include "apollonius.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "parallel.h"
+#include "triangulation.h"
+
+/**
+ * Apollonius diagrams: the distance from x to a circle site is
+ * |x - center| - radius, so bisectors are branches of hyperbolas and a node is
+ * the center of a circle touching three sites from outside. The dual is built
+ * by Triangulation with the test of whether a new site cuts into that
+ * circle in place of the empty circle test.
+ */
+
+namespace
+{
+
+const double PI = 3.14159265358979323846;
+
+double wrapAngle(double angle)
+{
+    while(angle < 0)
+        angle += 2*PI;
+    while(angle >= 2*PI)
+        angle -= 2*PI;
+    return angle;
+}
+
+// Branch of the hyperbola of points as far from a as from b, in a frame with
+// the origin between the centers and X towards b: |x - a| - |x - b| = ra - rb
+// is X = h cosh(t), Y = k sinh(t) with signed h, so only t changes along it
+// and t grows to the left of a -> b.
+struct Bisector
+{
+    double mx, my, ux, uy, h, k;
+
+    Bisector(const Circle& a, const Circle& b)
+    {
+        double dx = double(b.center.x) - a.center.x;
+        double dy = double(b.center.y) - a.center.y;
+        double focus = 0.5*std::sqrt(dx*dx + dy*dy);
+        ux = dx / (2*focus);
+        uy = dy / (2*focus);
+        mx = a.center.x + 0.5*dx;
+        my = a.center.y + 0.5*dy;
+        h = 0.5*(double(a.radius) - b.radius);
+        k = std::sqrt(std::max(0.0, focus*focus - h*h));
+    }
+
+    double param(double x, double y) const
+    {
+        double across = -(x - mx)*uy + (y - my)*ux;
+        return k > 0 ? std::asinh(across / k) : 0.0;
+    }
+
+    void at(double t, double& x, double& y) const
+    {
+        double along = h*std::cosh(t);
+        double across = k*std::sinh(t);
+        x = mx + along*ux - across*uy;
+        y = my + along*uy + across*ux;
+    }
+};
+
+// Circle touching sites, in double for the predicates
+struct Touching
+{
+    double x, y, radius;
+};
+
+int touchingCircles(const std::vector<Circle>& circles,
+        const size_t (&sites)[3], Touching (&out)[2]);
+bool touchingNode(const std::vector<Circle>& circles,
+        const size_t (&sites)[3], Touching& out);
+
+struct ApolloniusPredicates
+{
+    const std::vector<Circle>* circles;
+
+    double orient(size_t a, size_t b, size_t c) const
+    {
+        const Point& pa = (*circles)[a].center;
+        const Point& pb = (*circles)[b].center;
+        const Point& pc = (*circles)[c].center;
+        return (double(pb.x) - pa.x)*(double(pc.y) - pa.y) -
+            (double(pb.y) - pa.y)*(double(pc.x) - pa.x);
+    }
+
+    // How far p reaches past the common tangent of a and b on the outside of
+    // the hull edge a -> b. Worked out from orient rather than the tangent's
+    // normal, so that it's exactly 0 for circles the same size in a row.
+    double beyond(size_t a, size_t b, size_t p) const
+    {
+        const Circle& ca = (*circles)[a];
+        const Circle& cb = (*circles)[b];
+        const Circle& cp = (*circles)[p];
+        double dx = double(cb.center.x) - ca.center.x;
+        double dy = double(cb.center.y) - ca.center.y;
+        double length = std::sqrt(dx*dx + dy*dy);
+        double along = (double(ca.radius) - cb.radius) / length;
+        if(!(std::fabs(along) < 1))
+            return orient(a, b, p);
+
+        double px = double(cp.center.x) - ca.center.x;
+        double py = double(cp.center.y) - ca.center.y;
+        double across = std::sqrt(1 - along*along);
+        return (along*(px*dx + py*dy) + across*orient(a, b, p)) / length +
+            (double(cp.radius) - ca.radius);
+    }
+
+    // Normal of the common tangent of a and b on the outside of the hull edge
+    // a -> b, false if one is inside the other and there's no such tangent
+    bool tangentNormal(size_t a, size_t b, double& nx, double& ny) const
+    {
+        const Circle& ca = (*circles)[a];
+        const Circle& cb = (*circles)[b];
+        double dx = double(cb.center.x) - ca.center.x;
+        double dy = double(cb.center.y) - ca.center.y;
+        double length = std::sqrt(dx*dx + dy*dy);
+        double along = (double(ca.radius) - cb.radius) / length;
+        if(!(std::fabs(along) < 1))
+            return false;
+
+        double across = std::sqrt(1 - along*along);
+        nx = (along*dx - across*dy) / length;
+        ny = (along*dy + across*dx) / length;
+        return true;
+    }
+
+    // Far out in direction n the nearest site is the one reaching furthest
+    // that way, this is how much further p reaches than a
+    double reach(size_t a, size_t p, double nx, double ny) const
+    {
+        const Circle& ca = (*circles)[a];
+        const Circle& cp = (*circles)[p];
+        return (double(cp.center.x) - ca.center.x)*nx +
+            (double(cp.center.y) - ca.center.y)*ny + cp.radius - ca.radius;
+    }
+
+    bool conflict(size_t a, size_t b, size_t c, size_t p) const
+    {
+        const size_t sites[3] = {a, b, c};
+        Touching touching;
+        if(!touchingNode(*circles, sites, touching))
+            return false;
+
+        const Circle& cp = (*circles)[p];
+        double dx = cp.center.x - touching.x;
+        double dy = cp.center.y - touching.y;
+        return std::sqrt(dx*dx + dy*dy) - cp.radius < touching.radius;
+    }
+
+    // a, b and c on their own have a single node, so there's one triangle
+    bool face(size_t a, size_t b, size_t c) const
+    {
+        if(hidden(a, b) || hidden(b, a) || hidden(b, c) || hidden(c, b) ||
+                hidden(c, a) || hidden(a, c))
+            return false;
+
+        const size_t sites[3] = {a, b, c};
+        Touching touching[2];
+        return touchingCircles(*circles, sites, touching) == 1 &&
+            touchingNode(*circles, sites, touching[0]);
+    }
+
+    // p is inside near, every position is closer to near than to p
+    bool hidden(size_t p, size_t near) const
+    {
+        return distance(near, p) + (*circles)[p].radius <= 0;
+    }
+
+    bool coincident(size_t a, size_t b) const
+    {
+        return (*circles)[a].center.x == (*circles)[b].center.x &&
+            (*circles)[a].center.y == (*circles)[b].center.y;
+    }
+
+    double distance(size_t site, size_t p) const
+    {
+        const Circle& cs = (*circles)[site];
+        const Circle& cp = (*circles)[p];
+        return std::hypot(double(cp.center.x) - cs.center.x,
+                double(cp.center.y) - cs.center.y) - cs.radius;
+    }
+
+    bool edgeConflict(size_t a, size_t b, size_t c, size_t d, size_t p) const
+    {
+        if(b == size_t(-1))
+            return reachesBetween(a, c, d, p, true);
+        return crossedTwice(a, b, c, d, p);
+    }
+
+    bool edgeClear(size_t a, size_t b, size_t c, size_t d, size_t p) const
+    {
+        if(b == size_t(-1))
+            return reachesBetween(a, c, d, p, false);
+        return crossedTwice(a, b, c, d, p);
+    }
+
+    // The edge between two hull triangles is where a is nearest far out, in
+    // the directions from the normal of its tangent with c clockwise round
+    // to that of its tangent with d. How much further p reaches than a,
+    // going round, is largest straight away from a and smallest straight
+    // towards it. So between ends that agree about p, p is nearer (or
+    // further, if !nearer) somewhere exactly when that direction is strictly
+    // inside and p reaches further (or less far) there.
+    bool reachesBetween(size_t a, size_t c, size_t d, size_t p,
+            bool nearer) const
+    {
+        double fromx, fromy, tox, toy;
+        if(!tangentNormal(c, a, fromx, fromy) || !tangentNormal(a, d, tox, toy))
+            return false;
+
+        const Circle& ca = (*circles)[a];
+        const Circle& cp = (*circles)[p];
+        double dx = double(cp.center.x) - ca.center.x;
+        double dy = double(cp.center.y) - ca.center.y;
+        double length = std::sqrt(dx*dx + dy*dy);
+        double sign = nearer ? 1 : -1;
+        if(length == 0 || sign*reach(a, p, sign*dx / length,
+                    sign*dy / length) <= 0)
+            return false;
+
+        double from = std::atan2(fromy, fromx);
+        double to = std::atan2(toy, tox);
+        double toward = std::atan2(dy, dx) + (nearer ? 0 : PI);
+        double at = wrapAngle(from - toward);
+        return at > 0 && at < wrapAngle(from - to);
+    }
+
+    // Along the bisector of a and b, the distances to p and to a are equal
+    // only at the centers of circles touching a, b and p, of which there are
+    // at most two. So between nodes that agree about p, p is closer to some
+    // of the edge and not the rest exactly when both of those centers lie
+    // strictly between the nodes. c or d is size_t(-1) where the edge runs
+    // out to the left or the right of a -> b.
+    bool crossedTwice(size_t a, size_t b, size_t c, size_t d, size_t p) const
+    {
+        const size_t crossing[3] = {a, b, p};
+        Touching touching[2];
+        Bisector bisector((*circles)[a], (*circles)[b]);
+        if(bisector.k == 0 ||
+                touchingCircles(*circles, crossing, touching) != 2 ||
+                (touching[0].x == touching[1].x &&
+                 touching[0].y == touching[1].y))
+            return false;
+
+        double t0 = std::numeric_limits<double>::infinity(), t1 = -t0;
+        if((c != size_t(-1) && !nodeParam(bisector, a, b, c, t0)) ||
+                (d != size_t(-1) && !nodeParam(bisector, b, a, d, t1)))
+            return false;
+
+        for(const auto& circle : touching) {
+            double t = bisector.param(circle.x, circle.y);
+            if(!(t > std::min(t0, t1) && t < std::max(t0, t1)))
+                return false;
+        }
+        return true;
+    }
+
+    // Where the node of triangle abc is along bisector
+    bool nodeParam(const Bisector& bisector, size_t a, size_t b, size_t c,
+            double& t) const
+    {
+        const size_t sites[3] = {a, b, c};
+        Touching node;
+        if(!touchingNode(*circles, sites, node))
+            return false;
+        t = bisector.param(node.x, node.y);
+        return true;
+    }
+};
+
+typedef Triangulation<ApolloniusPredicates> ApolloniusTriangulation;
+
+Voronoi::Node::Ptr tangentNode(const std::vector<Circle>& circles,
+        const size_t (&sites)[3])
+{
+    Circle touching;
+    tangentCircle(circles, sites, touching);
+
+    auto node = std::make_shared<Voronoi::Node>();
+    node->x = touching.center.x;
+    node->y = touching.center.y;
+    node->radius = std::max(0.f, touching.radius);
+    node->parents.insert(sites, sites + 3);
+    return node;
+}
+
+// Point between two circles at the same distance from both
+Voronoi::Node::Ptr gapNode(const std::vector<Circle>& circles, size_t a,
+        size_t b)
+{
+    const Circle& ca = circles[a];
+    const Circle& cb = circles[b];
+    double dx = double(cb.center.x) - ca.center.x;
+    double dy = double(cb.center.y) - ca.center.y;
+    double length = std::sqrt(dx*dx + dy*dy);
+    double gap = length - ca.radius - cb.radius;
+    double t = (ca.radius + 0.5*gap) / length;
+
+    auto node = std::make_shared<Voronoi::Node>();
+    node->x = ca.center.x + t*dx;
+    node->y = ca.center.y + t*dy;
+    node->radius = std::max(0.0, 0.5*gap);
+    node->parents.insert(a);
+    node->parents.insert(b);
+    return node;
+}
+
+/**
+ * Every circle touching the three sites from outside, out[] gets up to two
+ *
+ * @return how many there are
+ */
+int touchingCircles(const std::vector<Circle>& circles,
+        const size_t (&sites)[3], Touching (&out)[2])
+{
+    // With a's center at the origin, subtracting a's equation
+    // |x|^2 = (R + ra)^2 from b's and c's leaves two linear equations in x, y
+    // and R. Their solutions are a line s + t v, with v across both normals,
+    // which stays a line when the centers are in a row and the normals only
+    // differ in R. Putting that back into a's leaves a quadratic in t.
+    //
+    // a is the site across from the longest side, at the widest angle, where
+    // the two differences are furthest from parallel. Starting from a sharp
+    // corner of a thin triangle loses the circle to rounding, and the answer
+    // would depend on which of the three sites comes first.
+    int base = 0;
+    double longest = -1;
+    for(int ii = 0; ii < 3; ii++) {
+        const Point& p0 = circles[sites[(ii + 1) % 3]].center;
+        const Point& p1 = circles[sites[(ii + 2) % 3]].center;
+        double dx = double(p1.x) - p0.x, dy = double(p1.y) - p0.y;
+        if(dx*dx + dy*dy > longest) {
+            longest = dx*dx + dy*dy;
+            base = ii;
+        }
+    }
+
+    const Circle& ca = circles[sites[base]];
+    double ra = ca.radius;
+    double row[2][3], rhs[2];
+    for(int ii = 0; ii < 2; ii++) {
+        const Circle& ci = circles[sites[(base + ii + 1) % 3]];
+        row[ii][0] = double(ci.center.x) - ca.center.x;
+        row[ii][1] = double(ci.center.y) - ca.center.y;
+        row[ii][2] = double(ci.radius) - ra;
+        rhs[ii] = 0.5*(row[ii][0]*row[ii][0] + row[ii][1]*row[ii][1] -
+                double(ci.radius)*ci.radius + ra*ra);
+    }
+
+    double v[3] = {
+        row[0][1]*row[1][2] - row[0][2]*row[1][1],
+        row[0][2]*row[1][0] - row[0][0]*row[1][2],
+        row[0][0]*row[1][1] - row[0][1]*row[1][0],
+    };
+    double g00 = 0, g01 = 0, g11 = 0;
+    for(int ii = 0; ii < 3; ii++) {
+        g00 += row[0][ii]*row[0][ii];
+        g01 += row[0][ii]*row[1][ii];
+        g11 += row[1][ii]*row[1][ii];
+    }
+    // Lagrange's identity, the Gram determinant of the rows is |v|^2
+    double gram = v[0]*v[0] + v[1]*v[1] + v[2]*v[2];
+    if(!(gram > 0))
+        return 0;
+
+    double w0 = (g11*rhs[0] - g01*rhs[1]) / gram;
+    double w1 = (g00*rhs[1] - g01*rhs[0]) / gram;
+    double x0 = w0*row[0][0] + w1*row[1][0];
+    double y0 = w0*row[0][1] + w1*row[1][1];
+    double r0 = w0*row[0][2] + w1*row[1][2] + ra;
+    double length = std::sqrt(gram);
+    double x1 = v[0] / length, y1 = v[1] / length, r1 = v[2] / length;
+
+    double qa = x1*x1 + y1*y1 - r1*r1;
+    double qb = 2*(x0*x1 + y0*y1 - r0*r1);
+    double qc = x0*x0 + y0*y0 - r0*r0;
+
+    double roots[2];
+    int count = 0;
+    if(std::fabs(qa) < 1e-12) {
+        if(qb != 0)
+            roots[count++] = -qc / qb;
+    } else {
+        double disc = qb*qb - 4*qa*qc;
+        if(disc < 0)
+            return 0;
+        double sq = std::sqrt(disc);
+        roots[count++] = (-qb - sq) / (2*qa);
+        roots[count++] = (-qb + sq) / (2*qa);
+    }
+
+    int found = 0;
+    for(int ii = 0; ii < count; ii++) {
+        double radius = r0 + r1*roots[ii] - ra;
+        bool outside = true;
+        for(size_t site : sites)
+            outside &= radius + circles[site].radius >= 0;
+        if(!outside)
+            continue;
+
+        out[found].x = ca.center.x + x0 + x1*roots[ii];
+        out[found].y = ca.center.y + y0 + y1*roots[ii];
+        out[found].radius = radius;
+        found++;
+    }
+    return found;
+}
+
+// of the (up to) two touching circles, the node of the counterclockwise
+// triangle a, b, c is the one that sees the sites counterclockwise
+bool touchingNode(const std::vector<Circle>& circles,
+        const size_t (&sites)[3], Touching& out)
+{
+    Touching touching[2];
+    int count = touchingCircles(circles, sites, touching);
+
+    bool found = false;
+    for(int ii = 0; ii < count; ii++) {
+        const Touching& circle = touching[ii];
+        double angles[3];
+        for(int jj = 0; jj < 3; jj++) {
+            const Circle& site = circles[sites[jj]];
+            angles[jj] = std::atan2(site.center.y - circle.y,
+                    site.center.x - circle.x);
+        }
+        double turn = wrapAngle(angles[1] - angles[0]) +
+            wrapAngle(angles[2] - angles[1]) + wrapAngle(angles[0] - angles[2]);
+        if(std::fabs(turn - 2*PI) > 1e-6)
+            continue;
+
+        if(!found || circle.radius < out.radius) {
+            out = circle;
+            found = true;
+        }
+    }
+    return found;
+}
+
+}
+
+bool tangentCircle(const std::vector<Circle>& circles,
+        const size_t (&sites)[3], Circle& out)
+{
+    Touching touching;
+    if(!touchingNode(circles, sites, touching))
+        return false;
+    out.center = Point(touching.x, touching.y);
+    out.radius = touching.radius;
+    return true;
+}
+
+std::vector<Point> tessellateBisector(const Circle& a, const Circle& b,
+        const Point& from, const Point& to, float max_error)
+{
+    Bisector bisector(a, b);
+    auto param = [&](const Point& pt) {
+        return bisector.param(pt.x, pt.y);
+    };
+    auto evaluate = [&](double t) {
+        double x, y;
+        bisector.at(t, x, y);
+        return Point(x, y);
+    };
+
+    // split the parameter range until each chord stays within max_error of
+    // the curve at its middle
+    std::vector<Point> out(1, from);
+    std::vector<std::pair<double, double>> stack;
+    stack.push_back(std::make_pair(param(from), param(to)));
+    while(!stack.empty()) {
+        auto range = stack.back();
+        stack.pop_back();
+
+        Point p0 = evaluate(range.first);
+        Point p1 = evaluate(range.second);
+        double mid = 0.5*(range.first + range.second);
+        Point pm = evaluate(mid);
+        double chord = distance2d(p0, p1);
+        double error = chord > 0 ?
+            std::fabs((p1.x - p0.x)*(pm.y - p0.y) - (p1.y - p0.y)*(pm.x - p0.x)) / chord :
+            0;
+        if(error > max_error && std::fabs(range.second - range.first) > 1e-6) {
+            stack.push_back(std::make_pair(mid, range.second));
+            stack.push_back(std::make_pair(range.first, mid));
+        } else {
+            out.push_back(p1);
+        }
+    }
+    out.back() = to;
+    return out;
+}
+
+Voronoi::Voronoi(const std::vector<Circle>& circles) :
+    Voronoi(circles, Options())
+{
+}
+
+Voronoi::Voronoi(const std::vector<Circle>& circles, const Options& options)
+{
+    PerfCounters counters;
+    m_stats.counters = options.perf_counters && counters.open();
+    SerialScope serial(m_stats.counters);
+
+    counters.start();
+    std::vector<Point> centers(circles.size());
+    for(size_t ii = 0; ii < circles.size(); ii++)
+        centers[ii] = circles[ii].center;
+    std::vector<size_t> ordered = hilbertOrder(centers);
+    std::vector<size_t> rank(ordered.size());
+    for(size_t ii = 0; ii < ordered.size(); ii++)
+        rank[ordered[ii]] = ii;
+
+    // Biggest first, so that no site is hidden by one inserted after it and
+    // none have to be taken out of the triangulation again. That scatters
+    // the order, so point location goes by rank along the curve instead.
+    std::stable_sort(ordered.begin(), ordered.end(), [&](size_t a, size_t b) {
+        return circles[a].radius > circles[b].radius;
+    });
+    counters.stop(m_stats.sort);
+
+    counters.start();
+    ApolloniusPredicates predicates{&circles};
+    ApolloniusTriangulation triangulation(predicates);
+    bool triangulated = triangulation.build(ordered, rank);
+    counters.stop(m_stats.sweep);
+
+    counters.start();
+    if(!triangulated) {
+        for(size_t ii = 1; ii < ordered.size(); ii++) {
+            if(!predicates.coincident(ordered[ii - 1], ordered[ii]))
+                m_nodes.push_back(gapNode(circles, ordered[ii - 1], ordered[ii]));
+        }
+    } else {
+        dualGraph(triangulation, centers,
+                [&](const size_t (&sites)[3]) {
+                    return tangentNode(circles, sites);
+                },
+                [&](size_t a, size_t b) {
+                    return gapNode(circles, a, b);
+                }, m_nodes, m_edges);
+    }
+    counters.stop(m_stats.assembly);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include "geometry.h"
+#include "voronoi.h"
+
+/**
+ * Helpers for diagrams of circle sites, see Voronoi(const std::vector<Circle>&).
+ *
+ * The bisector between two circle sites is a branch of a hyperbola, the
+ * diagram only stores its end nodes, tessellateBisector() recovers the curve
+ * in between.
+ */
+
+/**
+ * Circle touching the three sites from outside (radius is negative where the
+ * sites overlap), the one that sees them in counterclockwise order
+ *
+ * @return false if there is no such circle
+ */
+bool tangentCircle(const std::vector<Circle>& circles,
+        const size_t (&sites)[3], Circle& out);
+
+/**
+ * Points along the bisector of a and b from one of its points to another,
+ * e.g. the two nodes of an edge whose parents are a and b. Consecutive points
+ * are within max_error of the curve between them.
+ */
+std::vector<Point> tessellateBisector(const Circle& a, const Circle& b,
+        const Point& from, const Point& to, float max_error);
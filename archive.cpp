@@ -0,0 +1,539 @@
+#include "archive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#include "parallel.h"
+
+namespace
+{
+
+const char MAGIC[4] = {'V', 'D', 'G', 'A'};
+const uint32_t VERSION = 1;
+
+// keeps deltas between quantized values within 32 bits after zigzag
+const double MAX_QUANTIZED = double(1 << 30);
+
+// lets the unpacking loop always read whole 64 bit words
+const size_t PACK_SLACK = 8;
+
+// marks a parent that is stored as a literal rather than a reference
+const uint32_t LITERAL = 3;
+
+struct BlockHeader
+{
+    // quantized x, y and radius of the first node
+    int32_t base[3];
+
+    // bits per packed delta for x, y and radius
+    uint8_t width[3];
+    uint8_t reserved;
+};
+
+uint32_t zigzag(int32_t value)
+{
+    return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value)
+{
+    return int32_t((value >> 1) ^ (~(value & 1) + 1));
+}
+
+void writeVarint(std::vector<char>& out, uint64_t value)
+{
+    while(value >= 0x80) {
+        out.push_back(char(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+bool readVarint(const char*& ptr, const char* end, uint64_t& value)
+{
+    value = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        if(ptr == end)
+            return false;
+        uint8_t byte = *ptr++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+size_t packedSize(size_t count, uint32_t width)
+{
+    return (count*width + 7) / 8 + PACK_SLACK;
+}
+
+uint32_t bitWidth(uint32_t value)
+{
+    uint32_t width = 0;
+    while(value) {
+        width++;
+        value >>= 1;
+    }
+    return width;
+}
+
+void pack(const std::vector<uint32_t>& values, uint32_t width, char* out)
+{
+    std::memset(out, 0, packedSize(values.size(), width));
+    for(size_t ii = 0; ii < values.size(); ii++) {
+        size_t bit = ii*width;
+        uint64_t word;
+        std::memcpy(&word, out + bit/8, sizeof(word));
+        word |= uint64_t(values[ii]) << (bit % 8);
+        std::memcpy(out + bit/8, &word, sizeof(word));
+    }
+}
+
+// width is at most 32 so a value never spans more than one 64 bit word
+void unpack(const char* data, size_t count, uint32_t width, uint32_t* out)
+{
+    uint64_t mask = (uint64_t(1) << width) - 1;
+    for(size_t ii = 0; ii < count; ii++) {
+        size_t bit = ii*width;
+        uint64_t word;
+        std::memcpy(&word, data + bit/8, sizeof(word));
+        out[ii] = uint32_t((word >> (bit % 8)) & mask);
+    }
+}
+
+bool quantize(float value, float resolution, int32_t& out)
+{
+    double scaled = std::round(double(value) / resolution);
+    if(!(std::fabs(scaled) < MAX_QUANTIZED))
+        return false;
+    out = int32_t(scaled);
+    return true;
+}
+
+template <size_t N>
+size_t parentCount(const uint32_t (&parents)[N])
+{
+    size_t count = 0;
+    while(count < N && parents[count] != NO_PARENT)
+        count++;
+    return count;
+}
+
+/**
+ * Parents as references into the parents of a previous node (prev) where
+ * possible. The leading byte holds the count and a 2 bit source per parent:
+ * an index into prev or LITERAL, literals follow as zigzag varint deltas.
+ */
+void writeParents(std::vector<char>& out, const uint32_t (&parents)[3],
+        const uint32_t (&prev)[3])
+{
+    size_t count = parentCount(parents);
+    size_t prev_count = parentCount(prev);
+    uint8_t code = count;
+    for(size_t ii = 0; ii < count; ii++) {
+        uint32_t source = LITERAL;
+        for(size_t jj = 0; jj < prev_count; jj++) {
+            if(prev[jj] == parents[ii])
+                source = jj;
+        }
+        code |= source << (2 + 2*ii);
+    }
+    out.push_back(char(code));
+
+    uint32_t base = prev_count > 0 ? prev[0] : 0;
+    for(size_t ii = 0; ii < count; ii++) {
+        if(((code >> (2 + 2*ii)) & 3) == LITERAL)
+            writeVarint(out, zigzag(int32_t(parents[ii] - base)));
+        base = parents[ii];
+    }
+}
+
+bool readParents(const char*& ptr, const char* end, uint32_t (&parents)[3],
+        const uint32_t (&prev)[3])
+{
+    if(ptr == end)
+        return false;
+    uint8_t code = *ptr++;
+    size_t count = code & 3;
+    size_t prev_count = parentCount(prev);
+
+    std::fill(parents, parents + 3, NO_PARENT);
+    uint32_t base = prev_count > 0 ? prev[0] : 0;
+    for(size_t ii = 0; ii < count; ii++) {
+        uint32_t source = (code >> (2 + 2*ii)) & 3;
+        if(source == LITERAL) {
+            uint64_t value;
+            if(!readVarint(ptr, end, value))
+                return false;
+            parents[ii] = base + uint32_t(unzigzag(uint32_t(value)));
+        } else if(source < prev_count) {
+            parents[ii] = prev[source];
+        } else {
+            return false;
+        }
+        base = parents[ii];
+    }
+    return true;
+}
+
+/**
+ * Renumber nodes in depth first order along the edges, sort edges by their
+ * (lower, upper) nodes in the new numbering
+ */
+FlatDiagram reorder(const FlatDiagram& diagram)
+{
+    size_t node_count = diagram.nodes.size();
+    std::vector<uint32_t> offsets(node_count + 1, 0);
+    for(const auto& edge : diagram.edges) {
+        offsets[edge.nodes[0] + 1]++;
+        offsets[edge.nodes[1] + 1]++;
+    }
+    for(size_t ii = 0; ii < node_count; ii++)
+        offsets[ii + 1] += offsets[ii];
+
+    std::vector<uint32_t> adjacent(offsets.back());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for(const auto& edge : diagram.edges) {
+        adjacent[fill[edge.nodes[0]]++] = edge.nodes[1];
+        adjacent[fill[edge.nodes[1]]++] = edge.nodes[0];
+    }
+
+    std::vector<uint32_t> rank(node_count, NO_PARENT);
+    std::vector<uint32_t> stack;
+    FlatDiagram out;
+    out.nodes.reserve(node_count);
+    for(uint32_t start = 0; start < node_count; start++) {
+        if(rank[start] != NO_PARENT)
+            continue;
+
+        stack.push_back(start);
+        while(!stack.empty()) {
+            uint32_t node = stack.back();
+            stack.pop_back();
+            if(rank[node] != NO_PARENT)
+                continue;
+
+            rank[node] = out.nodes.size();
+            out.nodes.push_back(diagram.nodes[node]);
+            for(uint32_t ii = offsets[node + 1]; ii > offsets[node]; ii--) {
+                if(rank[adjacent[ii - 1]] == NO_PARENT)
+                    stack.push_back(adjacent[ii - 1]);
+            }
+        }
+    }
+
+    out.edges = diagram.edges;
+    for(auto& edge : out.edges) {
+        uint32_t a = rank[edge.nodes[0]];
+        uint32_t b = rank[edge.nodes[1]];
+        edge.nodes[0] = std::min(a, b);
+        edge.nodes[1] = std::max(a, b);
+    }
+
+    parallelSort(out.edges.begin(), out.edges.end(),
+            [](const FlatDiagram::Edge& lhs, const FlatDiagram::Edge& rhs) {
+        return std::make_pair(lhs.nodes[0], lhs.nodes[1]) <
+            std::make_pair(rhs.nodes[0], rhs.nodes[1]);
+    });
+    return out;
+}
+
+bool encodeBlock(const FlatDiagram& diagram, float resolution,
+        const ArchiveBlock& block, std::vector<char>& out)
+{
+    const FlatDiagram::Node* nodes = &diagram.nodes[block.first_node];
+    size_t count = block.node_count;
+
+    BlockHeader header;
+    header.reserved = 0;
+    std::vector<uint32_t> deltas[3];
+    for(size_t field = 0; field < 3; field++) {
+        int32_t prev = 0;
+        uint32_t max = 0;
+        deltas[field].resize(count);
+        for(size_t ii = 0; ii < count; ii++) {
+            float value = field == 0 ? nodes[ii].x :
+                field == 1 ? nodes[ii].y : nodes[ii].radius;
+            int32_t quantized;
+            if(!quantize(value, resolution, quantized))
+                return false;
+            if(ii == 0) {
+                header.base[field] = quantized;
+                prev = quantized;
+            }
+            deltas[field][ii] = zigzag(quantized - prev);
+            max = std::max(max, deltas[field][ii]);
+            prev = quantized;
+        }
+        header.width[field] = bitWidth(max);
+    }
+
+    out.resize(sizeof(header));
+    std::memcpy(out.data(), &header, sizeof(header));
+    for(size_t field = 0; field < 3; field++) {
+        size_t offset = out.size();
+        out.resize(offset + packedSize(count, header.width[field]));
+        pack(deltas[field], header.width[field], &out[offset]);
+    }
+
+    uint32_t prev[3] = {NO_PARENT, NO_PARENT, NO_PARENT};
+    for(size_t ii = 0; ii < count; ii++) {
+        writeParents(out, nodes[ii].parents, prev);
+        std::copy(nodes[ii].parents, nodes[ii].parents + 3, prev);
+    }
+
+    // edge parents are usually a subset of their lower node's parents, stored
+    // as a 3 bit mask next to the upper node, 0 means they follow explicitly
+    uint32_t prev_lower = block.first_node;
+    for(size_t ii = 0; ii < block.edge_count; ii++) {
+        const auto& edge = diagram.edges[block.first_edge + ii];
+        const auto& lower = diagram.nodes[edge.nodes[0]].parents;
+        size_t parent_count = parentCount(edge.parents);
+
+        uint32_t mask = 0;
+        for(size_t jj = 0; jj < 3 && lower[jj] != NO_PARENT; jj++) {
+            if(std::find(edge.parents, edge.parents + parent_count, lower[jj]) !=
+                    edge.parents + parent_count)
+                mask |= 1 << jj;
+        }
+        if(size_t(__builtin_popcount(mask)) != parent_count)
+            mask = 0;
+
+        writeVarint(out, edge.nodes[0] - prev_lower);
+        writeVarint(out, (uint64_t(edge.nodes[1] - edge.nodes[0]) << 3) | mask);
+        if(mask == 0) {
+            writeVarint(out, parent_count);
+            uint32_t base = 0;
+            for(size_t jj = 0; jj < parent_count; jj++) {
+                writeVarint(out, zigzag(int32_t(edge.parents[jj] - base)));
+                base = edge.parents[jj];
+            }
+        }
+        prev_lower = edge.nodes[0];
+    }
+    return true;
+}
+
+/**
+ * Decode block into nodes and edges, which must have room for the block's
+ * node_count and edge_count entries
+ */
+bool decodeBlock(const ArchiveView& archive, const ArchiveBlock& block,
+        FlatDiagram::Node* nodes, FlatDiagram::Edge* edges)
+{
+    const char* ptr = archive.data + block.offset;
+    const char* end = ptr + block.size;
+    size_t count = block.node_count;
+    float resolution = archive.header->resolution;
+
+    BlockHeader header;
+    if(block.size < sizeof(header))
+        return false;
+    std::memcpy(&header, ptr, sizeof(header));
+    ptr += sizeof(header);
+
+    std::vector<uint32_t> deltas(count);
+    for(size_t field = 0; field < 3; field++) {
+        uint32_t width = header.width[field];
+        if(width > 32 || size_t(end - ptr) < packedSize(count, width))
+            return false;
+        unpack(ptr, count, width, deltas.data());
+        ptr += packedSize(count, width);
+
+        uint32_t value = header.base[field];
+        for(size_t ii = 0; ii < count; ii++) {
+            value += uint32_t(unzigzag(deltas[ii]));
+            float decoded = float(int32_t(value)) * resolution;
+            if(field == 0)
+                nodes[ii].x = decoded;
+            else if(field == 1)
+                nodes[ii].y = decoded;
+            else
+                nodes[ii].radius = decoded;
+        }
+    }
+
+    uint32_t prev[3] = {NO_PARENT, NO_PARENT, NO_PARENT};
+    for(size_t ii = 0; ii < count; ii++) {
+        if(!readParents(ptr, end, nodes[ii].parents, prev))
+            return false;
+        std::copy(nodes[ii].parents, nodes[ii].parents + 3, prev);
+    }
+
+    uint64_t lower = block.first_node;
+    for(size_t ii = 0; ii < block.edge_count; ii++) {
+        uint64_t delta, packed;
+        if(!readVarint(ptr, end, delta) || !readVarint(ptr, end, packed))
+            return false;
+
+        lower += delta;
+        uint64_t upper = lower + (packed >> 3);
+        if(lower >= block.first_node + count ||
+                upper >= archive.header->node_count)
+            return false;
+
+        auto& edge = edges[ii];
+        edge.nodes[0] = lower;
+        edge.nodes[1] = upper;
+        std::fill(edge.parents, edge.parents + 2, NO_PARENT);
+
+        uint32_t mask = packed & 7;
+        if(mask != 0) {
+            const auto& parents = nodes[lower - block.first_node].parents;
+            size_t out = 0;
+            for(size_t jj = 0; jj < 3; jj++) {
+                if(!(mask & (1 << jj)))
+                    continue;
+                if(out == 2 || parents[jj] == NO_PARENT)
+                    return false;
+                edge.parents[out++] = parents[jj];
+            }
+        } else {
+            uint64_t parent_count;
+            if(!readVarint(ptr, end, parent_count) || parent_count > 2)
+                return false;
+            uint32_t base = 0;
+            for(size_t jj = 0; jj < parent_count; jj++) {
+                uint64_t value;
+                if(!readVarint(ptr, end, value))
+                    return false;
+                edge.parents[jj] = base + uint32_t(unzigzag(uint32_t(value)));
+                base = edge.parents[jj];
+            }
+        }
+    }
+    return ptr == end;
+}
+
+}
+
+bool encodeArchive(const FlatDiagram& diagram, const ArchiveOptions& options,
+        std::vector<char>& out)
+{
+    if(!(options.resolution > 0) || options.block_nodes == 0)
+        return false;
+
+    FlatDiagram ordered = reorder(diagram);
+
+    size_t node_count = ordered.nodes.size();
+    size_t block_count = (node_count + options.block_nodes - 1) / options.block_nodes;
+    std::vector<ArchiveBlock> blocks(block_count);
+    size_t edge = 0;
+    for(size_t ii = 0; ii < block_count; ii++) {
+        auto& block = blocks[ii];
+        block.first_node = ii*options.block_nodes;
+        block.node_count = std::min<size_t>(options.block_nodes,
+                node_count - block.first_node);
+        block.first_edge = edge;
+        while(edge < ordered.edges.size() &&
+                ordered.edges[edge].nodes[0] < block.first_node + block.node_count)
+            edge++;
+        block.edge_count = edge - block.first_edge;
+    }
+
+    std::vector<std::vector<char>> encoded(block_count);
+    std::vector<char> success(block_count);
+    parallelFor(0, block_count, [&](size_t ii) {
+        success[ii] = encodeBlock(ordered, options.resolution, blocks[ii],
+                encoded[ii]);
+    });
+    if(std::find(success.begin(), success.end(), false) != success.end())
+        return false;
+
+    ArchiveHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.resolution = options.resolution;
+    header.block_nodes = options.block_nodes;
+    header.node_count = node_count;
+    header.edge_count = ordered.edges.size();
+    header.block_count = block_count;
+    header.reserved = 0;
+
+    size_t offset = sizeof(header) + block_count*sizeof(ArchiveBlock);
+    for(size_t ii = 0; ii < block_count; ii++) {
+        blocks[ii].offset = offset;
+        blocks[ii].size = encoded[ii].size();
+        offset += encoded[ii].size();
+    }
+
+    out.resize(offset);
+    std::memcpy(out.data(), &header, sizeof(header));
+    if(block_count > 0) {
+        std::memcpy(out.data() + sizeof(header), blocks.data(),
+                block_count*sizeof(ArchiveBlock));
+    }
+    for(size_t ii = 0; ii < block_count; ii++)
+        std::copy(encoded[ii].begin(), encoded[ii].end(), &out[blocks[ii].offset]);
+    return true;
+}
+
+bool viewArchive(const char* data, size_t size, ArchiveView& out)
+{
+    if(size < sizeof(ArchiveHeader))
+        return false;
+
+    auto header = reinterpret_cast<const ArchiveHeader*>(data);
+    if(std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header->version != VERSION ||
+            size < sizeof(ArchiveHeader) + size_t(header->block_count)*sizeof(ArchiveBlock))
+        return false;
+
+    // Every node takes at least its parents' code byte and every edge two
+    // varints on top of the block header and packing slack, so counts the
+    // block can't hold are refused before anything is sized by them
+    auto blocks = reinterpret_cast<const ArchiveBlock*>(data + sizeof(ArchiveHeader));
+    uint64_t node = 0, edge = 0;
+    for(size_t ii = 0; ii < header->block_count; ii++) {
+        const auto& block = blocks[ii];
+        if(block.first_node != node || block.first_edge != edge ||
+                block.offset > size || block.size > size - block.offset ||
+                block.node_count > header->block_nodes ||
+                block.size < sizeof(BlockHeader) + 3*PACK_SLACK +
+                    uint64_t(block.node_count) + 2*uint64_t(block.edge_count))
+            return false;
+        node += block.node_count;
+        edge += block.edge_count;
+    }
+    if(node != header->node_count || edge != header->edge_count)
+        return false;
+
+    out.header = header;
+    out.blocks = blocks;
+    out.data = data;
+    out.size = size;
+    return true;
+}
+
+bool decodeBlock(const ArchiveView& archive, size_t block, FlatDiagram& out)
+{
+    if(block >= archive.header->block_count)
+        return false;
+
+    const auto& info = archive.blocks[block];
+    out.nodes.resize(info.node_count);
+    out.edges.resize(info.edge_count);
+    return decodeBlock(archive, info, out.nodes.data(), out.edges.data());
+}
+
+bool decodeArchive(const char* data, size_t size, FlatDiagram& out)
+{
+    ArchiveView archive;
+    if(!viewArchive(data, size, archive))
+        return false;
+
+    out.nodes.resize(archive.header->node_count);
+    out.edges.resize(archive.header->edge_count);
+
+    size_t block_count = archive.header->block_count;
+    std::vector<char> success(block_count);
+    parallelFor(0, block_count, [&](size_t ii) {
+        const auto& block = archive.blocks[ii];
+        success[ii] = decodeBlock(archive, block,
+                out.nodes.data() + block.first_node,
+                out.edges.data() + block.first_edge);
+    });
+    return std::find(success.begin(), success.end(), false) == success.end();
+}
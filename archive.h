@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "diagram_io.h"
+
+/**
+ * Compressed archival format for flat diagrams.
+ *
+ * Nodes are renumbered in depth first order along the edges so that
+ * consecutive nodes mostly sit next to each other on the same chain, then cut
+ * into blocks of a fixed number of nodes. Each block is decodable on its own:
+ *
+ *  - x, y and radius are quantized to a fixed resolution and stored as deltas
+ *    from the previous node, zigzag encoded and bit packed with the smallest
+ *    width that fits the block. Unpacking is a fixed width, branch free loop
+ *    followed by a prefix sum.
+ *  - node parents are stored as references into the previous node's parents
+ *    where possible, the rest as zigzag varint deltas.
+ *  - edges belong to the block of their lower node and are stored sorted, as
+ *    varint deltas. An edge whose parents are just the parents its two nodes
+ *    share costs a single flag bit for them.
+ *
+ * A block index after the header gives the offset and node / edge range of
+ * every block for random access.
+ *
+ * The archive is lossy in two ways: coordinates are rounded to the
+ * resolution, and nodes and edges come back in archive order, with the lower
+ * node of each edge first.
+ *
+ * Layout (native byte order):
+ *
+ *  ArchiveHeader
+ *  ArchiveBlock[block_count]
+ *  block data
+ */
+
+struct ArchiveOptions
+{
+    // quantization step for x, y and radius
+    float resolution = 1.0f / 1024;
+
+    // nodes per block
+    uint32_t block_nodes = 4096;
+};
+
+struct ArchiveHeader
+{
+    char magic[4];
+    uint32_t version;
+    float resolution;
+    uint32_t block_nodes;
+    uint32_t node_count;
+    uint32_t edge_count;
+    uint32_t block_count;
+    uint32_t reserved;
+};
+
+struct ArchiveBlock
+{
+    // offset of the block data from the start of the archive
+    uint64_t offset;
+    uint64_t size;
+
+    uint32_t first_node;
+    uint32_t node_count;
+    uint32_t first_edge;
+    uint32_t edge_count;
+};
+
+// Pointers into a buffer holding an archive
+struct ArchiveView
+{
+    const ArchiveHeader* header;
+    const ArchiveBlock* blocks;
+    const char* data;
+    size_t size;
+};
+
+/**
+ * Encode the diagram as an archive, blocks are encoded in parallel
+ *
+ * @return false if a coordinate is too large to be quantized at the requested
+ * resolution
+ */
+bool encodeArchive(const FlatDiagram& diagram, const ArchiveOptions& options,
+        std::vector<char>& out);
+
+// Check the header and block index, including that each block is big enough
+// for its node and edge counts, returns false if data is not an archive
+bool viewArchive(const char* data, size_t size, ArchiveView& out);
+
+/**
+ * Decode a single block, out gets the block's nodes and edges. Edges still
+ * refer to nodes by their index in the whole archive.
+ */
+bool decodeBlock(const ArchiveView& archive, size_t block, FlatDiagram& out);
+
+// Decode the whole archive, blocks are decoded in parallel
+bool decodeArchive(const char* data, size_t size, FlatDiagram& out);
@@ -0,0 +1,530 @@
+#pragma once
+
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Ordered sequence kept in a B+ tree, for the beach line.
+ *
+ * Elements live in linked leaves of up to ORDER elements. Every inner node
+ * keeps, next to each child, a copy of the last element under that child,
+ * so a search compares against live elements only and visits one node per
+ * level. Nodes split when full and are merged with or refilled from a
+ * sibling when they fall under half full, so the tree stays balanced and an
+ * insert or erase moves at most a few nodes' worth of elements.
+ *
+ * The beach line's order depends on the sweep, and two breakpoints that
+ * nearly meet can compare either way. So lower_bound is the only operation
+ * that compares; inserts go before a given position and erases take a
+ * position, and the caller decides where an element belongs. Unlike
+ * std::set, any insert or erase invalidates iterators, use the one
+ * returned.
+ */
+template <typename T, typename Compare, size_t ORDER = 16>
+class BTreeSet
+{
+    static_assert(ORDER >= 4, "nodes must split into at least two");
+    static const size_t MIN_COUNT = ORDER/2;
+
+    struct Inner;
+
+    struct Node
+    {
+        Node(bool leaf) : leaf(leaf), count(0), parent(nullptr) {}
+
+        bool leaf;
+        uint32_t count;
+        Inner* parent;
+    };
+
+    struct Leaf : Node
+    {
+        Leaf() : Node(true), prev(nullptr), next(nullptr) {}
+
+        Leaf* prev;
+        Leaf* next;
+        T items[ORDER];
+    };
+
+    struct Inner : Node
+    {
+        Inner() : Node(false) {}
+
+        Node* children[ORDER];
+        // last element under each child
+        T keys[ORDER];
+    };
+
+    // Where an element is, or would be after a rebalance
+    struct Position
+    {
+        Leaf* leaf;
+        size_t slot;
+    };
+
+public:
+    class const_iterator
+    {
+    public:
+        const_iterator() : m_set(nullptr), m_leaf(nullptr), m_slot(0) {}
+
+        const T& operator*() const
+        {
+            return m_leaf->items[m_slot];
+        }
+
+        const T* operator->() const
+        {
+            return &**this;
+        }
+
+        const_iterator& operator++()
+        {
+            if(++m_slot == m_leaf->count) {
+                m_leaf = m_leaf->next;
+                m_slot = 0;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        const_iterator& operator--()
+        {
+            if(m_leaf == nullptr) {
+                m_leaf = m_set->m_last;
+                m_slot = m_leaf->count;
+            } else if(m_slot == 0) {
+                m_leaf = m_leaf->prev;
+                m_slot = m_leaf->count;
+            }
+            m_slot--;
+            return *this;
+        }
+
+        const_iterator operator--(int)
+        {
+            const_iterator copy = *this;
+            --*this;
+            return copy;
+        }
+
+        bool operator==(const const_iterator& rhs) const
+        {
+            return m_leaf == rhs.m_leaf && m_slot == rhs.m_slot;
+        }
+
+        bool operator!=(const const_iterator& rhs) const
+        {
+            return !(*this == rhs);
+        }
+
+    private:
+        friend class BTreeSet;
+
+        const_iterator(const BTreeSet* set, Leaf* leaf, size_t slot) :
+            m_set(set), m_leaf(leaf), m_slot(slot) {}
+
+        const BTreeSet* m_set;
+        Leaf* m_leaf;
+        size_t m_slot;
+    };
+
+    // elements can't be changed in place, that could break the order
+    typedef const_iterator iterator;
+
+    BTreeSet(const Compare& compare) : m_compare(compare), m_root(nullptr),
+        m_first(nullptr), m_last(nullptr), m_size(0) {}
+
+    ~BTreeSet()
+    {
+        clear();
+    }
+
+    BTreeSet(const BTreeSet&) = delete;
+    BTreeSet& operator=(const BTreeSet&) = delete;
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, m_first, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, nullptr, 0);
+    }
+
+    void clear()
+    {
+        if(m_root)
+            destroy(m_root);
+        m_root = nullptr;
+        m_first = nullptr;
+        m_last = nullptr;
+        m_size = 0;
+    }
+
+    // First element not less than value
+    const_iterator lower_bound(const T& value) const
+    {
+        if(m_root == nullptr)
+            return end();
+
+        const Node* node = m_root;
+        while(!node->leaf) {
+            const Inner* inner = static_cast<const Inner*>(node);
+            size_t ii = search(inner->keys, inner->count, value);
+            if(ii == inner->count)
+                return end();
+            node = inner->children[ii];
+        }
+
+        const Leaf* leaf = static_cast<const Leaf*>(node);
+        size_t slot = search(leaf->items, leaf->count, value);
+        // below the root the parent's key is this leaf's last element, so
+        // only a root leaf can come up empty
+        if(slot == leaf->count)
+            return end();
+        return const_iterator(this, const_cast<Leaf*>(leaf), slot);
+    }
+
+    // Inserts value just before pos, which must be where it belongs
+    const_iterator insert(const_iterator pos, const T& value)
+    {
+        if(m_root == nullptr) {
+            Leaf* leaf = new Leaf;
+            m_root = m_first = m_last = leaf;
+            leaf->items[0] = value;
+            leaf->count = 1;
+            m_size = 1;
+            return begin();
+        }
+
+        Leaf* leaf = pos.m_leaf;
+        size_t slot = pos.m_slot;
+        if(leaf == nullptr) {
+            leaf = m_last;
+            slot = leaf->count;
+        }
+
+        if(leaf->count == ORDER) {
+            // split in half, moving the upper half to a new leaf after it
+            Leaf* upper = new Leaf;
+            upper->count = ORDER - MIN_COUNT;
+            for(size_t ii = 0; ii < upper->count; ii++)
+                upper->items[ii] = leaf->items[MIN_COUNT + ii];
+            leaf->count = MIN_COUNT;
+
+            upper->prev = leaf;
+            upper->next = leaf->next;
+            if(leaf->next)
+                leaf->next->prev = upper;
+            else
+                m_last = upper;
+            leaf->next = upper;
+            insertChild(leaf, upper);
+
+            if(slot > MIN_COUNT) {
+                leaf = upper;
+                slot -= MIN_COUNT;
+            }
+        }
+
+        for(size_t ii = leaf->count; ii > slot; ii--)
+            leaf->items[ii] = leaf->items[ii - 1];
+        leaf->items[slot] = value;
+        leaf->count++;
+        m_size++;
+        if(slot + 1 == leaf->count)
+            refresh(leaf);
+        return const_iterator(this, leaf, slot);
+    }
+
+    // Returns the element after the erased one
+    const_iterator erase(const_iterator pos)
+    {
+        Leaf* leaf = pos.m_leaf;
+        size_t slot = pos.m_slot;
+        for(size_t ii = slot; ii + 1 < leaf->count; ii++)
+            leaf->items[ii] = leaf->items[ii + 1];
+        leaf->count--;
+        m_size--;
+
+        if(leaf->count == 0 && leaf == m_root) {
+            clear();
+            return end();
+        }
+
+        Position next = {leaf, slot};
+        if(slot == leaf->count) {
+            next.leaf = leaf->next;
+            next.slot = 0;
+            if(leaf->count > 0)
+                refresh(leaf);
+        }
+        if(leaf != m_root && leaf->count < MIN_COUNT)
+            rebalance(leaf, next);
+        return const_iterator(this, next.leaf, next.slot);
+    }
+
+private:
+    static void destroy(Node* node)
+    {
+        if(node->leaf) {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        Inner* inner = static_cast<Inner*>(node);
+        for(size_t ii = 0; ii < inner->count; ii++)
+            destroy(inner->children[ii]);
+        delete inner;
+    }
+
+    // First of count sorted elements that isn't less than value. Testing
+    // every element of a node in one pass without branches measured no
+    // faster for the beach line: its elements point at their sites, so the
+    // pass loads a node's worth of sites where this loads four, and its
+    // comparisons only vectorize with -fno-trapping-math.
+    size_t search(const T* items, size_t count, const T& value) const
+    {
+        size_t first = 0, last = count;
+        while(first < last) {
+            size_t mid = (first + last) / 2;
+            if(m_compare(items[mid], value))
+                first = mid + 1;
+            else
+                last = mid;
+        }
+        return first;
+    }
+
+    static const T& lastOf(const Node* node)
+    {
+        if(node->leaf)
+            return static_cast<const Leaf*>(node)->items[node->count - 1];
+        return static_cast<const Inner*>(node)->keys[node->count - 1];
+    }
+
+    static size_t indexOf(const Inner* parent, const Node* child)
+    {
+        size_t ii = 0;
+        while(parent->children[ii] != child)
+            ii++;
+        return ii;
+    }
+
+    // Updates the keys above node after its last element changed
+    static void refresh(Node* node)
+    {
+        while(Inner* parent = node->parent) {
+            size_t ii = indexOf(parent, node);
+            parent->keys[ii] = lastOf(node);
+            if(ii + 1 != parent->count)
+                break;
+            node = parent;
+        }
+    }
+
+    // Adds right to the tree just after left, which was just split
+    void insertChild(Node* left, Node* right)
+    {
+        Inner* parent = left->parent;
+        if(parent == nullptr) {
+            parent = new Inner;
+            parent->count = 2;
+            parent->children[0] = left;
+            parent->children[1] = right;
+            parent->keys[0] = lastOf(left);
+            parent->keys[1] = lastOf(right);
+            left->parent = parent;
+            right->parent = parent;
+            m_root = parent;
+            return;
+        }
+
+        if(parent->count == ORDER) {
+            Inner* upper = new Inner;
+            upper->count = ORDER - MIN_COUNT;
+            for(size_t ii = 0; ii < upper->count; ii++) {
+                upper->children[ii] = parent->children[MIN_COUNT + ii];
+                upper->keys[ii] = parent->keys[MIN_COUNT + ii];
+                upper->children[ii]->parent = upper;
+            }
+            parent->count = MIN_COUNT;
+            insertChild(parent, upper);
+            parent = left->parent;
+        }
+
+        size_t index = indexOf(parent, left) + 1;
+        for(size_t ii = parent->count; ii > index; ii--) {
+            parent->children[ii] = parent->children[ii - 1];
+            parent->keys[ii] = parent->keys[ii - 1];
+        }
+        parent->children[index] = right;
+        parent->count++;
+        right->parent = parent;
+        parent->keys[index - 1] = lastOf(left);
+        refresh(right);
+    }
+
+    // Maps next, if it's in left or right, to where a move of elements from
+    // a node pair with left_count and right_count to one with new_left
+    // elements on the left puts it
+    static void remap(Position& next, Leaf* left, Leaf* right,
+            size_t left_count, size_t new_left)
+    {
+        size_t index;
+        if(next.leaf == left)
+            index = next.slot;
+        else if(next.leaf == right)
+            index = left_count + next.slot;
+        else
+            return;
+
+        if(index < new_left) {
+            next.leaf = left;
+            next.slot = index;
+        } else {
+            next.leaf = right;
+            next.slot = index - new_left;
+        }
+    }
+
+    // Merges node, which fell under half full, with a sibling or moves
+    // elements over from one
+    void rebalance(Node* node, Position& next)
+    {
+        Inner* parent = node->parent;
+        size_t index = indexOf(parent, node);
+        if(index > 0)
+            index--;
+        Node* left = parent->children[index];
+        Node* right = parent->children[index + 1];
+        size_t left_count = left->count;
+        size_t total = left->count + right->count;
+
+        if(total <= ORDER) {
+            // everything moves into left and right goes away
+            move(left, right, total);
+            if(left->leaf) {
+                Leaf* left_leaf = static_cast<Leaf*>(left);
+                Leaf* right_leaf = static_cast<Leaf*>(right);
+                remap(next, left_leaf, right_leaf, left_count, total);
+                left_leaf->next = right_leaf->next;
+                if(right_leaf->next)
+                    right_leaf->next->prev = left_leaf;
+                else
+                    m_last = left_leaf;
+                delete right_leaf;
+            } else {
+                delete static_cast<Inner*>(right);
+            }
+
+            for(size_t ii = index + 1; ii + 1 < parent->count; ii++) {
+                parent->children[ii] = parent->children[ii + 1];
+                parent->keys[ii] = parent->keys[ii + 1];
+            }
+            parent->count--;
+            refresh(left);
+
+            if(parent == m_root) {
+                if(parent->count == 1) {
+                    m_root = left;
+                    left->parent = nullptr;
+                    delete parent;
+                }
+            } else if(parent->count < MIN_COUNT) {
+                rebalance(parent, next);
+            }
+            return;
+        }
+
+        // share evenly, the parent keeps its children
+        size_t new_left = total / 2;
+        move(left, right, new_left);
+        if(left->leaf) {
+            remap(next, static_cast<Leaf*>(left), static_cast<Leaf*>(right),
+                    left_count, new_left);
+        }
+        refresh(left);
+        refresh(right);
+    }
+
+    // Moves elements between neighbors so that left has new_left of them
+    static void move(Node* left, Node* right, size_t new_left)
+    {
+        size_t total = left->count + right->count;
+        if(left->leaf) {
+            moveItems(static_cast<Leaf*>(left)->items,
+                    static_cast<Leaf*>(right)->items, nullptr, nullptr,
+                    left->count, right->count, new_left, nullptr);
+        } else {
+            Inner* left_inner = static_cast<Inner*>(left);
+            Inner* right_inner = static_cast<Inner*>(right);
+            moveItems(left_inner->keys, right_inner->keys,
+                    left_inner->children, right_inner->children,
+                    left->count, right->count, new_left, left_inner);
+            for(size_t ii = 0; ii + new_left < total; ii++)
+                right_inner->children[ii]->parent = right_inner;
+        }
+        left->count = new_left;
+        right->count = total - new_left;
+    }
+
+    static void moveItems(T* left, T* right, Node** left_children,
+            Node** right_children, size_t left_count, size_t right_count,
+            size_t new_left, Inner* left_parent)
+    {
+        if(new_left > left_count) {
+            // the first of right go to the end of left
+            size_t shift = new_left - left_count;
+            for(size_t ii = 0; ii < shift; ii++) {
+                left[left_count + ii] = right[ii];
+                if(left_children) {
+                    left_children[left_count + ii] = right_children[ii];
+                    left_children[left_count + ii]->parent = left_parent;
+                }
+            }
+            for(size_t ii = shift; ii < right_count; ii++) {
+                right[ii - shift] = right[ii];
+                if(right_children)
+                    right_children[ii - shift] = right_children[ii];
+            }
+        } else if(new_left < left_count) {
+            // the last of left go to the front of right
+            size_t shift = left_count - new_left;
+            for(size_t ii = right_count; ii > 0; ii--) {
+                right[ii - 1 + shift] = right[ii - 1];
+                if(right_children)
+                    right_children[ii - 1 + shift] = right_children[ii - 1];
+            }
+            for(size_t ii = 0; ii < shift; ii++) {
+                right[ii] = left[new_left + ii];
+                if(right_children)
+                    right_children[ii] = left_children[new_left + ii];
+            }
+        }
+    }
+
+    Compare m_compare;
+    Node* m_root;
+    Leaf* m_first;
+    Leaf* m_last;
+    size_t m_size;
+};
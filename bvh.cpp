@@ -0,0 +1,176 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <queue>
+#include <cmath>
+
+namespace
+{
+
+const uint32_t LEAF_SIZE = 8;
+
+double sqr(double v)
+{
+    return v*v;
+}
+
+}
+
+const size_t BoundingVolumeHierarchy::NONE;
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(const std::vector<Item>& items) :
+    m_items(items)
+{
+    if(m_items.empty())
+        return;
+
+    m_nodes.reserve(2*m_items.size() / LEAF_SIZE + 1);
+    build(0, m_items.size());
+}
+
+/**
+ * Recursively split the items at the median of the longer side of their
+ * bounding box.
+ *
+ * @return index of the new node
+ */
+uint32_t BoundingVolumeHierarchy::build(uint32_t begin, uint32_t end)
+{
+    uint32_t index = m_nodes.size();
+    m_nodes.push_back(Node());
+
+    Node node;
+    node.min_x = node.min_y = std::numeric_limits<float>::infinity();
+    node.max_x = node.max_y = -std::numeric_limits<float>::infinity();
+    node.max_key = -std::numeric_limits<float>::infinity();
+    node.begin = begin;
+    node.end = end;
+    node.left = node.right = 0;
+    for(uint32_t ii = begin; ii < end; ii++) {
+        const Item& item = m_items[ii];
+        node.min_x = std::min(node.min_x, item.position.x);
+        node.min_y = std::min(node.min_y, item.position.y);
+        node.max_x = std::max(node.max_x, item.position.x);
+        node.max_y = std::max(node.max_y, item.position.y);
+        node.max_key = std::max(node.max_key, item.key);
+    }
+
+    if(end - begin > LEAF_SIZE) {
+        uint32_t mid = begin + (end - begin) / 2;
+        if(node.max_x - node.min_x > node.max_y - node.min_y) {
+            std::nth_element(m_items.begin() + begin, m_items.begin() + mid,
+                    m_items.begin() + end, [](const Item& lhs, const Item& rhs) {
+                        return lhs.position.x < rhs.position.x;
+                    });
+        } else {
+            std::nth_element(m_items.begin() + begin, m_items.begin() + mid,
+                    m_items.begin() + end, [](const Item& lhs, const Item& rhs) {
+                        return lhs.position.y < rhs.position.y;
+                    });
+        }
+        node.left = build(begin, mid);
+        node.right = build(mid, end);
+    }
+
+    m_nodes[index] = node;
+    return index;
+}
+
+float BoundingVolumeHierarchy::distanceSquared(const Node& node,
+        const Point& pt) const
+{
+    double dx = std::max<double>(0, std::max(node.min_x - pt.x, pt.x - node.max_x));
+    double dy = std::max<double>(0, std::max(node.min_y - pt.y, pt.y - node.max_y));
+    return dx*dx + dy*dy;
+}
+
+size_t BoundingVolumeHierarchy::nearest(const Point& pt, float& distance,
+        float min_key) const
+{
+    size_t best = NONE;
+    double best_dist = std::numeric_limits<double>::infinity();
+    if(m_nodes.empty() || m_nodes[0].max_key < min_key) {
+        distance = best_dist;
+        return best;
+    }
+
+    // depth first, visiting the closer child first so that the bound tightens
+    // quickly
+    uint32_t stack[64];
+    size_t depth = 0;
+    stack[depth++] = 0;
+    while(depth > 0) {
+        const Node& node = m_nodes[stack[--depth]];
+        if(distanceSquared(node, pt) >= best_dist || node.max_key < min_key)
+            continue;
+
+        if(node.left == 0) {
+            for(uint32_t ii = node.begin; ii < node.end; ii++) {
+                const Item& item = m_items[ii];
+                if(item.key < min_key)
+                    continue;
+                double dist = sqr(item.position.x - pt.x) +
+                    sqr(item.position.y - pt.y);
+                if(dist < best_dist) {
+                    best_dist = dist;
+                    best = ii;
+                }
+            }
+            continue;
+        }
+
+        uint32_t near = node.left;
+        uint32_t far = node.right;
+        if(distanceSquared(m_nodes[far], pt) < distanceSquared(m_nodes[near], pt))
+            std::swap(near, far);
+        stack[depth++] = far;
+        stack[depth++] = near;
+    }
+
+    distance = std::sqrt(best_dist);
+    return best;
+}
+
+std::vector<size_t> BoundingVolumeHierarchy::largest(const Point& lo,
+        const Point& hi, size_t k) const
+{
+    std::vector<size_t> out;
+    if(m_nodes.empty() || k == 0)
+        return out;
+
+    // Best first search, nodes are queued with the largest key below them and
+    // items with their own key, so an item is only popped once nothing left
+    // in the queue can beat it. Items are told apart from nodes by setting the
+    // top bit of the index.
+    const size_t ITEM = size_t(1) << (sizeof(size_t)*8 - 1);
+    typedef std::pair<float, size_t> Entry;
+    std::priority_queue<Entry> queue;
+    queue.push(Entry(m_nodes[0].max_key, 0));
+    while(!queue.empty() && out.size() < k) {
+        Entry entry = queue.top();
+        queue.pop();
+
+        if(entry.second & ITEM) {
+            out.push_back(entry.second & ~ITEM);
+            continue;
+        }
+
+        const Node& node = m_nodes[entry.second];
+        if(node.max_x < lo.x || node.min_x > hi.x ||
+                node.max_y < lo.y || node.min_y > hi.y)
+            continue;
+
+        if(node.left == 0) {
+            for(uint32_t ii = node.begin; ii < node.end; ii++) {
+                const Point& pos = m_items[ii].position;
+                if(pos.x >= lo.x && pos.x <= hi.x && pos.y >= lo.y && pos.y <= hi.y)
+                    queue.push(Entry(m_items[ii].key, ii | ITEM));
+            }
+        } else {
+            queue.push(Entry(m_nodes[node.left].max_key, node.left));
+            queue.push(Entry(m_nodes[node.right].max_key, node.right));
+        }
+    }
+
+    return out;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+#include "geometry.h"
+
+/**
+ * Static bounding volume hierarchy over points that each carry a key.
+ *
+ * Every node of the tree stores the bounding box of its points along with the
+ * largest key below it, so queries can skip whole subtrees that are too far
+ * away or whose keys are too small.
+ */
+class BoundingVolumeHierarchy
+{
+public:
+    static const size_t NONE = std::numeric_limits<size_t>::max();
+
+    struct Item
+    {
+        Point position;
+        float key;
+        size_t id;
+    };
+
+    BoundingVolumeHierarchy() {};
+    BoundingVolumeHierarchy(const std::vector<Item>& items);
+
+    size_t size() const
+    {
+        return m_items.size();
+    }
+
+    const Item& operator[](size_t ii) const
+    {
+        return m_items[ii];
+    }
+
+    /**
+     * Find the item closest to pt, considering only items with key >= min_key
+     *
+     * @param pt Query position
+     * @param distance Output, distance from pt to the returned item
+     * @param min_key Items with smaller keys are ignored
+     * @return index of the item, or NONE if there are no matching items
+     */
+    size_t nearest(const Point& pt, float& distance,
+            float min_key = -std::numeric_limits<float>::infinity()) const;
+
+    /**
+     * Find the k items with the largest keys that lie in the box [lo, hi]
+     *
+     * @return indices of the items in order of decreasing key
+     */
+    std::vector<size_t> largest(const Point& lo, const Point& hi,
+            size_t k) const;
+
+private:
+    struct Node
+    {
+        float min_x, min_y, max_x, max_y;
+        float max_key;
+        uint32_t begin, end;
+
+        // children, 0 for leaves since the root is never a child
+        uint32_t left, right;
+    };
+
+    uint32_t build(uint32_t begin, uint32_t end);
+    float distanceSquared(const Node& node, const Point& pt) const;
+
+    std::vector<Item> m_items;
+    std::vector<Node> m_nodes;
+};
@@ -0,0 +1,331 @@
+#include "cells.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#include "dual.h"
+#include "parallel.h"
+
+namespace
+{
+
+// Convex cell, edge ii runs from corners[ii] to corners[ii + 1] along the
+// bisector with labels[ii], or the bounding box if that is NO_NEIGHBOR
+struct Polygon
+{
+    std::vector<Point> corners;
+    std::vector<size_t> labels;
+};
+
+// Part of the boundary inside one cell, from where it enters the cell across
+// the bisector with entry to where it leaves across the bisector with exit
+struct Piece
+{
+    size_t site;
+    std::vector<Point> points;
+    size_t entry;
+    size_t exit;
+};
+
+/**
+ * The cell of site within the box [lo, hi]: the box cut by the half plane
+ * closer to site than to each neighbor in turn
+ */
+Polygon cellPolygon(const std::vector<Point>& points, const NeighborLists& graph,
+        size_t site, const Point& lo, const Point& hi)
+{
+    Polygon cell;
+    cell.corners = {lo, Point(hi.x, lo.y), hi, Point(lo.x, hi.y)};
+    cell.labels.assign(4, NO_NEIGHBOR);
+
+    const Point& center = points[site];
+    for(size_t jj = graph.offsets[site]; jj < graph.offsets[site + 1]; jj++) {
+        size_t neighbor = graph.neighbors[jj];
+        Vector normal = points[neighbor] - center;
+        Point middle = center + normal*0.5f;
+        auto side = [&](const Point& pt) {
+            return dot(pt - middle, normal);
+        };
+
+        // each corner carries the label of the edge leaving it: a crossing
+        // on the way out starts an edge along this bisector
+        Polygon cut;
+        size_t count = cell.corners.size();
+        for(size_t ii = 0; ii < count; ii++) {
+            const Point& pt0 = cell.corners[ii];
+            const Point& pt1 = cell.corners[(ii + 1) % count];
+            float side0 = side(pt0);
+            float side1 = side(pt1);
+            if(side0 <= 0) {
+                cut.corners.push_back(pt0);
+                cut.labels.push_back(cell.labels[ii]);
+            }
+            if((side0 <= 0) != (side1 <= 0)) {
+                cut.corners.push_back(pt0 + (pt1 - pt0)*(side0 / (side0 - side1)));
+                cut.labels.push_back(side0 <= 0 ? neighbor : cell.labels[ii]);
+            }
+        }
+        cell = std::move(cut);
+    }
+    return cell;
+}
+
+/**
+ * Cut the boundary into pieces at the bisectors it crosses. Along the
+ * segment pt0 + t (pt1 - pt0), the segment leaves the cell of site at the
+ * smallest t past the current one where it gets closer to a neighbor.
+ */
+std::vector<Piece> walkBoundary(const std::vector<Point>& points,
+        const NeighborLists& graph, const std::vector<Point>& boundary)
+{
+    size_t site = locatePoint(points, graph, 0, boundary[0]);
+    size_t previous = NO_NEIGHBOR;
+    std::vector<Piece> pieces(1, Piece{site, {boundary[0]}, NO_NEIGHBOR, NO_NEIGHBOR});
+    for(size_t ii = 0; ii < boundary.size(); ii++) {
+        const Point& pt0 = boundary[ii];
+        const Point& pt1 = boundary[(ii + 1) % boundary.size()];
+        Vector delta = pt1 - pt0;
+        float t = 0;
+        for(size_t steps = 0; steps < points.size(); steps++) {
+            const Point& center = points[site];
+            float exit = 1;
+            size_t across = NO_NEIGHBOR;
+            for(size_t jj = graph.offsets[site]; jj < graph.offsets[site + 1]; jj++) {
+                // side of the bisector, linear in t
+                size_t neighbor = graph.neighbors[jj];
+                Vector normal = points[neighbor] - center;
+                float side0 = dot(pt0 - (center + normal*0.5f), normal);
+                float slope = dot(delta, normal);
+                if(slope <= 0)
+                    continue;
+
+                // don't go straight back across the bisector just crossed
+                float crossing = -side0 / slope;
+                if(neighbor == previous && crossing <= t)
+                    continue;
+                if(crossing >= t && crossing < exit) {
+                    exit = crossing;
+                    across = neighbor;
+                }
+            }
+
+            if(across == NO_NEIGHBOR) {
+                pieces.back().points.push_back(pt1);
+                break;
+            }
+
+            Point crossing = pt0 + delta*exit;
+            pieces.back().points.push_back(crossing);
+            pieces.back().exit = across;
+            pieces.push_back(Piece{across, {crossing}, site, NO_NEIGHBOR});
+            previous = site;
+            site = across;
+            t = exit;
+        }
+    }
+
+    // the walk ends where it started, inside the first piece's cell
+    if(pieces.size() > 1) {
+        Piece& last = pieces.back();
+        last.points.insert(last.points.end(), pieces[0].points.begin() + 1,
+                pieces[0].points.end());
+        last.exit = pieces[0].exit;
+        pieces[0] = last;
+        pieces.pop_back();
+    } else {
+        pieces[0].points.pop_back();
+    }
+
+    // pieces that only touch a corner of a cell add nothing to it
+    pieces.erase(std::remove_if(pieces.begin(), pieces.end(),
+                [](const Piece& piece) {
+                    return piece.points.size() == 2 &&
+                        piece.points[0].x == piece.points[1].x &&
+                        piece.points[0].y == piece.points[1].y;
+                }), pieces.end());
+    return pieces;
+}
+
+// Position of pt along the perimeter of cell, ii + t on edge ii
+float perimeterPosition(const Polygon& cell, const Point& pt)
+{
+    float best = std::numeric_limits<float>::infinity();
+    float position = 0;
+    size_t count = cell.corners.size();
+    for(size_t ii = 0; ii < count; ii++) {
+        const Point& pt0 = cell.corners[ii];
+        Vector edge = cell.corners[(ii + 1) % count] - pt0;
+        float length2 = normSquared(edge);
+        float t = length2 > 0 ? dot(pt - pt0, edge) / length2 : 0;
+        t = std::min(1.f, std::max(0.f, t));
+        float distance = normSquared(pt0 + edge*t - pt);
+        if(distance < best) {
+            best = distance;
+            position = ii + std::min(t, 0.99999f);
+        }
+    }
+    return position;
+}
+
+/**
+ * Clip a cell by the pieces of boundary inside it. The inside of the
+ * boundary is on the left of each piece, so after a piece leaves the cell
+ * the clipped region continues counterclockwise along the cell until the
+ * next piece comes back in. Neighbors across the parts of the cell kept this
+ * way are inside the boundary and go to inside.
+ */
+std::vector<std::vector<Point>> clipCell(const Polygon& cell,
+        const std::vector<const Piece*>& pieces, std::vector<size_t>& inside)
+{
+    size_t count = cell.corners.size();
+    std::vector<float> entries(pieces.size());
+    std::vector<float> exits(pieces.size());
+    for(size_t ii = 0; ii < pieces.size(); ii++) {
+        entries[ii] = perimeterPosition(cell, pieces[ii]->points.front());
+        exits[ii] = perimeterPosition(cell, pieces[ii]->points.back());
+    }
+
+    // counterclockwise distance along the perimeter
+    auto ahead = [count](float from, float to) {
+        float distance = std::fmod(to - from + count, float(count));
+        return distance;
+    };
+
+    std::vector<std::vector<Point>> rings;
+    std::vector<bool> used(pieces.size(), false);
+    for(size_t first = 0; first < pieces.size(); first++) {
+        if(used[first])
+            continue;
+
+        // a boundary entirely inside the cell is its own ring
+        if(pieces[first]->entry == NO_NEIGHBOR) {
+            used[first] = true;
+            rings.push_back(pieces[first]->points);
+            continue;
+        }
+
+        std::vector<Point> ring;
+        size_t current = first;
+        while(!used[current]) {
+            used[current] = true;
+            const auto& points = pieces[current]->points;
+            ring.insert(ring.end(), points.begin(), points.end() - 1);
+
+            size_t next = current;
+            float nearest = std::numeric_limits<float>::infinity();
+            for(size_t ii = 0; ii < pieces.size(); ii++) {
+                float distance = ahead(exits[current], entries[ii]);
+                if(pieces[ii]->entry != NO_NEIGHBOR && distance < nearest) {
+                    nearest = distance;
+                    next = ii;
+                }
+            }
+
+            // corners passed on the way, and the edges they're on
+            float position = exits[current];
+            size_t edge = size_t(position);
+            ring.push_back(points.back());
+            for(float walked = 1 - (position - edge); walked < nearest; walked += 1) {
+                edge = (edge + 1) % count;
+                ring.push_back(cell.corners[edge]);
+                inside.push_back(cell.labels[(edge + count - 1) % count]);
+            }
+            inside.push_back(cell.labels[size_t(entries[next]) % count]);
+            current = next;
+        }
+        rings.push_back(ring);
+    }
+    return rings;
+}
+
+}
+
+std::vector<ClippedCell> clipCells(const Voronoi& voronoi,
+        const std::vector<Point>& points, const std::vector<Point>& boundary)
+{
+    if(points.empty() || boundary.size() < 3)
+        return std::vector<ClippedCell>();
+
+    // the walk expects the inside on the left
+    std::vector<Point> ring = boundary;
+    float area = 0;
+    for(size_t ii = 0; ii < ring.size(); ii++) {
+        const Point& pt0 = ring[ii];
+        const Point& pt1 = ring[(ii + 1) % ring.size()];
+        area += pt0.x*pt1.y - pt1.x*pt0.y;
+    }
+    if(area < 0)
+        std::reverse(ring.begin(), ring.end());
+
+    // cells only need to be bounded where the boundary can reach
+    Point lo = ring[0], hi = ring[0];
+    for(const auto& pt : ring) {
+        lo = Point(std::min(lo.x, pt.x), std::min(lo.y, pt.y));
+        hi = Point(std::max(hi.x, pt.x), std::max(hi.y, pt.y));
+    }
+    Vector margin = (hi - lo)*0.1f + Vector(1, 1);
+    lo -= margin;
+    hi += margin;
+
+    NeighborLists graph = neighborLists(voronoi, points);
+    std::vector<Piece> pieces = walkBoundary(points, graph, ring);
+
+    // crossed[site] lists the pieces in each cell the boundary passes through
+    std::vector<size_t> crossed;
+    std::vector<std::vector<const Piece*>> by_site(points.size());
+    for(const auto& piece : pieces) {
+        if(by_site[piece.site].empty())
+            crossed.push_back(piece.site);
+        by_site[piece.site].push_back(&piece);
+    }
+    std::sort(crossed.begin(), crossed.end());
+
+    std::vector<ClippedCell> clipped(crossed.size());
+    std::vector<std::vector<size_t>> seeds(crossed.size());
+    parallelFor(0, crossed.size(), [&](size_t ii) {
+        size_t site = crossed[ii];
+        Polygon cell = cellPolygon(points, graph, site, lo, hi);
+        clipped[ii].site = site;
+        clipped[ii].rings = clipCell(cell, by_site[site], seeds[ii]);
+    });
+
+    // Cells the boundary doesn't cross are all inside or all outside, and
+    // the inside ones are reached from the kept edges of crossed cells
+    // without crossing the boundary
+    std::vector<char> state(points.size(), 0);
+    for(size_t site : crossed)
+        state[site] = 1;
+    std::vector<size_t> inside;
+    for(const auto& list : seeds) {
+        for(size_t site : list) {
+            if(site != NO_NEIGHBOR && state[site] == 0) {
+                state[site] = 2;
+                inside.push_back(site);
+            }
+        }
+    }
+    for(size_t ii = 0; ii < inside.size(); ii++) {
+        size_t site = inside[ii];
+        for(size_t jj = graph.offsets[site]; jj < graph.offsets[site + 1]; jj++) {
+            size_t neighbor = graph.neighbors[jj];
+            if(state[neighbor] == 0) {
+                state[neighbor] = 2;
+                inside.push_back(neighbor);
+            }
+        }
+    }
+
+    std::vector<ClippedCell> whole(inside.size());
+    parallelFor(0, inside.size(), [&](size_t ii) {
+        whole[ii].site = inside[ii];
+        whole[ii].rings.push_back(cellPolygon(points, graph, inside[ii], lo, hi).corners);
+    });
+
+    clipped.insert(clipped.end(), whole.begin(), whole.end());
+    std::sort(clipped.begin(), clipped.end(),
+            [](const ClippedCell& lhs, const ClippedCell& rhs) {
+                return lhs.site < rhs.site;
+            });
+    return clipped;
+}
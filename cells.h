@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include "geometry.h"
+#include "voronoi.h"
+
+/**
+ * Cells of a finished Voronoi diagram clipped to a bounding polygon, e.g. the
+ * territory of each site within a country or parcel.
+ *
+ * Rather than clipping every cell against the whole polygon, the polygon's
+ * boundary is walked once through the cells it crosses, cutting it into
+ * pieces that each lie in a single cell. Only the crossed cells need to be
+ * clipped, which they are by their own pieces. Every other cell is either
+ * entirely inside or entirely outside, and the inside ones are found by
+ * flooding out from the crossed cells. So the work is proportional to the
+ * boundary plus the output, not boundary times cells.
+ */
+
+struct ClippedCell
+{
+    size_t site;
+
+    // counterclockwise rings, more than one where the boundary cuts the cell
+    // into separate pieces
+    std::vector<std::vector<Point>> rings;
+};
+
+/**
+ * Cells clipped to boundary, a simple polygon in either orientation that
+ * needn't be convex. Sites whose cells miss the polygon are left out, the
+ * rest are in order of site.
+ */
+std::vector<ClippedCell> clipCells(const Voronoi& voronoi,
+        const std::vector<Point>& points, const std::vector<Point>& boundary);
@@ -0,0 +1,49 @@
+#include "clearance.h"
+
+ClearanceIndex::ClearanceIndex(const Voronoi& voronoi,
+        const std::vector<Point>& points) :
+    m_nodes(voronoi.getNodes())
+{
+    std::vector<BoundingVolumeHierarchy::Item> items;
+    items.reserve(m_nodes.size());
+    for(size_t ii = 0; ii < m_nodes.size(); ii++) {
+        // a node between two points is just their midpoint, and its circle
+        // may hold other points
+        const auto& node = m_nodes[ii];
+        if(node->parents.size() == 3)
+            items.push_back({Point(node->x, node->y), node->radius, ii});
+    }
+    m_node_tree = BoundingVolumeHierarchy(items);
+
+    items.clear();
+    items.reserve(points.size());
+    for(size_t ii = 0; ii < points.size(); ii++)
+        items.push_back({points[ii], 0, ii});
+    m_point_tree = BoundingVolumeHierarchy(items);
+}
+
+float ClearanceIndex::clearance(const Point& pt) const
+{
+    float distance;
+    m_point_tree.nearest(pt, distance);
+    return distance;
+}
+
+size_t ClearanceIndex::nearestPoint(const Point& pt, float& distance) const
+{
+    size_t ii = m_point_tree.nearest(pt, distance);
+    if(ii == BoundingVolumeHierarchy::NONE)
+        return ii;
+    return m_point_tree[ii].id;
+}
+
+std::vector<ClearanceIndex::EmptyCircle> ClearanceIndex::largestCircles(
+        const Point& lo, const Point& hi, size_t k) const
+{
+    std::vector<EmptyCircle> out;
+    for(size_t ii : m_node_tree.largest(lo, hi, k)) {
+        const auto& node = m_nodes[m_node_tree[ii].id];
+        out.push_back({Point(node->x, node->y), node->radius, node});
+    }
+    return out;
+}
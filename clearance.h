@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include "geometry.h"
+#include "voronoi.h"
+#include "bvh.h"
+
+/**
+ * Clearance and empty circle queries over a finished Voronoi diagram.
+ *
+ * Every node of the diagram with three parents is the center of a circle that
+ * touches them and contains no other points, with the node's radius. Those
+ * nodes are indexed by radius so that the largest of these circles in a window
+ * can be found without looking at the rest, and the points are indexed by
+ * position so that the clearance (distance to the nearest point) can be found
+ * anywhere. Nodes with two parents are just the midpoints between them, and
+ * aren't indexed.
+ */
+class ClearanceIndex
+{
+public:
+    struct EmptyCircle
+    {
+        Point center;
+        float radius;
+        Voronoi::Node::Ptr node;
+    };
+
+    ClearanceIndex(const Voronoi& voronoi, const std::vector<Point>& points);
+
+    // Distance from pt to the nearest point
+    float clearance(const Point& pt) const;
+
+    // Index of the point nearest to pt, with its distance
+    size_t nearestPoint(const Point& pt, float& distance) const;
+
+    /**
+     * Largest empty circles whose centers lie in the window [lo, hi]
+     *
+     * Only nodes of the diagram with three parents are considered as
+     * centers, so a circle centered where an edge leaves the window is not
+     * reported.
+     *
+     * @return up to k circles in order of decreasing radius
+     */
+    std::vector<EmptyCircle> largestCircles(const Point& lo, const Point& hi,
+            size_t k) const;
+
+private:
+    std::vector<Voronoi::Node::Ptr> m_nodes;
+    BoundingVolumeHierarchy m_node_tree;
+    BoundingVolumeHierarchy m_point_tree;
+};
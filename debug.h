@@ -1,19 +1,45 @@
 #pragma once
 
+/**
+ * Tracing of the sweep, to stderr and as an SVG of the beach line per unit of
+ * sweep in the working directory. It's compiled in only with -DVORONOI_DEBUG:
+ * the engine runs inside servers, worker pools and other people's processes,
+ * which must not get files or output they didn't ask for.
+ */
+
+#ifdef VORONOI_DEBUG
+
 #include <random>
 #include <cmath>
 #include <iomanip>
 #include <sstream>
+#include <iostream>
+#include <atomic>
+#include <mutex>
 
 #include "simple_svg.hpp"
 
+// one lock for every thread's trace, so lines from concurrent runs don't mix
+inline
+std::mutex& debugMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+#define DEBUG_LOG(expr) \
+    do { \
+        std::lock_guard<std::mutex> debug_lock(debugMutex()); \
+        std::cerr << expr; \
+    } while(0)
+
 template <typename IntersectionContainer, typename EventContainer>
 void draw_state(const IntersectionContainer& intersections,
         const EventContainer& events, double sweep_y)
 {
     svg::Dimensions dimensions(1200, 1200);
 
-    static int count = 0;
+    static std::atomic<int> count(0);
     std::ostringstream oss;
     oss << "state_" << std::setfill('0') << std::setw(5) << count++ << ".svg";
     svg::Document doc(oss.str(), svg::Layout(dimensions, svg::Layout::BottomLeft));
@@ -102,4 +128,14 @@ void draw_parabola(svg::Document& doc, double min_x, double max_x,
     doc.save();
 }
 
+#else
+
+#define DEBUG_LOG(expr) do {} while(0)
+
+template <typename IntersectionContainer, typename EventContainer>
+void draw_state(const IntersectionContainer&, const EventContainer&, double,
+        double)
+{
+}
 
+#endif
@@ -0,0 +1,200 @@
+#include "diagram_io.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+namespace
+{
+
+const char MAGIC[4] = {'V', 'D', 'G', 'M'};
+const uint32_t VERSION = 1;
+
+template <size_t N>
+void fillParents(const std::set<size_t>& parents, uint32_t (&out)[N])
+{
+    std::fill(out, out + N, NO_PARENT);
+    size_t ii = 0;
+    for(auto it = parents.begin(); it != parents.end() && ii < N; ++it)
+        out[ii++] = *it;
+}
+
+}
+
+FlatDiagram flatten(const Voronoi& voronoi)
+{
+    FlatDiagram out;
+    const auto& nodes = voronoi.getNodes();
+    const auto& edges = voronoi.getEdges();
+
+    std::unordered_map<const Voronoi::Node*, uint32_t> index;
+    index.reserve(nodes.size());
+    out.nodes.resize(nodes.size());
+    for(size_t ii = 0; ii < nodes.size(); ii++) {
+        const auto& node = nodes[ii];
+        index[node.get()] = ii;
+        out.nodes[ii].x = node->x;
+        out.nodes[ii].y = node->y;
+        out.nodes[ii].radius = node->radius;
+        fillParents(node->parents, out.nodes[ii].parents);
+    }
+
+    out.edges.resize(edges.size());
+    for(size_t ii = 0; ii < edges.size(); ii++) {
+        const auto& edge = edges[ii];
+        out.edges[ii].nodes[0] = index.at(edge->nodes[0].get());
+        out.edges[ii].nodes[1] = index.at(edge->nodes[1].get());
+        fillParents(edge->parents, out.edges[ii].parents);
+    }
+
+    return out;
+}
+
+size_t serializedSize(const FlatDiagram& diagram)
+{
+    return sizeof(DiagramHeader) +
+        diagram.nodes.size()*sizeof(FlatDiagram::Node) +
+        diagram.edges.size()*sizeof(FlatDiagram::Edge);
+}
+
+void serialize(const FlatDiagram& diagram, char* out)
+{
+    DiagramHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.node_count = diagram.nodes.size();
+    header.edge_count = diagram.edges.size();
+
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    if(!diagram.nodes.empty()) {
+        std::memcpy(out, diagram.nodes.data(),
+                diagram.nodes.size()*sizeof(FlatDiagram::Node));
+    }
+    out += diagram.nodes.size()*sizeof(FlatDiagram::Node);
+    if(!diagram.edges.empty()) {
+        std::memcpy(out, diagram.edges.data(),
+                diagram.edges.size()*sizeof(FlatDiagram::Edge));
+    }
+}
+
+void serialize(const FlatDiagram& diagram, std::vector<char>& out)
+{
+    out.resize(serializedSize(diagram));
+    serialize(diagram, out.data());
+}
+
+bool view(const char* data, size_t size, DiagramView& out)
+{
+    if(size < sizeof(DiagramHeader))
+        return false;
+
+    auto header = reinterpret_cast<const DiagramHeader*>(data);
+    if(std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header->version != VERSION)
+        return false;
+
+    size_t expected = sizeof(DiagramHeader) +
+        size_t(header->node_count)*sizeof(FlatDiagram::Node) +
+        size_t(header->edge_count)*sizeof(FlatDiagram::Edge);
+    if(size < expected)
+        return false;
+
+    auto nodes = reinterpret_cast<const FlatDiagram::Node*>(
+            data + sizeof(DiagramHeader));
+    auto edges = reinterpret_cast<const FlatDiagram::Edge*>(
+            data + sizeof(DiagramHeader) +
+            header->node_count*sizeof(FlatDiagram::Node));
+
+    // users of the view index nodes by the edges without checking
+    for(uint32_t ii = 0; ii < header->edge_count; ii++) {
+        if(edges[ii].nodes[0] >= header->node_count ||
+                edges[ii].nodes[1] >= header->node_count)
+            return false;
+    }
+
+    out.header = header;
+    out.nodes = nodes;
+    out.edges = edges;
+    return true;
+}
+
+bool deserialize(const char* data, size_t size, FlatDiagram& out)
+{
+    DiagramView diagram;
+    if(!view(data, size, diagram))
+        return false;
+
+    out.nodes.assign(diagram.nodes, diagram.nodes + diagram.header->node_count);
+    out.edges.assign(diagram.edges, diagram.edges + diagram.header->edge_count);
+    return true;
+}
+
+bool readAll(int fd, void* data, size_t size)
+{
+    char* ptr = static_cast<char*>(data);
+    while(size > 0) {
+        ssize_t count = ::read(fd, ptr, size);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            return false;
+        ptr += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const void* data, size_t size)
+{
+    const char* ptr = static_cast<const char*>(data);
+    while(size > 0) {
+        ssize_t count = ::write(fd, ptr, size);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            return false;
+        ptr += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool sendAll(int fd, const void* data, size_t size)
+{
+    const char* ptr = static_cast<const char*>(data);
+    while(size > 0) {
+        ssize_t count = ::send(fd, ptr, size, MSG_NOSIGNAL);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            return false;
+        ptr += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool writeDiagram(int fd, const FlatDiagram& diagram)
+{
+    std::vector<char> buffer;
+    serialize(diagram, buffer);
+    uint64_t size = buffer.size();
+    return writeAll(fd, &size, sizeof(size)) &&
+        writeAll(fd, buffer.data(), buffer.size());
+}
+
+bool readDiagram(int fd, FlatDiagram& diagram, size_t max_size)
+{
+    uint64_t size;
+    if(!readAll(fd, &size, sizeof(size)) || size > max_size)
+        return false;
+
+    std::vector<char> buffer(size);
+    return readAll(fd, buffer.data(), size) &&
+        deserialize(buffer.data(), size, diagram);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "voronoi.h"
+
+/**
+ * Flat, pointer free form of a Voronoi diagram along with a binary format that
+ * is just a header followed by the raw node and edge arrays. Since there is
+ * nothing to decode, a buffer in this format can be used in place (see
+ * DiagramView) as well as copied back into a FlatDiagram.
+ *
+ * Layout (native byte order):
+ *
+ *  DiagramHeader
+ *  FlatDiagram::Node[node_count]
+ *  FlatDiagram::Edge[edge_count]
+ */
+
+const uint32_t NO_PARENT = 0xffffffff;
+
+struct FlatDiagram
+{
+    struct Node
+    {
+        float x, y;
+        float radius;
+
+        // sorted, unused entries are NO_PARENT
+        uint32_t parents[3];
+    };
+
+    struct Edge
+    {
+        // indices into nodes
+        uint32_t nodes[2];
+
+        // sorted, unused entries are NO_PARENT
+        uint32_t parents[2];
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+};
+
+struct DiagramHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t node_count;
+    uint32_t edge_count;
+};
+
+// Pointers into a buffer holding a serialized diagram
+struct DiagramView
+{
+    const DiagramHeader* header;
+    const FlatDiagram::Node* nodes;
+    const FlatDiagram::Edge* edges;
+};
+
+FlatDiagram flatten(const Voronoi& voronoi);
+
+size_t serializedSize(const FlatDiagram& diagram);
+
+// Write the diagram to out, which must hold serializedSize(diagram) bytes
+void serialize(const FlatDiagram& diagram, char* out);
+void serialize(const FlatDiagram& diagram, std::vector<char>& out);
+
+// Check the header, the sizes and that every edge's nodes are in range,
+// returns false if data is not a valid diagram
+bool view(const char* data, size_t size, DiagramView& out);
+bool deserialize(const char* data, size_t size, FlatDiagram& out);
+
+// Largest diagram readDiagram accepts unless told otherwise
+const size_t MAX_DIAGRAM_SIZE = size_t(1) << 30;
+
+// Length prefixed diagram on a file descriptor (pipe, socket or file). A
+// length over max_size is refused before anything is allocated for it.
+bool writeDiagram(int fd, const FlatDiagram& diagram);
+bool readDiagram(int fd, FlatDiagram& diagram,
+        size_t max_size = MAX_DIAGRAM_SIZE);
+
+// Read or write exactly size bytes, retrying on short transfers
+bool readAll(int fd, void* data, size_t size);
+bool writeAll(int fd, const void* data, size_t size);
+
+// Like writeAll but for sockets, a closed peer is reported as an error instead
+// of raising SIGPIPE
+bool sendAll(int fd, const void* data, size_t size);
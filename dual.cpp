@@ -0,0 +1,166 @@
+#include "dual.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "parallel.h"
+
+namespace
+{
+
+class DisjointSets
+{
+public:
+    DisjointSets(size_t size) : m_parent(size), m_rank(size, 0)
+    {
+        std::iota(m_parent.begin(), m_parent.end(), 0);
+    }
+
+    size_t find(size_t ii)
+    {
+        while(m_parent[ii] != ii) {
+            m_parent[ii] = m_parent[m_parent[ii]];
+            ii = m_parent[ii];
+        }
+        return ii;
+    }
+
+    // returns false if the two were already in the same set
+    bool join(size_t ii, size_t jj)
+    {
+        ii = find(ii);
+        jj = find(jj);
+        if(ii == jj)
+            return false;
+
+        if(m_rank[ii] < m_rank[jj])
+            std::swap(ii, jj);
+        m_parent[jj] = ii;
+        if(m_rank[ii] == m_rank[jj])
+            m_rank[ii]++;
+        return true;
+    }
+
+private:
+    std::vector<size_t> m_parent;
+    std::vector<unsigned char> m_rank;
+};
+
+}
+
+std::vector<DualEdge> dualEdges(const Voronoi& voronoi,
+        const std::vector<Point>& points)
+{
+    // every pair of parents of a node share a bisector
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for(const auto& node : voronoi.getNodes()) {
+        for(auto it0 = node->parents.begin(); it0 != node->parents.end(); ++it0) {
+            auto it1 = it0;
+            for(++it1; it1 != node->parents.end(); ++it1)
+                pairs.push_back(std::make_pair(*it0, *it1));
+        }
+    }
+
+    parallelSort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    std::vector<DualEdge> edges(pairs.size());
+    parallelFor(0, pairs.size(), [&](size_t ii) {
+        size_t a = pairs[ii].first;
+        size_t b = pairs[ii].second;
+        assert(a < points.size() && b < points.size());
+        edges[ii] = DualEdge{a, b, distance2d(points[a], points[b])};
+    });
+    return edges;
+}
+
+NeighborLists neighborLists(const Voronoi& voronoi,
+        const std::vector<Point>& points)
+{
+    NeighborLists out;
+    std::vector<DualEdge> edges = dualEdges(voronoi, points);
+    out.offsets.assign(points.size() + 1, 0);
+    for(const auto& edge : edges) {
+        out.offsets[edge.a + 1]++;
+        out.offsets[edge.b + 1]++;
+    }
+    for(size_t ii = 0; ii < points.size(); ii++)
+        out.offsets[ii + 1] += out.offsets[ii];
+
+    std::vector<size_t> fill(out.offsets.begin(), out.offsets.end() - 1);
+    out.neighbors.resize(out.offsets.back());
+    for(const auto& edge : edges) {
+        out.neighbors[fill[edge.a]++] = edge.b;
+        out.neighbors[fill[edge.b]++] = edge.a;
+    }
+    return out;
+}
+
+// Greedy: in a Delaunay graph some neighbor is always closer to pt unless
+// the current point is the closest
+size_t locatePoint(const std::vector<Point>& points, const NeighborLists& lists,
+        size_t start, const Point& pt)
+{
+    size_t current = start;
+    float best = normSquared(pt - points[current]);
+    bool moved = true;
+    while(moved) {
+        moved = false;
+        size_t from = current;
+        for(size_t jj = lists.offsets[from]; jj < lists.offsets[from + 1]; jj++) {
+            size_t neighbor = lists.neighbors[jj];
+            float distance = normSquared(pt - points[neighbor]);
+            if(distance < best) {
+                best = distance;
+                current = neighbor;
+                moved = true;
+            }
+        }
+    }
+    return current;
+}
+
+std::vector<DualEdge> minimumSpanningTree(const Voronoi& voronoi,
+        const std::vector<Point>& points)
+{
+    // Kruskal
+    std::vector<DualEdge> edges = dualEdges(voronoi, points);
+    parallelSort(edges.begin(), edges.end(),
+            [](const DualEdge& lhs, const DualEdge& rhs) {
+                return lhs.length < rhs.length;
+            });
+
+    std::vector<DualEdge> tree;
+    if(points.empty())
+        return tree;
+
+    tree.reserve(points.size() - 1);
+    DisjointSets sets(points.size());
+    for(const auto& edge : edges) {
+        if(sets.join(edge.a, edge.b)) {
+            tree.push_back(edge);
+            if(tree.size() + 1 == points.size())
+                break;
+        }
+    }
+    return tree;
+}
+
+std::vector<size_t> nearestNeighbors(const Voronoi& voronoi,
+        const std::vector<Point>& points)
+{
+    std::vector<DualEdge> edges = dualEdges(voronoi, points);
+    std::vector<size_t> nearest(points.size(), NO_NEIGHBOR);
+    std::vector<float> best(points.size(), std::numeric_limits<float>::infinity());
+    for(const auto& edge : edges) {
+        if(edge.length < best[edge.a]) {
+            best[edge.a] = edge.length;
+            nearest[edge.a] = edge.b;
+        }
+        if(edge.length < best[edge.b]) {
+            best[edge.b] = edge.length;
+            nearest[edge.b] = edge.a;
+        }
+    }
+    return nearest;
+}
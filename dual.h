@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+
+#include "geometry.h"
+#include "voronoi.h"
+
+/**
+ * Graphs over the input points that are read off the dual (Delaunay) graph of
+ * a finished Voronoi diagram. Two points are joined in the dual when their
+ * cells share a bisector, and both the Euclidean minimum spanning tree and
+ * the nearest neighbor of every point only ever use these pairs.
+ */
+
+const size_t NO_NEIGHBOR = std::numeric_limits<size_t>::max();
+
+struct DualEdge
+{
+    size_t a, b;
+    float length;
+};
+
+// Pairs of points whose cells share a bisector, each pair once with a < b
+std::vector<DualEdge> dualEdges(const Voronoi& voronoi,
+        const std::vector<Point>& points);
+
+// Neighbors of every point in the dual, those of point ii are
+// neighbors[offsets[ii]] up to neighbors[offsets[ii + 1]]
+struct NeighborLists
+{
+    std::vector<size_t> offsets;
+    std::vector<size_t> neighbors;
+};
+
+NeighborLists neighborLists(const Voronoi& voronoi,
+        const std::vector<Point>& points);
+
+// Point whose cell holds pt, found by walking the dual from start towards pt
+size_t locatePoint(const std::vector<Point>& points, const NeighborLists& lists,
+        size_t start, const Point& pt);
+
+// Euclidean minimum spanning tree (forest if the dual is disconnected)
+std::vector<DualEdge> minimumSpanningTree(const Voronoi& voronoi,
+        const std::vector<Point>& points);
+
+// Index of the closest other point for each point, NO_NEIGHBOR if it has none
+std::vector<size_t> nearestNeighbors(const Voronoi& voronoi,
+        const std::vector<Point>& points);
@@ -0,0 +1,53 @@
+#include "event_log.h"
+
+#include <cstring>
+
+#include "diagram_io.h"
+
+namespace
+{
+
+const char MAGIC[4] = {'S', 'K', 'E', 'V'};
+const uint32_t VERSION = 1;
+
+}
+
+bool writeEventLog(int fd, const EventLog& log)
+{
+    EventLogHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.point_count = log.points.size();
+    header.event_count = log.events.size();
+    return writeAll(fd, &header, sizeof(header)) &&
+        writeAll(fd, log.points.data(), log.points.size()*sizeof(Point)) &&
+        writeAll(fd, log.events.data(), log.events.size()*sizeof(EventRecord));
+}
+
+bool readEventLog(int fd, EventLog& log)
+{
+    EventLogHeader header;
+    if(!readAll(fd, &header, sizeof(header)))
+        return false;
+    if(std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header.version != VERSION)
+        return false;
+
+    log.points.resize(header.point_count);
+    log.events.resize(header.event_count);
+    if(!readAll(fd, log.points.data(), log.points.size()*sizeof(Point)) ||
+            !readAll(fd, log.events.data(), log.events.size()*sizeof(EventRecord)))
+        return false;
+
+    // sites must be points of the log
+    for(const auto& event : log.events) {
+        size_t count = event.type == EVENT_SITE ? 1 : 3;
+        if(event.type != EVENT_SITE && event.type != EVENT_CIRCLE)
+            return false;
+        for(size_t ii = 0; ii < count; ii++) {
+            if(event.sites[ii] >= log.points.size())
+                return false;
+        }
+    }
+    return true;
+}
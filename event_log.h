@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "geometry.h"
+
+/**
+ * The sequence of events a sweep processed, for reproducing it exactly.
+ *
+ * A Voronoi built with Options::event_log appends a record per site and
+ * circle event in the order it handled them, along with how big the event
+ * queue and beach line were at the time. Voronoi(log) then feeds the same
+ * events straight to the beach line and graph, bypassing the event queue's
+ * choice of order, so their cost can be profiled on its own and different
+ * implementations compared on identical work. The log carries its points, so
+ * it is all that's needed to replay.
+ *
+ * Binary layout (native byte order):
+ *
+ *  EventLogHeader
+ *  Point[point_count]
+ *  EventRecord[event_count]
+ */
+
+const uint32_t NO_EVENT_SITE = 0xffffffff;
+
+enum EventType : uint32_t
+{
+    EVENT_SITE = 0,
+    EVENT_CIRCLE = 1,
+};
+
+struct EventRecord
+{
+    uint32_t type;
+
+    // the site for a site event, the sites of the left, middle and right
+    // arcs for a circle event, NO_EVENT_SITE where unused
+    uint32_t sites[3];
+
+    // sweep position when the event happened
+    float y;
+
+    // sizes before handling the event
+    uint32_t queue_size;
+    uint32_t beach_size;
+};
+
+struct EventLog
+{
+    std::vector<Point> points;
+    std::vector<EventRecord> events;
+};
+
+struct EventLogHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t point_count;
+    uint32_t event_count;
+};
+
+// Whole log on a file descriptor
+bool writeEventLog(int fd, const EventLog& log);
+bool readEventLog(int fd, EventLog& log);
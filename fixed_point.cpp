@@ -0,0 +1,149 @@
+#include "fixed_point.h"
+
+#include <limits>
+
+namespace
+{
+
+// nodes are gathered into float arrays this many at a time
+const size_t CHUNK = 1024;
+
+/**
+ * Compute in Wide (float for 16 bit output, double for 32 bit where float
+ * can't hold the limits exactly) so that clamping happens before the
+ * conversion, and keep the loop free of branches so it vectorizes.
+ */
+template <typename T, typename Wide>
+size_t convert(const float* in, size_t count, float origin, float resolution,
+        T* out)
+{
+    const Wide lo = std::numeric_limits<T>::min();
+    const Wide hi = std::numeric_limits<T>::max();
+    const Wide scale = Wide(1) / resolution;
+
+    size_t clipped = 0;
+    for(size_t ii = 0; ii < count; ii++) {
+        Wide value = (Wide(in[ii]) - origin)*scale;
+        value += value < 0 ? Wide(-0.5) : Wide(0.5);
+
+        // written so that NaN fails the first test and becomes lo
+        Wide clamped = value > lo ? value : lo;
+        clamped = clamped < hi ? clamped : hi;
+        clipped += (value <= lo - 1) | (value >= hi + 1) | (value != value);
+        out[ii] = T(clamped);
+    }
+    return clipped;
+}
+
+template <typename T, typename Nodes, typename GetNode>
+void convertNodes(const Nodes& nodes, GetNode get, const TileFrame& frame,
+        FixedNodes<T>& out)
+{
+    out.x.resize(nodes.size());
+    out.y.resize(nodes.size());
+    out.clipped = 0;
+
+    float xs[CHUNK], ys[CHUNK];
+    for(size_t start = 0; start < nodes.size(); start += CHUNK) {
+        size_t count = std::min(CHUNK, nodes.size() - start);
+        for(size_t ii = 0; ii < count; ii++) {
+            const auto& node = get(nodes[start + ii]);
+            xs[ii] = node.x;
+            ys[ii] = node.y;
+        }
+        out.clipped += toFixed(xs, count, frame.origin_x, frame.resolution,
+                &out.x[start]);
+        out.clipped += toFixed(ys, count, frame.origin_y, frame.resolution,
+                &out.y[start]);
+    }
+}
+
+const FlatDiagram::Node& flatNode(const FlatDiagram::Node& node)
+{
+    return node;
+}
+
+const Voronoi::Node& voronoiNode(const Voronoi::Node::Ptr& node)
+{
+    return *node;
+}
+
+}
+
+size_t toFixed(const float* in, size_t count, float origin, float resolution,
+        int16_t* out)
+{
+    return convert<int16_t, float>(in, count, origin, resolution, out);
+}
+
+size_t toFixed(const float* in, size_t count, float origin, float resolution,
+        int32_t* out)
+{
+    return convert<int32_t, double>(in, count, origin, resolution, out);
+}
+
+void toFixed(const FlatDiagram& diagram, const TileFrame& frame,
+        FixedNodes16& out)
+{
+    convertNodes(diagram.nodes, flatNode, frame, out);
+}
+
+void toFixed(const FlatDiagram& diagram, const TileFrame& frame,
+        FixedNodes32& out)
+{
+    convertNodes(diagram.nodes, flatNode, frame, out);
+}
+
+void toFixed(const Voronoi& voronoi, const TileFrame& frame, FixedNodes16& out)
+{
+    convertNodes(voronoi.getNodes(), voronoiNode, frame, out);
+}
+
+void toFixed(const Voronoi& voronoi, const TileFrame& frame, FixedNodes32& out)
+{
+    convertNodes(voronoi.getNodes(), voronoiNode, frame, out);
+}
+
+FixedOutput::FixedOutput(const TileFrame& frame, FixedNodes16& nodes) :
+    m_frame(frame), m_nodes16(&nodes), m_nodes32(nullptr)
+{
+}
+
+FixedOutput::FixedOutput(const TileFrame& frame, FixedNodes32& nodes) :
+    m_frame(frame), m_nodes16(nullptr), m_nodes32(&nodes)
+{
+}
+
+void FixedOutput::resize(size_t count) const
+{
+    if(m_nodes16) {
+        m_nodes16->x.resize(count);
+        m_nodes16->y.resize(count);
+    } else {
+        m_nodes32->x.resize(count);
+        m_nodes32->y.resize(count);
+    }
+}
+
+size_t FixedOutput::convert(size_t start, size_t count, const float* x,
+        const float* y) const
+{
+    if(m_nodes16) {
+        return toFixed(x, count, m_frame.origin_x, m_frame.resolution,
+                &m_nodes16->x[start]) +
+            toFixed(y, count, m_frame.origin_y, m_frame.resolution,
+                    &m_nodes16->y[start]);
+    }
+    return toFixed(x, count, m_frame.origin_x, m_frame.resolution,
+            &m_nodes32->x[start]) +
+        toFixed(y, count, m_frame.origin_y, m_frame.resolution,
+                &m_nodes32->y[start]);
+}
+
+void FixedOutput::setClipped(size_t clipped) const
+{
+    if(m_nodes16)
+        m_nodes16->clipped = clipped;
+    else
+        m_nodes32->clipped = clipped;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "voronoi.h"
+#include "diagram_io.h"
+
+/**
+ * Node coordinates as tile local fixed point integers, for delivering diagrams
+ * as map tiles.
+ *
+ * A coordinate v becomes round((v - origin) / resolution), clamped to the
+ * range of the integer type. Coordinates are stored as separate x and y
+ * arrays so the conversion is one straight loop over each.
+ *
+ * A diagram built with a FixedOutput in Voronoi::Options::fixed writes them
+ * as it builds its nodes, a chunk at a time while the chunk's positions are
+ * still in cache. The toFixed overloads for a finished diagram are a pass
+ * of their own over its nodes.
+ */
+
+struct TileFrame
+{
+    // position that maps to integer (0, 0)
+    float origin_x, origin_y;
+
+    // size of one integer step
+    float resolution;
+};
+
+template <typename T>
+struct FixedNodes
+{
+    std::vector<T> x;
+    std::vector<T> y;
+
+    // coordinates that were clamped to the integer range
+    size_t clipped;
+};
+
+typedef FixedNodes<int16_t> FixedNodes16;
+typedef FixedNodes<int32_t> FixedNodes32;
+
+/**
+ * Where a diagram writes the fixed point positions of its nodes, in
+ * getNodes() order, see Voronoi::Options::fixed
+ */
+class FixedOutput
+{
+public:
+    FixedOutput(const TileFrame& frame, FixedNodes16& nodes);
+    FixedOutput(const TileFrame& frame, FixedNodes32& nodes);
+
+    // Size the arrays for count nodes
+    void resize(size_t count) const;
+
+    // Convert the count nodes from index start on, which may happen on
+    // several threads at once for separate ranges
+    //
+    // @return the number of coordinates that were clamped
+    size_t convert(size_t start, size_t count, const float* x,
+            const float* y) const;
+
+    // Record the clamped coordinates of all ranges
+    void setClipped(size_t clipped) const;
+
+private:
+    TileFrame m_frame;
+
+    // one of them is set
+    FixedNodes16* m_nodes16;
+    FixedNodes32* m_nodes32;
+};
+
+/**
+ * Convert count coordinates, clamping to the range of T. NaN becomes the
+ * lowest value.
+ *
+ * @return the number of coordinates that were clamped
+ */
+size_t toFixed(const float* in, size_t count, float origin, float resolution,
+        int16_t* out);
+size_t toFixed(const float* in, size_t count, float origin, float resolution,
+        int32_t* out);
+
+void toFixed(const FlatDiagram& diagram, const TileFrame& frame,
+        FixedNodes16& out);
+void toFixed(const FlatDiagram& diagram, const TileFrame& frame,
+        FixedNodes32& out);
+
+// Same as above from a finished diagram, nodes in getNodes() order
+void toFixed(const Voronoi& voronoi, const TileFrame& frame, FixedNodes16& out);
+void toFixed(const Voronoi& voronoi, const TileFrame& frame, FixedNodes32& out);
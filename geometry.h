@@ -90,6 +90,12 @@ float distance2d(const Point& lhs, const Point& rhs)
                      (lhs.y - rhs.y)*(lhs.y - rhs.y));
 }
 
+struct Circle
+{
+    Point center;
+    float radius;
+};
+
 struct Line
 {
     Point pt0;
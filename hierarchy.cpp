@@ -0,0 +1,100 @@
+#include "hierarchy.h"
+
+#include <unordered_map>
+#include <tuple>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+#include "parallel.h"
+#include "std_ext.h"
+
+namespace
+{
+
+const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+}
+
+SkeletonHierarchy::SkeletonHierarchy(const Voronoi& voronoi,
+        const std::vector<Point>& boundary)
+{
+    if(boundary.size() < 3)
+        return;
+
+    // distance along the boundary to each sample, and which way is inside
+    std::vector<float> along(boundary.size() + 1, 0);
+    float area = 0;
+    for(size_t ii = 0; ii < boundary.size(); ii++) {
+        const Point& pt0 = boundary[ii];
+        const Point& pt1 = boundary[(ii + 1) % boundary.size()];
+        along[ii + 1] = along[ii] + distance2d(pt0, pt1);
+        area += pt0.x*pt1.y - pt1.x*pt0.y;
+    }
+    float perimeter = along.back();
+    float sign = area < 0 ? -1 : 1;
+
+    // The circle of a node inside touches its three samples in the order
+    // they come along the boundary, outside it's the other way round. Two
+    // nodes with a pair of parents in common are the ends of the edge along
+    // their bisector. The nodes with two parents are midpoints of pairs of
+    // samples, which needn't be on that edge, so they're left out.
+    std::unordered_map<std::tuple<uint32_t, uint32_t>,
+        std::tuple<uint32_t, uint32_t>> open_edges;
+    for(const auto& node : voronoi.getNodes()) {
+        if(node->parents.size() != 3)
+            continue;
+        uint32_t parents[3];
+        std::copy(node->parents.begin(), node->parents.end(), parents);
+        const Point& pt0 = boundary[parents[0]];
+        Vector side0 = boundary[parents[1]] - pt0;
+        Vector side1 = boundary[parents[2]] - pt0;
+        if(sign*(side0.x*side1.y - side0.y*side1.x) <= 0)
+            continue;
+
+        uint32_t index = m_nodes.size();
+        m_nodes.push_back(Point(node->x, node->y));
+        for(size_t kk = 0; kk < 3; kk++) {
+            auto key = std::make_tuple(parents[kk], parents[(kk + 1) % 3]);
+            if(std::get<0>(key) > std::get<1>(key))
+                std::swap(std::get<0>(key), std::get<1>(key));
+            auto result = open_edges.emplace(key,
+                    std::make_tuple(index, NONE));
+            if(!result.second && std::get<1>(result.first->second) == NONE)
+                std::get<1>(result.first->second) = index;
+        }
+    }
+
+    // a pair with one node inside is where the skeleton runs out to the
+    // boundary between them
+    for(const auto& entry : open_edges) {
+        uint32_t node0 = std::get<0>(entry.second);
+        uint32_t node1 = std::get<1>(entry.second);
+        if(node1 == NONE)
+            continue;
+
+        float length = along[std::get<1>(entry.first)] -
+            along[std::get<0>(entry.first)];
+        m_edges.push_back(Edge{{node0, node1},
+                std::min(length, perimeter - length)});
+    }
+
+    parallelSort(m_edges.begin(), m_edges.end(),
+            [](const Edge& lhs, const Edge& rhs) {
+                return lhs.scale > rhs.scale;
+            });
+}
+
+size_t SkeletonHierarchy::count(float scale) const
+{
+    auto end = std::partition_point(m_edges.begin(), m_edges.end(),
+            [scale](const Edge& edge) {
+                return edge.scale >= scale;
+            });
+    return end - m_edges.begin();
+}
+
+std::vector<SkeletonHierarchy::Edge> SkeletonHierarchy::level(float scale) const
+{
+    return std::vector<Edge>(m_edges.begin(), m_edges.begin() + count(scale));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "geometry.h"
+#include "voronoi.h"
+
+/**
+ * Skeleton of a polygon at every level of generalization from one diagram.
+ *
+ * The polygon is given by samples along its boundary and the skeleton is the
+ * edges of their diagram between nodes inside it, so it stops at the last
+ * node before running out to the boundary. Each edge lies between two
+ * samples, and the boundary between them (the shorter way round) is the
+ * detail the edge stands for: an edge between neighboring samples stands for
+ * one sample step, the trunk of a long lobe for the whole lobe. That length
+ * is the edge's scale, and it only grows from the tips of the skeleton
+ * inwards, so dropping every edge below a scale trims whole branches back and
+ * leaves the skeleton connected.
+ *
+ * The edges are stored once sorted by decreasing scale, so the skeleton at
+ * any scale is a prefix of them.
+ */
+class SkeletonHierarchy
+{
+public:
+    struct Edge
+    {
+        uint32_t nodes[2];
+        float scale;
+    };
+
+    // boundary is a closed polygon in either orientation and voronoi is the
+    // plain diagram of its vertices, which should be sampled densely enough
+    // that the diagram follows the shape
+    SkeletonHierarchy(const Voronoi& voronoi, const std::vector<Point>& boundary);
+
+    const std::vector<Point>& nodes() const
+    {
+        return m_nodes;
+    }
+
+    // Edges inside the polygon in order of decreasing scale
+    const std::vector<Edge>& edges() const
+    {
+        return m_edges;
+    }
+
+    // Number of edges kept at scale, i.e. edges()[0] up to edges()[count]
+    // have a scale of at least scale
+    size_t count(float scale) const;
+
+    // Edges kept at scale
+    std::vector<Edge> level(float scale) const;
+
+private:
+    std::vector<Point> m_nodes;
+    std::vector<Edge> m_edges;
+};
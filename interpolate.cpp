@@ -0,0 +1,244 @@
+#include "interpolate.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+#include "std_ext.h"
+#include "parallel.h"
+
+namespace
+{
+
+struct Center
+{
+    double x, y;
+};
+
+double orient(const Point& a, const Point& b, const Point& c)
+{
+    return (double(b.x) - a.x)*(double(c.y) - a.y) -
+        (double(b.y) - a.y)*(double(c.x) - a.x);
+}
+
+Center circumcenter(const Point& a, const Point& b, const Point& c)
+{
+    double bx = double(b.x) - a.x;
+    double by = double(b.y) - a.y;
+    double cx = double(c.x) - a.x;
+    double cy = double(c.y) - a.y;
+    double d = 2*(bx*cy - by*cx);
+    double b2 = bx*bx + by*by;
+    double c2 = cx*cx + cy*cy;
+    return Center{a.x + (cy*b2 - by*c2) / d, a.y + (bx*c2 - cx*b2) / d};
+}
+
+// A piece of the boundary of the destroyed triangles, going counter-clockwise
+// around the query point
+struct BoundaryEdge
+{
+    uint32_t from;
+    uint32_t to;
+    uint32_t triangle;
+    Center center;
+};
+
+}
+
+const uint32_t NaturalNeighborInterpolator::NONE;
+
+NaturalNeighborInterpolator::NaturalNeighborInterpolator(const Voronoi& voronoi,
+        const std::vector<Point>& points,
+        const std::vector<float>& values) :
+    m_points(points), m_values(values)
+{
+    assert(points.size() == values.size());
+
+    // nodes with 3 parents are the circumcenters of the dual triangles
+    for(const auto& node : voronoi.getNodes()) {
+        if(node->parents.size() != 3)
+            continue;
+
+        Triangle tri;
+        std::copy(node->parents.begin(), node->parents.end(), tri.vertices);
+        const Point& a = m_points[tri.vertices[0]];
+        const Point& b = m_points[tri.vertices[1]];
+        const Point& c = m_points[tri.vertices[2]];
+        double area = orient(a, b, c);
+        if(area == 0)
+            continue;
+        if(area < 0)
+            std::swap(tri.vertices[1], tri.vertices[2]);
+
+        Center center = circumcenter(a, b, c);
+        tri.center_x = center.x;
+        tri.center_y = center.y;
+        tri.radius_sq = (a.x - center.x)*(a.x - center.x) +
+            (a.y - center.y)*(a.y - center.y);
+        std::fill(tri.neighbors, tri.neighbors + 3, NONE);
+        m_triangles.push_back(tri);
+    }
+
+    // connect triangles that share an edge, the map holds triangle*4 + the
+    // index of the vertex opposite the edge
+    std::unordered_map<std::tuple<uint32_t, uint32_t>, uint32_t> open_edges;
+    for(uint32_t tt = 0; tt < m_triangles.size(); tt++) {
+        for(uint32_t kk = 0; kk < 3; kk++) {
+            uint32_t a = m_triangles[tt].vertices[(kk + 1) % 3];
+            uint32_t b = m_triangles[tt].vertices[(kk + 2) % 3];
+            auto key = std::make_tuple(std::min(a, b), std::max(a, b));
+            auto result = open_edges.emplace(key, tt*4 + kk);
+            if(!result.second) {
+                uint32_t other = result.first->second;
+                m_triangles[tt].neighbors[kk] = other / 4;
+                m_triangles[other / 4].neighbors[other % 4] = tt;
+                open_edges.erase(result.first);
+            }
+        }
+    }
+
+    m_incident_offsets.assign(m_points.size() + 1, 0);
+    for(const auto& tri : m_triangles) {
+        for(uint32_t vv : tri.vertices)
+            m_incident_offsets[vv + 1]++;
+    }
+    for(size_t ii = 0; ii < m_points.size(); ii++)
+        m_incident_offsets[ii + 1] += m_incident_offsets[ii];
+
+    std::vector<uint32_t> fill(m_incident_offsets.begin(),
+            m_incident_offsets.end() - 1);
+    m_incident.resize(m_incident_offsets.back());
+    for(uint32_t tt = 0; tt < m_triangles.size(); tt++) {
+        for(uint32_t vv : m_triangles[tt].vertices)
+            m_incident[fill[vv]++] = tt;
+    }
+
+    std::vector<BoundingVolumeHierarchy::Item> items;
+    items.reserve(m_points.size());
+    for(size_t ii = 0; ii < m_points.size(); ii++)
+        items.push_back({m_points[ii], 0, ii});
+    m_point_tree = BoundingVolumeHierarchy(items);
+}
+
+bool NaturalNeighborInterpolator::inCircle(uint32_t tri, const Point& pt) const
+{
+    const Triangle& triangle = m_triangles[tri];
+    double dx = pt.x - triangle.center_x;
+    double dy = pt.y - triangle.center_y;
+    return dx*dx + dy*dy < triangle.radius_sq;
+}
+
+float NaturalNeighborInterpolator::interpolate(const Point& pt) const
+{
+    float distance;
+    size_t nearest = m_point_tree.nearest(pt, distance);
+    if(nearest == BoundingVolumeHierarchy::NONE)
+        return NAN;
+    nearest = m_point_tree[nearest].id;
+    if(distance == 0)
+        return m_values[nearest];
+
+    // The nearest point is always a natural neighbor, so at least one of its
+    // triangles would be destroyed by inserting pt. Grow the rest from there.
+    std::vector<uint32_t> cavity;
+    for(uint32_t ii = m_incident_offsets[nearest];
+            ii < m_incident_offsets[nearest + 1]; ii++) {
+        if(inCircle(m_incident[ii], pt)) {
+            cavity.push_back(m_incident[ii]);
+            break;
+        }
+    }
+
+    for(size_t ii = 0; ii < cavity.size(); ii++) {
+        for(uint32_t neighbor : m_triangles[cavity[ii]].neighbors) {
+            if(neighbor != NONE && inCircle(neighbor, pt) &&
+                    std::find(cavity.begin(), cavity.end(), neighbor) == cavity.end())
+                cavity.push_back(neighbor);
+        }
+    }
+
+    std::vector<BoundaryEdge> boundary;
+    for(uint32_t tt : cavity) {
+        const Triangle& tri = m_triangles[tt];
+        for(uint32_t kk = 0; kk < 3; kk++) {
+            uint32_t neighbor = tri.neighbors[kk];
+            if(neighbor != NONE &&
+                    std::find(cavity.begin(), cavity.end(), neighbor) != cavity.end())
+                continue;
+
+            BoundaryEdge edge;
+            edge.from = tri.vertices[(kk + 1) % 3];
+            edge.to = tri.vertices[(kk + 2) % 3];
+            edge.triangle = tt;
+
+            // pt is outside of the convex hull
+            if(orient(m_points[edge.from], m_points[edge.to], pt) <= 0)
+                return m_values[nearest];
+
+            edge.center = circumcenter(pt, m_points[edge.from], m_points[edge.to]);
+            boundary.push_back(edge);
+        }
+    }
+
+    if(boundary.empty())
+        return m_values[nearest];
+
+    // The piece stolen from the cell of point s lies between the new
+    // circumcenters of the boundary edges going into and out of s, and the
+    // old circumcenters of the destroyed triangles around s
+    double total_weight = 0;
+    double total_value = 0;
+    for(const auto& in : boundary) {
+        uint32_t site = in.to;
+        auto out = std::find_if(boundary.begin(), boundary.end(),
+                [site](const BoundaryEdge& edge) { return edge.from == site; });
+        if(out == boundary.end())
+            return m_values[nearest];
+
+        std::vector<Center> polygon;
+        polygon.push_back(in.center);
+
+        uint32_t tt = in.triangle;
+        for(size_t steps = 0; steps <= cavity.size(); steps++) {
+            const Triangle& tri = m_triangles[tt];
+            polygon.push_back(Center{tri.center_x, tri.center_y});
+
+            uint32_t kk = std::find(tri.vertices, tri.vertices + 3, site) -
+                tri.vertices;
+            if(tt == out->triangle && tri.vertices[(kk + 1) % 3] == out->to)
+                break;
+
+            // rotate counter-clockwise around site, across the edge from
+            // site to the next vertex
+            tt = tri.neighbors[(kk + 2) % 3];
+            if(tt == NONE)
+                return m_values[nearest];
+        }
+        polygon.push_back(out->center);
+
+        double area = 0;
+        for(size_t ii = 0; ii < polygon.size(); ii++) {
+            const Center& a = polygon[ii];
+            const Center& b = polygon[(ii + 1) % polygon.size()];
+            area += a.x*b.y - b.x*a.y;
+        }
+        area = std::abs(area)*0.5;
+
+        total_weight += area;
+        total_value += area*m_values[site];
+    }
+
+    if(total_weight <= 0)
+        return m_values[nearest];
+    return total_value / total_weight;
+}
+
+std::vector<float> NaturalNeighborInterpolator::interpolate(
+        const std::vector<Point>& pts) const
+{
+    std::vector<float> out(pts.size());
+    parallelFor(0, pts.size(), [&](size_t ii) {
+        out[ii] = interpolate(pts[ii]);
+    });
+    return out;
+}
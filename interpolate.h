@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "geometry.h"
+#include "voronoi.h"
+#include "bvh.h"
+
+/**
+ * Natural neighbor (Sibson) interpolation of values given at the input points.
+ *
+ * Inserting a query point q into the diagram would give it a cell made of
+ * pieces stolen from the cells of its natural neighbors, and each neighbor is
+ * weighted by the fraction of the new cell that came from it. The stolen
+ * pieces are found locally: the triangles of the dual whose circumcircles
+ * contain q are exactly the ones that insertion would destroy, so only those
+ * are visited and the diagram itself is never modified.
+ *
+ * Queries outside of the convex hull of the points take the value of the
+ * nearest point.
+ */
+class NaturalNeighborInterpolator
+{
+public:
+    NaturalNeighborInterpolator(const Voronoi& voronoi,
+            const std::vector<Point>& points,
+            const std::vector<float>& values);
+
+    float interpolate(const Point& pt) const;
+
+    // Interpolate many points, split across threads
+    std::vector<float> interpolate(const std::vector<Point>& pts) const;
+
+private:
+    static const uint32_t NONE = 0xffffffff;
+
+    // Dual triangle with counter-clockwise vertices, neighbors[k] is across
+    // the edge opposite vertices[k]
+    struct Triangle
+    {
+        uint32_t vertices[3];
+        uint32_t neighbors[3];
+        double center_x, center_y;
+        double radius_sq;
+    };
+
+    bool inCircle(uint32_t tri, const Point& pt) const;
+
+    std::vector<Point> m_points;
+    std::vector<float> m_values;
+    std::vector<Triangle> m_triangles;
+
+    // triangles touching point ii are m_incident[m_incident_offsets[ii]] up
+    // to m_incident[m_incident_offsets[ii + 1]]
+    std::vector<uint32_t> m_incident_offsets;
+    std::vector<uint32_t> m_incident;
+
+    BoundingVolumeHierarchy m_point_tree;
+};
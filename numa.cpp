@@ -0,0 +1,95 @@
+#include "numa.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+
+namespace
+{
+
+// CPUs in a list like "0-3,8-11"
+std::vector<int> parseCpuList(const std::string& text)
+{
+    std::vector<int> cpus;
+    std::istringstream iss(text);
+    std::string range;
+    while(std::getline(iss, range, ',')) {
+        int first, last;
+        char dash;
+        std::istringstream part(range);
+        if(!(part >> first))
+            continue;
+        last = first;
+        if(part >> dash >> last && dash != '-')
+            last = first;
+        for(int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+}
+
+std::vector<NumaNode> numaNodes()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &allowed);
+    }
+
+    std::vector<NumaNode> nodes;
+    const char* root = "/sys/devices/system/node";
+    if(DIR* dir = opendir(root)) {
+        while(dirent* entry = readdir(dir)) {
+            int id;
+            char extra;
+            if(std::sscanf(entry->d_name, "node%d%c", &id, &extra) != 1)
+                continue;
+
+            std::ifstream file(std::string(root) + "/" + entry->d_name + "/cpulist");
+            std::string text;
+            std::getline(file, text);
+
+            NumaNode node{id, {}};
+            for(int cpu : parseCpuList(text)) {
+                if(cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                    node.cpus.push_back(cpu);
+            }
+            if(!node.cpus.empty())
+                nodes.push_back(node);
+        }
+        closedir(dir);
+    }
+
+    if(nodes.empty()) {
+        NumaNode node{0, {}};
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(CPU_ISSET(cpu, &allowed))
+                node.cpus.push_back(cpu);
+        }
+        nodes.push_back(node);
+    }
+
+    std::sort(nodes.begin(), nodes.end(),
+            [](const NumaNode& lhs, const NumaNode& rhs) {
+                return lhs.id < rhs.id;
+            });
+    return nodes;
+}
+
+bool pinThread(const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu : cpus)
+        CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
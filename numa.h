@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+/**
+ * NUMA topology as the kernel reports it under /sys/devices/system/node, and
+ * pinning threads to a node's CPUs.
+ *
+ * Linux places a page on the node of the thread that first touches it, and
+ * malloc hands each thread its own arena, so a thread that stays on one node
+ * keeps the memory it allocates there. Pinning is all it takes to keep a
+ * worker's scratch and output local, without a NUMA library.
+ */
+
+struct NumaNode
+{
+    int id;
+
+    // CPUs of the node this process may run on
+    std::vector<int> cpus;
+};
+
+// Nodes with at least one usable CPU, a single node holding every usable CPU
+// if the kernel doesn't say
+std::vector<NumaNode> numaNodes();
+
+// Restrict the calling thread to cpus, returns false if that's not allowed
+bool pinThread(const std::vector<int>& cpus);
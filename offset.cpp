@@ -0,0 +1,426 @@
+#include "offset.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cmath>
+
+#include "parallel.h"
+#include "std_ext.h"
+
+namespace
+{
+
+const float TWO_PI = 2*M_PI;
+const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+// Where an offset crosses a piece, seen from one of the piece's sites
+struct Crossing
+{
+    uint32_t site;
+    double angle;
+    bool start;
+    uint32_t index;
+
+    bool operator<(const Crossing& rhs) const
+    {
+        // an arc that shrank to nothing at a node starts before it ends
+        return std::make_tuple(site, angle, !start) <
+            std::make_tuple(rhs.site, rhs.angle, !rhs.start);
+    }
+};
+
+}
+
+OffsetCurves::OffsetCurves(const Voronoi& voronoi,
+        const std::vector<Point>& points) :
+    m_points(points)
+{
+    // coincident points share a cell, the first of them stands for the rest
+    std::vector<uint32_t> same(points.size());
+    std::unordered_map<std::tuple<float, float>, uint32_t> first;
+    float area = 0;
+    for(uint32_t ii = 0; ii < points.size(); ii++) {
+        same[ii] = first.emplace(std::make_tuple(points[ii].x, points[ii].y),
+                ii).first->second;
+        const Point& next = points[(ii + 1) % points.size()];
+        area += points[ii].x*next.y - next.x*points[ii].y;
+    }
+    float sign = area < 0 ? -1 : 1;
+
+    // The circle of a node inside touches its three points in the order they
+    // come along the boundary, as in SkeletonHierarchy. Two nodes with a pair
+    // of parents in common are the ends of the edge between them.
+    std::vector<Voronoi::Node::Ptr> nodes;
+    std::vector<bool> inside;
+    std::unordered_map<std::tuple<uint32_t, uint32_t>,
+        std::tuple<uint32_t, uint32_t>> open_edges;
+    for(const auto& node : voronoi.getNodes()) {
+        if(node->parents.size() != 3)
+            continue;
+        std::vector<uint32_t> parents;
+        for(size_t parent : node->parents)
+            parents.push_back(same[parent]);
+        std::sort(parents.begin(), parents.end());
+        const Point& pt0 = points[parents[0]];
+        const Point& pt1 = points[parents[1]];
+        const Point& pt2 = points[parents[2]];
+        float turn = (pt1.x - pt0.x)*(pt2.y - pt0.y) -
+            (pt1.y - pt0.y)*(pt2.x - pt0.x);
+        if(turn == 0)
+            continue;
+
+        uint32_t index = nodes.size();
+        nodes.push_back(node);
+        inside.push_back(sign*turn > 0);
+        for(size_t kk = 0; kk < 3; kk++) {
+            auto key = std::make_tuple(parents[kk], parents[(kk + 1) % 3]);
+            if(std::get<0>(key) > std::get<1>(key))
+                std::swap(std::get<0>(key), std::get<1>(key));
+            auto result = open_edges.emplace(key,
+                    std::make_tuple(index, NONE));
+            if(!result.second && std::get<1>(result.first->second) == NONE)
+                std::get<1>(result.first->second) = index;
+        }
+    }
+
+    for(const auto& entry : open_edges) {
+        uint32_t a = std::get<0>(entry.first);
+        uint32_t b = std::get<1>(entry.first);
+        uint32_t node0 = std::get<0>(entry.second);
+        uint32_t node1 = std::get<1>(entry.second);
+        if(node1 != NONE) {
+            addEdge(a, b, *nodes[node0], inside[node0],
+                    *nodes[node1], inside[node1]);
+            continue;
+        }
+
+        // a pair with one node is on the hull, its ray leads away from the
+        // node's third parent
+        uint32_t away = NONE;
+        for(size_t parent : nodes[node0]->parents) {
+            if(same[parent] != a && same[parent] != b)
+                away = same[parent];
+        }
+        addRay(a, b, away, *nodes[node0], inside[node0]);
+    }
+
+    // Points all in a row have strips for cells, each pair of neighbors
+    // along the row is split by a line that's two rays from their midpoint
+    std::vector<uint32_t> distinct;
+    for(uint32_t ii = 0; ii < same.size(); ii++) {
+        if(same[ii] == ii)
+            distinct.push_back(ii);
+    }
+    if(nodes.empty() && distinct.size() >= 2) {
+        const Point& origin = points[distinct[0]];
+        uint32_t far = *std::max_element(distinct.begin(), distinct.end(),
+                [&](uint32_t lhs, uint32_t rhs) {
+                    return distance2d(origin, points[lhs]) <
+                        distance2d(origin, points[rhs]);
+                });
+        Vector along = points[far] - origin;
+        std::sort(distinct.begin(), distinct.end(),
+                [&](uint32_t lhs, uint32_t rhs) {
+                    return dot(points[lhs] - origin, along) <
+                        dot(points[rhs] - origin, along);
+                });
+        for(size_t ii = 0; ii + 1 < distinct.size(); ii++) {
+            uint32_t a = distinct[ii];
+            uint32_t b = distinct[ii + 1];
+            Point middle = points[a] + (points[b] - points[a])*0.5f;
+            float half = distance2d(points[a], points[b])*0.5f;
+            addPiece(a, b, half, INFINITY, middle, true, false);
+            addPiece(a, b, half, INFINITY, middle, false, false);
+        }
+    }
+
+    std::sort(m_pieces.begin(), m_pieces.end(),
+            [](const Piece& lhs, const Piece& rhs) {
+                return lhs.low < rhs.low;
+            });
+
+    // Half the distance to the nearest neighbor is the lowest any piece
+    // around a site starts at, up to there its whole circle is an offset
+    std::vector<float> nearest(points.size(), NAN);
+    if(distinct.size() == 1)
+        nearest[distinct[0]] = INFINITY;
+    for(const auto& piece : m_pieces) {
+        for(uint32_t site : piece.sites) {
+            if(!(nearest[site] <= piece.low))
+                nearest[site] = piece.low;
+        }
+    }
+    for(uint32_t ii = 0; ii < nearest.size(); ii++) {
+        if(!std::isnan(nearest[ii]))
+            m_lone.push_back(ii);
+    }
+    std::sort(m_lone.begin(), m_lone.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return nearest[lhs] < nearest[rhs];
+    });
+    for(uint32_t site : m_lone)
+        m_lone_until.push_back(nearest[site]);
+}
+
+/**
+ * Add the pieces of the edge between node0 and node1, both with parents a and
+ * b. Positions along the edge are the midpoint m of a and b plus t times the
+ * unit normal on the left of a -> b, at a distance sqrt(h^2 + t^2) from both
+ * with h half the distance between them. If the nodes are on either side of
+ * m the edge passes through it and is cut in two there.
+ */
+void OffsetCurves::addEdge(uint32_t a, uint32_t b,
+        const Voronoi::Node& node0, bool inward0,
+        const Voronoi::Node& node1, bool inward1)
+{
+    const Point& pt0 = m_points[a];
+    const Point& pt1 = m_points[b];
+    Point middle = pt0 + (pt1 - pt0)*0.5f;
+    Vector normal(pt0.y - pt1.y, pt1.x - pt0.x);
+    float half = distance2d(pt0, pt1)*0.5f;
+
+    float t0 = dot(Point(node0.x, node0.y) - middle, normal);
+    float t1 = dot(Point(node1.x, node1.y) - middle, normal);
+    if(t0*t1 < 0) {
+        addPiece(a, b, half, node0.radius, Point(node0.x, node0.y), t0 > 0,
+                inward0);
+        addPiece(a, b, half, node1.radius, Point(node1.x, node1.y), t1 > 0,
+                inward1);
+    } else if(node0.radius < node1.radius) {
+        addPiece(a, b, node0.radius, node1.radius, Point(node1.x, node1.y),
+                t0 + t1 > 0, inward0 && inward1);
+    } else {
+        addPiece(a, b, node1.radius, node0.radius, Point(node0.x, node0.y),
+                t0 + t1 > 0, inward0 && inward1);
+    }
+}
+
+/**
+ * Add the pieces of the ray from node between a and b on the hull, which
+ * heads away from the third parent of the node. When the node is on the same
+ * side of a -> b as that parent the ray first passes between a and b.
+ */
+void OffsetCurves::addRay(uint32_t a, uint32_t b, uint32_t away,
+        const Voronoi::Node& node, bool inward)
+{
+    const Point& pt0 = m_points[a];
+    const Point& pt1 = m_points[b];
+    Point middle = pt0 + (pt1 - pt0)*0.5f;
+    Vector normal(pt0.y - pt1.y, pt1.x - pt0.x);
+    float half = distance2d(pt0, pt1)*0.5f;
+
+    bool heading = dot(m_points[away] - middle, normal) < 0;
+    float t = dot(Point(node.x, node.y) - middle, normal);
+    if(t != 0 && (t > 0) != heading) {
+        addPiece(a, b, half, node.radius, Point(node.x, node.y), t > 0, inward);
+        addPiece(a, b, half, INFINITY, middle, heading, false);
+    } else {
+        addPiece(a, b, node.radius, INFINITY, middle, heading, false);
+    }
+}
+
+void OffsetCurves::addPiece(uint32_t a, uint32_t b, float low, float high,
+        const Point& end, bool left, bool inward)
+{
+    if(!(low < high))
+        return;
+    m_pieces.push_back(Piece{{a, b}, low, high, end.x, end.y, left, inward});
+}
+
+std::vector<OffsetCurves::Ring> OffsetCurves::compute(float distance,
+        Side side) const
+{
+    return compute(std::vector<float>{distance}, side)[0];
+}
+
+/**
+ * Sweep the distances from the smallest up, keeping the pieces whose range
+ * holds the current one: a piece comes in once the distance passes its low
+ * and a heap on high says when it leaves. Each distance then only sees the
+ * pieces it crosses and the sites whose whole circle it is.
+ */
+std::vector<std::vector<OffsetCurves::Ring>> OffsetCurves::compute(
+        const std::vector<float>& distances, Side side) const
+{
+    std::vector<size_t> order(distances.size());
+    for(size_t ii = 0; ii < order.size(); ii++)
+        order[ii] = ii;
+    std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        return distances[lhs] < distances[rhs];
+    });
+
+    std::vector<std::vector<uint32_t>> crossed(distances.size());
+    std::vector<std::vector<uint32_t>> whole(distances.size());
+    std::vector<uint32_t> active;
+    std::vector<uint32_t> position(m_pieces.size());
+    std::vector<std::tuple<float, uint32_t>> leaving;
+    std::greater<std::tuple<float, uint32_t>> later;
+    size_t next = 0;
+    for(size_t index : order) {
+        float distance = distances[index];
+        if(!(distance > 0))
+            continue;
+
+        for(; next < m_pieces.size() && m_pieces[next].low < distance; next++) {
+            position[next] = active.size();
+            active.push_back(next);
+            leaving.emplace_back(m_pieces[next].high, next);
+            std::push_heap(leaving.begin(), leaving.end(), later);
+        }
+        while(!leaving.empty() && std::get<0>(leaving.front()) < distance) {
+            uint32_t piece = std::get<1>(leaving.front());
+            std::pop_heap(leaving.begin(), leaving.end(), later);
+            leaving.pop_back();
+            position[active.back()] = position[piece];
+            active[position[piece]] = active.back();
+            active.pop_back();
+        }
+
+        crossed[index] = active;
+        if(side != INWARD) {
+            auto it = std::lower_bound(m_lone_until.begin(),
+                    m_lone_until.end(), distance);
+            whole[index].assign(m_lone.begin() + (it - m_lone_until.begin()),
+                    m_lone.end());
+        }
+    }
+
+    std::vector<std::vector<Ring>> out(distances.size());
+    parallelFor(0, distances.size(), [&](size_t ii) {
+        if(distances[ii] > 0)
+            out[ii] = rings(distances[ii], side, crossed[ii], whole[ii]);
+    });
+    return out;
+}
+
+/**
+ * Join the crossings into rings. Crossing the bisector of a and b on the left
+ * of a -> b the offset leaves the cell of b for that of a, so an arc around a
+ * starts there and one around b ends; on the right it's the other way round.
+ * Around each site an arc runs from a crossing where one starts to the next
+ * one where one ends, and the next arc of the ring is the one that starts
+ * where it ends.
+ */
+std::vector<OffsetCurves::Ring> OffsetCurves::rings(float distance, Side side,
+        const std::vector<uint32_t>& crossed,
+        const std::vector<uint32_t>& whole) const
+{
+    std::vector<Crossing> crossings;
+    crossings.reserve(crossed.size()*2);
+    for(uint32_t ii = 0; ii < crossed.size(); ii++) {
+        const Piece& piece = m_pieces[crossed[ii]];
+        const Point& pt0 = m_points[piece.sites[0]];
+        const Point& pt1 = m_points[piece.sites[1]];
+        double x = piece.end_x;
+        double y = piece.end_y;
+        if(distance != piece.high) {
+            double dx = double(pt1.x) - pt0.x;
+            double dy = double(pt1.y) - pt0.y;
+            double length = std::sqrt(dx*dx + dy*dy);
+            double along = std::sqrt(std::max(0.0, double(distance)*distance -
+                        0.25*length*length)) / length;
+            if(!piece.left)
+                along = -along;
+            x = 0.5*(double(pt0.x) + pt1.x) - dy*along;
+            y = 0.5*(double(pt0.y) + pt1.y) + dx*along;
+        }
+        for(size_t kk = 0; kk < 2; kk++) {
+            const Point& center = kk == 0 ? pt0 : pt1;
+            crossings.push_back(Crossing{piece.sites[kk],
+                    std::atan2(y - center.y, x - center.x),
+                    (kk == 0) == piece.left, ii});
+        }
+    }
+    std::sort(crossings.begin(), crossings.end());
+
+    // arcs, and for each crossing the arc starting there
+    std::vector<Arc> arcs;
+    std::vector<uint32_t> ends;
+    std::vector<uint32_t> starting(crossed.size(), NONE);
+    std::vector<bool> paired(crossings.size(), false);
+    for(size_t begin = 0, end = 0; begin < crossings.size(); begin = end) {
+        while(end < crossings.size() &&
+                crossings[end].site == crossings[begin].site)
+            end++;
+
+        // twice round, so the last start finds the first end
+        size_t pending = NONE;
+        for(size_t jj = 0; jj < 2*(end - begin); jj++) {
+            size_t curr = begin + jj % (end - begin);
+            if(paired[curr]) {
+                if(crossings[curr].start)
+                    pending = NONE;
+                continue;
+            }
+            if(crossings[curr].start) {
+                pending = curr;
+            } else if(pending != NONE) {
+                const Crossing& from = crossings[pending];
+                const Crossing& to = crossings[curr];
+                double stop = to.angle < from.angle ? to.angle + TWO_PI :
+                    to.angle;
+                starting[from.index] = arcs.size();
+                arcs.push_back(Arc{from.site, float(from.angle), float(stop)});
+                ends.push_back(to.index);
+                paired[pending] = paired[curr] = true;
+                pending = NONE;
+            }
+        }
+    }
+
+    std::vector<Ring> out;
+    std::vector<bool> used(arcs.size(), false);
+    for(size_t ii = 0; ii < arcs.size(); ii++) {
+        if(used[ii])
+            continue;
+
+        Ring ring;
+        ring.distance = distance;
+        bool inward = true, outward = true;
+        for(uint32_t curr = ii; curr != NONE && !used[curr];
+                curr = starting[ends[curr]]) {
+            used[curr] = true;
+            if(m_pieces[crossed[ends[curr]]].inward)
+                outward = false;
+            else
+                inward = false;
+            if(arcs[curr].end_angle > arcs[curr].start_angle)
+                ring.arcs.push_back(arcs[curr]);
+        }
+
+        bool keep = side == BOTH_SIDES || (side == INWARD ? inward : outward);
+        if(keep && !ring.arcs.empty())
+            out.push_back(ring);
+    }
+
+    for(uint32_t site : whole)
+        out.push_back(Ring{distance, {Arc{site, 0, TWO_PI}}});
+    return out;
+}
+
+std::vector<Point> OffsetCurves::tessellate(const Ring& ring,
+        float max_error) const
+{
+    // the sagitta of a chord spanning angle a is d*(1 - cos(a/2))
+    float step = TWO_PI;
+    if(max_error < ring.distance)
+        step = 2*std::acos(1 - max_error / ring.distance);
+    step = std::max(step, 1e-3f);
+
+    std::vector<Point> out;
+    for(const auto& arc : ring.arcs) {
+        const Point& center = m_points[arc.site];
+        size_t count = std::max<size_t>(1,
+                std::ceil((arc.end_angle - arc.start_angle) / step));
+        float delta = (arc.end_angle - arc.start_angle) / count;
+
+        // the last point of the arc is the first point of the next one
+        for(size_t jj = 0; jj < count; jj++) {
+            float angle = arc.start_angle + jj*delta;
+            out.push_back(center + Vector(std::cos(angle), std::sin(angle))*
+                    ring.distance);
+        }
+    }
+    return out;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "geometry.h"
+#include "voronoi.h"
+
+/**
+ * Offset curves (buffers) read off the skeleton of a finished Voronoi diagram.
+ *
+ * The offset at distance d is where the nearest point is exactly d away.
+ * Inside the cell of a point that is an arc of radius d around it, and it
+ * passes into the next cell where it crosses the edge between them. Along an
+ * edge the distance to its two points is smallest where it passes between
+ * them and grows away from there, so with the edges cut at those midpoints
+ * each piece is crossed at most once, at a d between the radii of its ends.
+ *
+ * The pieces are built once from the nodes: two nodes with two parents in
+ * common are the ends of an edge, and a node that shares them with no other
+ * starts a ray out of the hull. Points that are all in a row have no nodes,
+ * and their cells are strips between parallel bisectors. An offset then only
+ * looks at the pieces it crosses, and the batch form sweeps the distances in
+ * order, adding pieces as d passes their lower radius and dropping them past
+ * the upper one, so its cost is in the arcs it emits.
+ *
+ * With points sampled along a closed boundary, as for SkeletonHierarchy, a
+ * node is inside if its circle touches its three points in the order they
+ * come along the boundary. Inward rings only cross the skeleton, the pieces
+ * of inside nodes, and outward rings only the rest, as do the whole circles
+ * around points further than 2d from any other. A ring closer than half the
+ * sample spacing passes between the samples and is on neither side. Both
+ * sides are traced either way, since they share cells, and the rings are
+ * kept by side afterwards.
+ */
+class OffsetCurves
+{
+public:
+    // Which pieces of the diagram an offset may cross
+    enum Side
+    {
+        INWARD,
+        OUTWARD,
+        BOTH_SIDES,
+    };
+
+    // Counter-clockwise arc of radius distance around points[site]. Angles are
+    // in radians, end_angle >= start_angle
+    struct Arc
+    {
+        size_t site;
+        float start_angle;
+        float end_angle;
+    };
+
+    // Closed ring made from consecutive arcs, the end of each arc is the start
+    // of the next one. Positions closer than distance to the points are on
+    // its left.
+    struct Ring
+    {
+        float distance;
+        std::vector<Arc> arcs;
+    };
+
+    // points are the sites of voronoi, in order along the boundary for the
+    // sides to mean anything
+    OffsetCurves(const Voronoi& voronoi, const std::vector<Point>& points);
+
+    std::vector<Ring> compute(float distance, Side side = BOTH_SIDES) const;
+
+    // Offsets for several distances from one sweep, in the order given
+    std::vector<std::vector<Ring>> compute(const std::vector<float>& distances,
+            Side side = BOTH_SIDES) const;
+
+    // Approximate a ring by a polyline that deviates from the true arcs by at
+    // most max_error
+    std::vector<Point> tessellate(const Ring& ring, float max_error) const;
+
+private:
+    // Part of the bisector of sites[0] and sites[1] that an offset crosses
+    // once, at any distance in (low, high]. It's on the left of sites[0] ->
+    // sites[1] if left, and at high it's at the node (end_x, end_y) unless
+    // high is infinite.
+    struct Piece
+    {
+        uint32_t sites[2];
+        float low, high;
+        float end_x, end_y;
+        bool left;
+        bool inward;
+    };
+
+    void addEdge(uint32_t a, uint32_t b, const Voronoi::Node& node0,
+            bool inward0, const Voronoi::Node& node1, bool inward1);
+    void addRay(uint32_t a, uint32_t b, uint32_t away,
+            const Voronoi::Node& node, bool inward);
+    void addPiece(uint32_t a, uint32_t b, float low, float high,
+            const Point& end, bool left, bool inward);
+    std::vector<Ring> rings(float distance, Side side,
+            const std::vector<uint32_t>& crossed,
+            const std::vector<uint32_t>& whole) const;
+
+    std::vector<Point> m_points;
+
+    // sorted by low
+    std::vector<Piece> m_pieces;
+
+    // sites that have a cell, by increasing distance to their nearest
+    // neighbor, and half that distance. A site's whole circle is an offset up
+    // to there.
+    std::vector<uint32_t> m_lone;
+    std::vector<float> m_lone_until;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+
+/**
+ * Set on threads that are already one of a pool sharing out the cores, such
+ * as the workers of skeletond or skeleton_batch and the threads started
+ * below. Their parallel work stays on the thread rather than starting a
+ * thread per core under every worker, which would also move it off the
+ * worker's NUMA node and out of its perf counters.
+ */
+inline
+bool& onWorkerThread()
+{
+    static thread_local bool worker = false;
+    return worker;
+}
+
+// Keeps the parallel helpers below on the calling thread while it's in
+// scope, as if it were a worker, if serial
+class SerialScope
+{
+public:
+    explicit SerialScope(bool serial) : m_saved(onWorkerThread())
+    {
+        if(serial)
+            onWorkerThread() = true;
+    }
+
+    ~SerialScope()
+    {
+        onWorkerThread() = m_saved;
+    }
+
+    SerialScope(const SerialScope&) = delete;
+    SerialScope& operator=(const SerialScope&) = delete;
+
+private:
+    bool m_saved;
+};
+
+// Number of threads to split parallel work across, one on a worker thread
+inline
+size_t threadCount()
+{
+    if(onWorkerThread())
+        return 1;
+    size_t count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+}
+
+/**
+ * Call func(ii) for every ii in [begin, end), splitting the range into one
+ * contiguous chunk per thread, threads of them or threadCount() if 0
+ */
+template <typename Func>
+void parallelFor(size_t begin, size_t end, Func func, size_t threads = 0)
+{
+    if(end <= begin)
+        return;
+
+    size_t count = std::min(threads == 0 ? threadCount() : threads,
+            end - begin);
+    if(count <= 1) {
+        for(size_t ii = begin; ii < end; ii++)
+            func(ii);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    size_t chunk = (end - begin + count - 1) / count;
+    for(size_t start = begin; start < end; start += chunk) {
+        size_t stop = std::min(end, start + chunk);
+        workers.emplace_back([start, stop, &func]() {
+            onWorkerThread() = true;
+            for(size_t ii = start; ii < stop; ii++)
+                func(ii);
+        });
+    }
+
+    for(auto& worker : workers)
+        worker.join();
+}
+
+/**
+ * Sort [first, last) by sorting one chunk per thread and then merging pairs of
+ * neighboring chunks in parallel until a single chunk is left, threads as for
+ * parallelFor
+ */
+template <typename RandomIt, typename Compare>
+void parallelSort(RandomIt first, RandomIt last, Compare comp,
+        size_t threads = 0)
+{
+    size_t size = std::distance(first, last);
+    size_t count = std::min(threads == 0 ? threadCount() : threads,
+            size / 1024 + 1);
+    if(count <= 1) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    std::vector<size_t> bounds;
+    for(size_t ii = 0; ii <= count; ii++)
+        bounds.push_back(size*ii / count);
+
+    parallelFor(0, count, [&](size_t ii) {
+        std::sort(first + bounds[ii], first + bounds[ii + 1], comp);
+    }, count);
+
+    while(bounds.size() > 2) {
+        std::vector<size_t> merged;
+        size_t pairs = (bounds.size() - 1) / 2;
+        parallelFor(0, pairs, [&](size_t ii) {
+            std::inplace_merge(first + bounds[2*ii], first + bounds[2*ii + 1],
+                    first + bounds[2*ii + 2], comp);
+        }, count);
+
+        for(size_t ii = 0; ii < bounds.size(); ii += 2)
+            merged.push_back(bounds[ii]);
+        if(merged.back() != bounds.back())
+            merged.push_back(bounds.back());
+        bounds.swap(merged);
+    }
+}
+
+template <typename RandomIt>
+void parallelSort(RandomIt first, RandomIt last)
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type Value;
+    parallelSort(first, last, std::less<Value>());
+}
@@ -0,0 +1,113 @@
+#include "perf_counters.h"
+
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace
+{
+
+const uint64_t CONFIGS[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+int openCounter(uint64_t config, int group)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return ::syscall(SYS_perf_event_open, &attr, 0, -1, group,
+            PERF_FLAG_FD_CLOEXEC);
+}
+
+}
+
+PerfCounters::PerfCounters() : m_counting(false)
+{
+    for(int ii = 0; ii < COUNTERS; ii++)
+        m_fds[ii] = -1;
+    for(int ii = 0; ii < COUNTERS + 2; ii++)
+        m_start[ii] = 0;
+}
+
+PerfCounters::~PerfCounters()
+{
+    for(int ii = COUNTERS - 1; ii >= 0; ii--) {
+        if(m_fds[ii] >= 0)
+            ::close(m_fds[ii]);
+    }
+}
+
+bool PerfCounters::open()
+{
+    for(int ii = 0; ii < COUNTERS; ii++) {
+        m_fds[ii] = openCounter(CONFIGS[ii], m_fds[0]);
+        if(m_fds[ii] < 0) {
+            for(int jj = ii - 1; jj >= 0; jj--) {
+                ::close(m_fds[jj]);
+                m_fds[jj] = -1;
+            }
+            return false;
+        }
+    }
+
+    ::ioctl(m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ::ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+void PerfCounters::start()
+{
+    m_start_time = std::chrono::steady_clock::now();
+    m_counting = available() && read(m_start);
+}
+
+void PerfCounters::stop(PerfSample& sample)
+{
+    uint64_t values[COUNTERS + 2];
+    bool counted = m_counting && read(values);
+
+    sample.seconds += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - m_start_time).count();
+    if(!counted)
+        return;
+
+    // When there are more counters than the PMU has the kernel takes turns
+    // with them, so the counts only cover the part of the phase the group
+    // was running and are scaled up to all of it
+    uint64_t enabled = values[0] - m_start[0];
+    uint64_t running = values[1] - m_start[1];
+    if(running == 0)
+        return;
+    double scale = double(enabled) / running;
+    uint64_t* counts[COUNTERS] = {&sample.cycles, &sample.instructions,
+        &sample.cache_misses, &sample.branch_misses};
+    for(int ii = 0; ii < COUNTERS; ii++)
+        *counts[ii] += uint64_t((values[ii + 2] - m_start[ii + 2])*scale + 0.5);
+}
+
+bool PerfCounters::read(uint64_t (&values)[COUNTERS + 2])
+{
+    // PERF_FORMAT_GROUP with both times: number of counters, time enabled,
+    // time running, then the counters' values
+    uint64_t buffer[3 + COUNTERS];
+    if(::read(m_fds[0], buffer, sizeof(buffer)) != ssize_t(sizeof(buffer)) ||
+            buffer[0] != COUNTERS)
+        return false;
+
+    std::memcpy(values, buffer + 1, sizeof(values));
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+/**
+ * Hardware performance counters for the calling thread through
+ * perf_event_open: cycles, instructions, cache misses and branch misses,
+ * opened as one group so they're all read at once. Counts are scaled by how
+ * long the group was actually on the PMU when the kernel multiplexes it.
+ *
+ * Counters are often unavailable (no PMU in a VM, perf_event_paranoid,
+ * seccomp), in which case open() returns false and samples only carry the
+ * elapsed time.
+ */
+
+struct PerfSample
+{
+    double seconds = 0;
+
+    // all zero unless counters were available
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cache_misses = 0;
+    uint64_t branch_misses = 0;
+};
+
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Open and start the counters, returns false if they're unavailable
+    bool open();
+
+    bool available() const
+    {
+        return m_fds[0] >= 0;
+    }
+
+    // Start a phase
+    void start();
+
+    // Add everything counted since start() to sample
+    void stop(PerfSample& sample);
+
+private:
+    static const int COUNTERS = 4;
+
+    // time enabled and running, then the counts
+    bool read(uint64_t (&values)[COUNTERS + 2]);
+
+    int m_fds[COUNTERS];
+    uint64_t m_start[COUNTERS + 2];
+    bool m_counting;
+    std::chrono::steady_clock::time_point m_start_time;
+};
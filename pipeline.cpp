@@ -0,0 +1,191 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "voronoi.h"
+#include "parallel.h"
+#include "numa.h"
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+double since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// A polygon on its way through the stages
+struct Item
+{
+    size_t index;
+    std::vector<Point> points;
+    FlatDiagram diagram;
+    bool ok;
+};
+
+typedef std::unique_ptr<Item> ItemPtr;
+
+/**
+ * Wait until attempt() succeeds or done() says it never will, adding the
+ * time spent waiting to stats. Spins briefly, then yields, then sleeps, so
+ * short waits are quick and long ones don't hold a core.
+ */
+template <typename Attempt, typename Done>
+bool wait(Attempt attempt, Done done, StageStats& stats)
+{
+    if(attempt())
+        return true;
+
+    Clock::time_point start = Clock::now();
+    for(size_t spins = 0; ; spins++) {
+        if(attempt()) {
+            stats.stall_seconds += since(start);
+            return true;
+        }
+        if(done()) {
+            stats.stall_seconds += since(start);
+            return attempt();
+        }
+        if(spins >= 4096)
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        else if(spins >= 64)
+            std::this_thread::yield();
+    }
+}
+
+}
+
+BatchPipeline::BatchPipeline(size_t workers, size_t window, bool numa) :
+    m_workers(std::max<size_t>(1, workers)),
+    m_window(std::max<size_t>(1, window)), m_numa(numa)
+{
+}
+
+PipelineStats BatchPipeline::run(const Reader& read, const Writer& write)
+{
+    PipelineStats stats;
+    Clock::time_point start = Clock::now();
+
+    std::vector<NumaNode> nodes(1);
+    if(m_numa)
+        nodes = numaNodes();
+
+    // one queue of parsed polygons per node, each big enough for the window
+    std::vector<std::unique_ptr<BoundedQueue<ItemPtr>>> parsed;
+    for(size_t ii = 0; ii < nodes.size(); ii++)
+        parsed.emplace_back(new BoundedQueue<ItemPtr>(m_window));
+    BoundedQueue<ItemPtr> computed(m_window);
+
+    // items read so far, and written so far, the difference is in flight
+    std::atomic<size_t> read_count(0);
+    std::atomic<size_t> written(0);
+    std::atomic<bool> read_done(false);
+    std::atomic<size_t> workers_left(m_workers);
+
+    std::thread parser([&]() {
+        while(true) {
+            wait([&]() {
+                    return read_count.load() - written.load() < m_window;
+                }, []() { return false; }, stats.parse);
+
+            Clock::time_point busy = Clock::now();
+            ItemPtr item(new Item);
+            item->index = read_count.load();
+            bool more = read(item->points);
+            stats.parse.busy_seconds += since(busy);
+            if(!more)
+                break;
+
+            // the window keeps the queue from filling
+            stats.parse.items++;
+            read_count++;
+            parsed[item->index % parsed.size()]->tryPush(item);
+        }
+        read_done = true;
+    });
+
+    std::vector<StageStats> worker_stats(m_workers);
+    std::vector<uint64_t> worker_failed(m_workers, 0);
+    std::vector<std::thread> workers;
+    for(size_t ii = 0; ii < m_workers; ii++) {
+        // workers in contiguous blocks per node
+        size_t node = ii*nodes.size() / m_workers;
+        workers.emplace_back([&, ii, node]() {
+            if(m_numa)
+                pinThread(nodes[node].cpus);
+            onWorkerThread() = true;
+
+            // own node first, then the others
+            auto take = [&](ItemPtr& item) {
+                for(size_t jj = 0; jj < parsed.size(); jj++) {
+                    if(parsed[(node + jj) % parsed.size()]->tryPop(item))
+                        return true;
+                }
+                return false;
+            };
+
+            ItemPtr item;
+            std::vector<Point> local;
+            while(wait([&]() { return take(item); },
+                        [&]() { return read_done.load(); }, worker_stats[ii])) {
+                Clock::time_point busy = Clock::now();
+                item->ok = true;
+                if(m_numa)
+                    local.assign(item->points.begin(), item->points.end());
+                const std::vector<Point>& points = m_numa ? local : item->points;
+                try {
+                    if(!points.empty()) {
+                        Voronoi voronoi(points);
+                        item->diagram = flatten(voronoi);
+                    }
+                } catch(...) {
+                    item->ok = false;
+                    worker_failed[ii]++;
+                }
+
+                // points aren't needed any more, free them on this thread
+                std::vector<Point>().swap(item->points);
+                worker_stats[ii].busy_seconds += since(busy);
+                worker_stats[ii].items++;
+                computed.tryPush(item);
+            }
+            workers_left--;
+        });
+    }
+
+    // write here, holding results that come early in their slot of the ring
+    std::vector<ItemPtr> pending(m_window);
+    ItemPtr item;
+    while(wait([&]() { return computed.tryPop(item); },
+                [&]() { return workers_left.load() == 0; }, stats.write)) {
+        size_t slot = item->index % m_window;
+        pending[slot] = std::move(item);
+
+        Clock::time_point busy = Clock::now();
+        size_t next = written.load();
+        while(pending[next % m_window] && pending[next % m_window]->index == next) {
+            ItemPtr ready = std::move(pending[next % m_window]);
+            write(ready->index, ready->diagram, ready->ok);
+            stats.write.items++;
+            written = ++next;
+        }
+        stats.write.busy_seconds += since(busy);
+    }
+
+    parser.join();
+    for(auto& worker : workers)
+        worker.join();
+
+    for(size_t ii = 0; ii < m_workers; ii++) {
+        stats.compute.items += worker_stats[ii].items;
+        stats.compute.busy_seconds += worker_stats[ii].busy_seconds;
+        stats.compute.stall_seconds += worker_stats[ii].stall_seconds;
+        stats.failed += worker_failed[ii];
+    }
+    stats.seconds = since(start);
+    return stats;
+}
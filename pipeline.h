@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "geometry.h"
+#include "diagram_io.h"
+
+/**
+ * Batch runs of many polygons with reading, computing and writing overlapped.
+ *
+ * A parser thread reads point sets, a pool of workers computes their
+ * diagrams and a writer thread hands them on in input order, with bounded
+ * lock free queues between the stages. At most window polygons are between
+ * being read and being written, so a slow writer holds the parser back
+ * instead of letting results pile up, and results that finish out of order
+ * wait in a ring of window slots.
+ *
+ * With numa set the workers are split across the NUMA nodes and pinned to
+ * them (see numa.h). Polygons are dealt out to the nodes in turn, each node's
+ * workers take their own first and only help the others when they run dry,
+ * and a worker copies its input before computing so that everything the
+ * engine touches is on its node.
+ */
+
+/**
+ * Bounded queue for any number of producers and consumers. Every slot
+ * carries a sequence number that says whether it's ready to be written or
+ * read on the current lap, so a push or pop is one compare and swap on the
+ * position plus one store to the slot.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    // capacity is rounded up to a power of two
+    BoundedQueue(size_t capacity) : m_push(0), m_pop(0)
+    {
+        size_t size = 2;
+        while(size < capacity)
+            size *= 2;
+        m_mask = size - 1;
+        m_slots.reset(new Slot[size]);
+        for(size_t ii = 0; ii < size; ii++)
+            m_slots[ii].sequence.store(ii, std::memory_order_relaxed);
+    }
+
+    // new only honours alignas from C++17, before that the positions
+    // could share a cache line or be misaligned on the heap
+    static void* operator new(size_t size)
+    {
+        void* ptr;
+        if(posix_memalign(&ptr, alignof(BoundedQueue), size) != 0)
+            throw std::bad_alloc();
+        return ptr;
+    }
+
+    static void operator delete(void* ptr)
+    {
+        free(ptr);
+    }
+
+    // Returns false if the queue is full
+    bool tryPush(T& value)
+    {
+        size_t position = m_push.load(std::memory_order_relaxed);
+        while(true) {
+            Slot& slot = m_slots[position & m_mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t lap = intptr_t(sequence) - intptr_t(position);
+            if(lap == 0) {
+                if(m_push.compare_exchange_weak(position, position + 1,
+                            std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(lap < 0) {
+                return false;
+            } else {
+                position = m_push.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty
+    bool tryPop(T& value)
+    {
+        size_t position = m_pop.load(std::memory_order_relaxed);
+        while(true) {
+            Slot& slot = m_slots[position & m_mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t lap = intptr_t(sequence) - intptr_t(position + 1);
+            if(lap == 0) {
+                if(m_pop.compare_exchange_weak(position, position + 1,
+                            std::memory_order_relaxed)) {
+                    value = std::move(slot.value);
+                    slot.sequence.store(position + m_mask + 1,
+                            std::memory_order_release);
+                    return true;
+                }
+            } else if(lap < 0) {
+                return false;
+            } else {
+                position = m_pop.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+
+    // on separate cache lines, producers and consumers don't share them
+    alignas(64) std::atomic<size_t> m_push;
+    alignas(64) std::atomic<size_t> m_pop;
+};
+
+// Throughput of one stage of a run
+struct StageStats
+{
+    uint64_t items = 0;
+
+    // time spent doing the stage's work, and waiting on the queues around it
+    // (summed over threads for the workers)
+    double busy_seconds = 0;
+    double stall_seconds = 0;
+};
+
+struct PipelineStats
+{
+    StageStats parse;
+    StageStats compute;
+    StageStats write;
+    uint64_t failed = 0;
+    double seconds = 0;
+};
+
+class BatchPipeline
+{
+public:
+    // Fill points with the next polygon, returns false at the end of input
+    typedef std::function<bool(std::vector<Point>&)> Reader;
+
+    // Called in input order, ok is false if the diagram couldn't be computed
+    typedef std::function<void(size_t index, const FlatDiagram& diagram,
+            bool ok)> Writer;
+
+    BatchPipeline(size_t workers, size_t window, bool numa = false);
+
+    // Run until read returns false and everything read has been written
+    PipelineStats run(const Reader& read, const Writer& write);
+
+private:
+    size_t m_workers;
+    size_t m_window;
+    bool m_numa;
+};
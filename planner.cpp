@@ -0,0 +1,228 @@
+#include "planner.h"
+
+#include <unordered_map>
+#include <array>
+#include <tuple>
+#include <limits>
+#include <algorithm>
+#include <queue>
+#include <cmath>
+
+#include "std_ext.h"
+
+namespace
+{
+
+const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+// Distance from pt to the segment from pt0 to pt1
+float segmentDistance(const Point& pt, const Point& pt0, const Point& pt1)
+{
+    Vector delta = pt1 - pt0;
+    float length2 = normSquared(delta);
+    float t = length2 > 0 ? dot(pt - pt0, delta) / length2 : 0;
+    t = std::min(1.f, std::max(0.f, t));
+    return norm(pt0 + delta*t - pt);
+}
+
+// Cost so far and the node it came from, per node reached by a search
+struct Label
+{
+    float cost;
+    uint32_t from;
+};
+
+}
+
+SkeletonPlanner::SkeletonPlanner(const Voronoi& voronoi,
+        const std::vector<Point>& points) :
+    m_points(points)
+{
+    std::vector<BoundingVolumeHierarchy::Item> items;
+    items.reserve(points.size());
+    for(size_t ii = 0; ii < points.size(); ii++)
+        items.push_back({points[ii], 0, ii});
+    m_point_tree = BoundingVolumeHierarchy(items);
+
+    // Only nodes with three parents are corners of the cells. The others are
+    // midpoints of pairs of points, which needn't be on the edge between
+    // them, and joining them to the corners or to each other can cut
+    // through other cells. Two corners with a pair of parents in common are
+    // the ends of an edge along the bisector of that pair.
+    std::vector<std::array<uint32_t, 3>> corners;
+    std::unordered_map<std::tuple<uint32_t, uint32_t>,
+        std::tuple<uint32_t, uint32_t>> open_edges;
+    m_cell_offsets.assign(points.size() + 1, 0);
+    for(const auto& node : voronoi.getNodes()) {
+        if(node->parents.size() != 3)
+            continue;
+        std::array<uint32_t, 3> parents;
+        std::copy(node->parents.begin(), node->parents.end(), parents.begin());
+        const Point& pt0 = points[parents[0]];
+        const Point& pt1 = points[parents[1]];
+        const Point& pt2 = points[parents[2]];
+        if((pt1.x - pt0.x)*(pt2.y - pt0.y) == (pt1.y - pt0.y)*(pt2.x - pt0.x))
+            continue;
+
+        uint32_t index = m_nodes.size();
+        m_nodes.push_back(Point(node->x, node->y));
+        corners.push_back(parents);
+        for(size_t kk = 0; kk < 3; kk++) {
+            m_cell_offsets[parents[kk] + 1]++;
+            auto key = std::make_tuple(parents[kk], parents[(kk + 1) % 3]);
+            if(std::get<0>(key) > std::get<1>(key))
+                std::swap(std::get<0>(key), std::get<1>(key));
+            auto result = open_edges.emplace(key,
+                    std::make_tuple(index, NONE));
+            if(!result.second && std::get<1>(result.first->second) == NONE)
+                std::get<1>(result.first->second) = index;
+        }
+    }
+
+    // counts, then running totals, then fill
+    for(size_t ii = 0; ii < points.size(); ii++)
+        m_cell_offsets[ii + 1] += m_cell_offsets[ii];
+    m_cell_nodes.resize(m_cell_offsets.back());
+    std::vector<uint32_t> fill(m_cell_offsets.begin(), m_cell_offsets.end() - 1);
+    for(uint32_t ii = 0; ii < corners.size(); ii++) {
+        for(uint32_t parent : corners[ii])
+            m_cell_nodes[fill[parent]++] = ii;
+    }
+
+    // Along an edge the distance to either parent is smallest where the
+    // edge passes closest to it. A pair with a single corner is on the hull
+    // and its edge is a ray, a dead end that no path needs.
+    struct Link
+    {
+        uint32_t node0, node1;
+        float clearance;
+    };
+    std::vector<Link> links;
+    m_offsets.assign(m_nodes.size() + 1, 0);
+    for(const auto& entry : open_edges) {
+        uint32_t node0 = std::get<0>(entry.second);
+        uint32_t node1 = std::get<1>(entry.second);
+        if(node1 == NONE)
+            continue;
+
+        const Point& parent = points[std::get<0>(entry.first)];
+        links.push_back({node0, node1,
+                segmentDistance(parent, m_nodes[node0], m_nodes[node1])});
+        m_offsets[node0 + 1]++;
+        m_offsets[node1 + 1]++;
+    }
+
+    for(size_t ii = 0; ii < m_nodes.size(); ii++)
+        m_offsets[ii + 1] += m_offsets[ii];
+    m_arcs.resize(m_offsets.back());
+    fill.assign(m_offsets.begin(), m_offsets.end() - 1);
+    for(const auto& link : links) {
+        float length = distance2d(m_nodes[link.node0], m_nodes[link.node1]);
+        m_arcs[fill[link.node0]++] = Arc{link.node1, length, link.clearance};
+        m_arcs[fill[link.node1]++] = Arc{link.node0, length, link.clearance};
+    }
+}
+
+size_t SkeletonPlanner::cell(const Point& pt) const
+{
+    float distance;
+    size_t ii = m_point_tree.nearest(pt, distance);
+    if(ii == BoundingVolumeHierarchy::NONE)
+        return ii;
+    return m_point_tree[ii].id;
+}
+
+std::vector<SkeletonPlanner::Arc> SkeletonPlanner::connectors(const Point& pt,
+        size_t site, float radius) const
+{
+    std::vector<Arc> out;
+    for(size_t ii = m_cell_offsets[site]; ii < m_cell_offsets[site + 1]; ii++) {
+        uint32_t node = m_cell_nodes[ii];
+        float clearance = segmentDistance(m_points[site], pt, m_nodes[node]);
+        if(clearance >= radius)
+            out.push_back(Arc{node, distance2d(pt, m_nodes[node]), clearance});
+    }
+    return out;
+}
+
+bool SkeletonPlanner::plan(const Point& start, const Point& goal, float radius,
+        std::vector<Point>& path) const
+{
+    path.clear();
+    size_t start_site = cell(start);
+    size_t goal_site = cell(goal);
+    if(start_site == BoundingVolumeHierarchy::NONE)
+        return false;
+    if(distance2d(start, m_points[start_site]) < radius ||
+            distance2d(goal, m_points[goal_site]) < radius)
+        return false;
+
+    // within one cell the straight line is both shortest and clear enough
+    // if it passes the cell's point at radius
+    if(start_site == goal_site &&
+            segmentDistance(m_points[start_site], start, goal) >= radius) {
+        path.push_back(start);
+        path.push_back(goal);
+        return true;
+    }
+
+    // the start and goal are extra nodes past the end of the graph, and the
+    // goal is reached through its connectors
+    const uint32_t START = m_nodes.size();
+    const uint32_t GOAL = m_nodes.size() + 1;
+    std::vector<Arc> start_arcs = connectors(start, start_site, radius);
+    std::unordered_map<uint32_t, float> goal_arcs;
+    for(const auto& arc : connectors(goal, goal_site, radius))
+        goal_arcs[arc.node] = arc.length;
+    if(start_arcs.empty() || goal_arcs.empty())
+        return false;
+
+    typedef std::pair<float, uint32_t> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+    std::unordered_map<uint32_t, Label> labels;
+    auto relax = [&](uint32_t from, uint32_t node, float cost) {
+        auto found = labels.find(node);
+        if(found != labels.end() && found->second.cost <= cost)
+            return;
+        labels[node] = Label{cost, from};
+        const Point& pt = node == GOAL ? goal : m_nodes[node];
+        open.push(Entry(cost + distance2d(pt, goal), node));
+    };
+
+    labels[START] = Label{0, START};
+    for(const auto& arc : start_arcs)
+        relax(START, arc.node, arc.length);
+
+    while(!open.empty()) {
+        Entry entry = open.top();
+        open.pop();
+        uint32_t node = entry.second;
+        if(node == GOAL)
+            break;
+
+        // skip entries left behind by a cheaper route found later
+        float cost = labels[node].cost;
+        if(entry.first > cost + distance2d(m_nodes[node], goal))
+            continue;
+
+        for(size_t ii = m_offsets[node]; ii < m_offsets[node + 1]; ii++) {
+            const Arc& arc = m_arcs[ii];
+            if(arc.clearance >= radius)
+                relax(node, arc.node, cost + arc.length);
+        }
+        auto found = goal_arcs.find(node);
+        if(found != goal_arcs.end())
+            relax(node, GOAL, cost + found->second);
+    }
+
+    auto found = labels.find(GOAL);
+    if(found == labels.end())
+        return false;
+
+    path.push_back(goal);
+    for(uint32_t node = found->second.from; node != START; node = labels[node].from)
+        path.push_back(m_nodes[node]);
+    path.push_back(start);
+    std::reverse(path.begin(), path.end());
+    return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "geometry.h"
+#include "voronoi.h"
+#include "bvh.h"
+
+/**
+ * Paths that keep a minimum clearance from the points, planned along the
+ * edges of a finished Voronoi diagram, e.g. a robot following the center
+ * lines of a polygon given by boundary samples.
+ *
+ * The edges are the paths that stay as far from the points as possible, so a
+ * route exists with some clearance exactly when one exists along them. The
+ * clearance of an edge is the smallest distance from it to its parents, and
+ * edges with less than the robot's radius are skipped. Start and goal are
+ * joined to the corners of their own cells by straight connectors, which
+ * stay within the cell and so only need to keep clear of its point. Between
+ * them the search is A* with the straight line distance to the goal, over
+ * adjacency that's packed into flat arrays up front.
+ */
+class SkeletonPlanner
+{
+public:
+    // voronoi must be the plain diagram of points
+    SkeletonPlanner(const Voronoi& voronoi, const std::vector<Point>& points);
+
+    /**
+     * Shortest path along the diagram from start to goal that stays at
+     * least radius from every point
+     *
+     * @param path Output, start, the nodes passed, then goal
+     * @return false if there is no such path
+     */
+    bool plan(const Point& start, const Point& goal, float radius,
+            std::vector<Point>& path) const;
+
+private:
+    struct Arc
+    {
+        uint32_t node;
+        float length;
+        float clearance;
+    };
+
+    // point whose cell holds pt
+    size_t cell(const Point& pt) const;
+
+    // connectors from pt to the nodes of the cell of site with enough
+    // clearance
+    std::vector<Arc> connectors(const Point& pt, size_t site,
+            float radius) const;
+
+    std::vector<Point> m_points;
+    BoundingVolumeHierarchy m_point_tree;
+
+    // nodes are the diagram's nodes with three parents, the corners of the
+    // cells, and arcs leaving node ii are m_arcs[m_offsets[ii]] up to
+    // m_offsets[ii + 1]
+    std::vector<Point> m_nodes;
+    std::vector<uint32_t> m_offsets;
+    std::vector<Arc> m_arcs;
+
+    // corners of the cell of point ii, the same way
+    std::vector<uint32_t> m_cell_offsets;
+    std::vector<uint32_t> m_cell_nodes;
+};
@@ -0,0 +1,191 @@
+#include "voronoi.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "parallel.h"
+#include "triangulation.h"
+
+/**
+ * Power diagrams: the dual of a power diagram is the regular triangulation of
+ * the weighted points, which is what Triangulation builds given the power
+ * test in place of the empty circle test.
+ */
+
+namespace
+{
+
+struct PowerPredicates
+{
+    const std::vector<Point>* points;
+    const std::vector<float>* weights;
+
+    double orient(size_t a, size_t b, size_t c) const
+    {
+        const Point& pa = (*points)[a];
+        const Point& pb = (*points)[b];
+        const Point& pc = (*points)[c];
+        return (double(pb.x) - pa.x)*(double(pc.y) - pa.y) -
+            (double(pb.y) - pa.y)*(double(pc.x) - pa.x);
+    }
+
+    double beyond(size_t a, size_t b, size_t p) const
+    {
+        return orient(a, b, p);
+    }
+
+    // p lifted to (x, y, x^2 + y^2 - w) lies below the plane through the
+    // lifted triangle
+    bool conflict(size_t a, size_t b, size_t c, size_t p) const
+    {
+        const Point& pp = (*points)[p];
+        double wp = (*weights)[p];
+        double rows[3][3];
+        size_t sites[3] = {a, b, c};
+        for(int ii = 0; ii < 3; ii++) {
+            const Point& pt = (*points)[sites[ii]];
+            double dx = double(pt.x) - pp.x;
+            double dy = double(pt.y) - pp.y;
+            rows[ii][0] = dx;
+            rows[ii][1] = dy;
+            rows[ii][2] = dx*dx + dy*dy - (*weights)[sites[ii]] + wp;
+        }
+
+        double det =
+            rows[0][0]*(rows[1][1]*rows[2][2] - rows[1][2]*rows[2][1]) -
+            rows[0][1]*(rows[1][0]*rows[2][2] - rows[1][2]*rows[2][0]) +
+            rows[0][2]*(rows[1][0]*rows[2][1] - rows[1][1]*rows[2][0]);
+        return det > 0;
+    }
+
+    bool coincident(size_t a, size_t b) const
+    {
+        return (*points)[a].x == (*points)[b].x && (*points)[a].y == (*points)[b].y;
+    }
+
+    // lifted, any three points that aren't in a line are a face of their hull
+    bool face(size_t a, size_t b, size_t c) const
+    {
+        return orient(a, b, c) > 0;
+    }
+
+    // The triangle under a point is in conflict with it unless it's hidden,
+    // so a point in conflict with nothing is hidden, by however many others
+    bool hidden(size_t, size_t) const
+    {
+        return true;
+    }
+
+    double distance(size_t site, size_t p) const
+    {
+        double dx = double((*points)[p].x) - (*points)[site].x;
+        double dy = double((*points)[p].y) - (*points)[site].y;
+        return dx*dx + dy*dy - (*weights)[site];
+    }
+
+    // bisectors are straight and the difference of two power distances is
+    // linear along them, so the extremes are always at the nodes
+    bool edgeConflict(size_t, size_t, size_t, size_t, size_t) const
+    {
+        return false;
+    }
+
+    bool edgeClear(size_t, size_t, size_t, size_t, size_t) const
+    {
+        return false;
+    }
+};
+
+typedef Triangulation<PowerPredicates> PowerTriangulation;
+
+// Point where the power distances to all three sites agree
+Voronoi::Node::Ptr powerCenter(const std::vector<Point>& points,
+        const std::vector<float>& weights, const size_t (&sites)[3])
+{
+    const Point& a = points[sites[0]];
+    double bx = double(points[sites[1]].x) - a.x;
+    double by = double(points[sites[1]].y) - a.y;
+    double cx = double(points[sites[2]].x) - a.x;
+    double cy = double(points[sites[2]].y) - a.y;
+    double rhs_b = bx*bx + by*by - weights[sites[1]] + weights[sites[0]];
+    double rhs_c = cx*cx + cy*cy - weights[sites[2]] + weights[sites[0]];
+    double det = 2*(bx*cy - by*cx);
+    double ux = (rhs_b*cy - rhs_c*by) / det;
+    double uy = (bx*rhs_c - cx*rhs_b) / det;
+
+    auto node = std::make_shared<Voronoi::Node>();
+    node->x = a.x + ux;
+    node->y = a.y + uy;
+    node->radius = std::sqrt(std::max(0.0, ux*ux + uy*uy - weights[sites[0]]));
+    node->parents.insert(sites, sites + 3);
+    return node;
+}
+
+// Point on the segment between two sites where their power distances agree
+Voronoi::Node::Ptr radicalPoint(const std::vector<Point>& points,
+        const std::vector<float>& weights, size_t a, size_t b)
+{
+    double dx = double(points[b].x) - points[a].x;
+    double dy = double(points[b].y) - points[a].y;
+    double length2 = dx*dx + dy*dy;
+    double t = 0.5 + (double(weights[a]) - weights[b]) / (2*length2);
+
+    auto node = std::make_shared<Voronoi::Node>();
+    node->x = points[a].x + t*dx;
+    node->y = points[a].y + t*dy;
+    node->radius = std::sqrt(std::max(0.0, t*t*length2 - weights[a]));
+    node->parents.insert(a);
+    node->parents.insert(b);
+    return node;
+}
+
+}
+
+Voronoi::Voronoi(const std::vector<Point>& points,
+        const std::vector<float>& weights) :
+    Voronoi(points, weights, Options())
+{
+}
+
+Voronoi::Voronoi(const std::vector<Point>& points,
+        const std::vector<float>& weights, const Options& options)
+{
+    if(points.size() != weights.size())
+        throw Error("a weight is needed for every point");
+
+    PerfCounters counters;
+    m_stats.counters = options.perf_counters && counters.open();
+    SerialScope serial(m_stats.counters);
+
+    // insert along a space filling curve so that each site is located near
+    // the previous one
+    counters.start();
+    std::vector<size_t> ordered = hilbertOrder(points);
+    counters.stop(m_stats.sort);
+
+    counters.start();
+    PowerPredicates predicates{&points, &weights};
+    PowerTriangulation triangulation(predicates);
+    bool triangulated = triangulation.build(ordered);
+    counters.stop(m_stats.sweep);
+
+    counters.start();
+    if(!triangulated) {
+        // all collinear, the cells are strips between consecutive points
+        for(size_t ii = 1; ii < ordered.size(); ii++) {
+            if(!predicates.coincident(ordered[ii - 1], ordered[ii]))
+                m_nodes.push_back(radicalPoint(points, weights, ordered[ii - 1], ordered[ii]));
+        }
+        counters.stop(m_stats.assembly);
+        return;
+    }
+
+    dualGraph(triangulation, points,
+            [&](const size_t (&sites)[3]) {
+                return powerCenter(points, weights, sites);
+            },
+            [&](size_t a, size_t b) {
+                return radicalPoint(points, weights, a, b);
+            }, m_nodes, m_edges);
+    counters.stop(m_stats.assembly);
+}
@@ -0,0 +1,464 @@
+#include "raster.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#include "dual.h"
+#include "parallel.h"
+#include "std_ext.h"
+
+namespace
+{
+
+// Side of the square tiles handed to each thread, in pixels
+const uint32_t TILE = 256;
+
+// Side of the blocks of pixels that share one search for nearby segments
+const uint32_t BLOCK = 16;
+
+// Most cells along a side of the grid of skeleton segments
+const int MAX_CELLS = 1024;
+
+const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+float distanceToSegment(const Point& pt, const Line& segment)
+{
+    Vector along = segment.pt1 - segment.pt0;
+    float length2 = normSquared(along);
+    float t = length2 > 0 ? dot(pt - segment.pt0, along) / length2 : 0;
+    t = std::min(1.0f, std::max(0.0f, t));
+    return distance2d(pt, segment.pt0 + along*t);
+}
+
+/**
+ * Segments binned into a grid of square cells over their bounding box, each
+ * in every cell its bounding box overlaps. The cells are about as many as
+ * the segments.
+ */
+class SegmentGrid
+{
+public:
+    explicit SegmentGrid(const std::vector<Line>& segments) :
+        m_segments(segments)
+    {
+        m_low = segments[0].pt0;
+        Point high = m_low;
+        for(const Line& segment : segments) {
+            for(const Point& pt : {segment.pt0, segment.pt1}) {
+                m_low.x = std::min(m_low.x, pt.x);
+                m_low.y = std::min(m_low.y, pt.y);
+                high.x = std::max(high.x, pt.x);
+                high.y = std::max(high.y, pt.y);
+            }
+        }
+
+        float width = high.x - m_low.x;
+        float height = high.y - m_low.y;
+        m_size = std::max({std::sqrt(width*height / segments.size()),
+                std::max(width, height) / MAX_CELLS,
+                std::numeric_limits<float>::min()});
+        m_columns = std::min<int>(MAX_CELLS, width / m_size) + 1;
+        m_rows = std::min<int>(MAX_CELLS, height / m_size) + 1;
+
+        m_offsets.assign(size_t(m_columns)*m_rows + 1, 0);
+        for(const Line& segment : segments) {
+            forEachCell(segment, [&](size_t cell) {
+                m_offsets[cell + 1]++;
+            });
+        }
+        for(size_t ii = 1; ii < m_offsets.size(); ii++)
+            m_offsets[ii] += m_offsets[ii - 1];
+
+        m_items.resize(m_offsets.back());
+        std::vector<size_t> next(m_offsets.begin(), m_offsets.end() - 1);
+        for(uint32_t index = 0; index < segments.size(); index++) {
+            forEachCell(segments[index], [&](size_t cell) {
+                m_items[next[cell]++] = index;
+            });
+        }
+    }
+
+    /**
+     * Every segment that may be the nearest one to some point of the box
+     * from low to high. Cells are searched in rings around the box until
+     * they are further away than the nearest any segment found is from all
+     * of the box, i.e. from its farthest corner.
+     */
+    std::vector<uint32_t> candidates(const Point& low, const Point& high) const
+    {
+        int col0 = column(low.x);
+        int col1 = column(high.x);
+        int row0 = row(low.y);
+        int row1 = row(high.y);
+
+        Point corners[4] = {low, Point(high.x, low.y), Point(low.x, high.y), high};
+        float bound = INFINITY;
+        std::vector<uint32_t> found;
+        auto visit = [&](int row, int col) {
+            if(row < 0 || row >= m_rows || col < 0 || col >= m_columns)
+                return;
+            size_t cell = size_t(row)*m_columns + col;
+            for(size_t ii = m_offsets[cell]; ii < m_offsets[cell + 1]; ii++) {
+                const Line& segment = m_segments[m_items[ii]];
+                float farthest = 0;
+                for(const Point& corner : corners)
+                    farthest = std::max(farthest, distanceToSegment(corner, segment));
+                bound = std::min(bound, farthest);
+                found.push_back(m_items[ii]);
+            }
+        };
+
+        for(int ring = 0; ; ring++) {
+            if(ring > 0 && ((ring - 1)*m_size > bound ||
+                        (col0 - ring < 0 && row0 - ring < 0 &&
+                         col1 + ring >= m_columns && row1 + ring >= m_rows)))
+                break;
+            for(int row = row0 - ring; row <= row1 + ring; row++) {
+                bool edge = ring == 0 || row == row0 - ring || row == row1 + ring;
+                for(int col = col0 - ring; col <= col1 + ring;
+                        col += edge ? 1 : col1 - col0 + 2*ring)
+                    visit(row, col);
+            }
+        }
+
+        // a segment whose bounding box is further from the box than the
+        // bound can't be nearest anywhere in it
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+        found.erase(std::remove_if(found.begin(), found.end(),
+                    [&](uint32_t index) {
+                        const Line& segment = m_segments[index];
+                        float dx = std::max({0.0f,
+                                std::min(segment.pt0.x, segment.pt1.x) - high.x,
+                                low.x - std::max(segment.pt0.x, segment.pt1.x)});
+                        float dy = std::max({0.0f,
+                                std::min(segment.pt0.y, segment.pt1.y) - high.y,
+                                low.y - std::max(segment.pt0.y, segment.pt1.y)});
+                        return dx*dx + dy*dy > bound*bound;
+                    }), found.end());
+        return found;
+    }
+
+private:
+    int column(float x) const
+    {
+        return std::min<float>(m_columns - 1,
+                std::max<float>(0, std::floor((x - m_low.x) / m_size)));
+    }
+
+    int row(float y) const
+    {
+        return std::min<float>(m_rows - 1,
+                std::max<float>(0, std::floor((y - m_low.y) / m_size)));
+    }
+
+    template<typename Func>
+    void forEachCell(const Line& segment, Func func) const
+    {
+        int col0 = column(std::min(segment.pt0.x, segment.pt1.x));
+        int col1 = column(std::max(segment.pt0.x, segment.pt1.x));
+        int row0 = row(std::min(segment.pt0.y, segment.pt1.y));
+        int row1 = row(std::max(segment.pt0.y, segment.pt1.y));
+        for(int row = row0; row <= row1; row++) {
+            for(int col = col0; col <= col1; col++)
+                func(size_t(row)*m_columns + col);
+        }
+    }
+
+    const std::vector<Line>& m_segments;
+    Point m_low;
+    float m_size;
+    int m_columns;
+    int m_rows;
+    std::vector<size_t> m_offsets;
+    std::vector<uint32_t> m_items;
+};
+
+void forEachSpan(const std::vector<Point>& points, const NeighborLists& lists,
+        const RasterFrame& frame,
+        const std::function<void(size_t, uint32_t, uint32_t, uint32_t)>& span)
+{
+    uint32_t columns = (frame.width + TILE - 1) / TILE;
+    uint32_t rows = (frame.height + TILE - 1) / TILE;
+    parallelFor(0, size_t(columns)*rows, [&](size_t tile) {
+        uint32_t col0 = (tile % columns)*TILE;
+        uint32_t col1 = std::min(frame.width, col0 + TILE);
+        uint32_t row0 = (tile / columns)*TILE;
+        uint32_t row1 = std::min(frame.height, row0 + TILE);
+
+        size_t start = 0;
+        for(uint32_t row = row0; row < row1; row++) {
+            float y = frame.origin_y + (row + 0.5f)*frame.resolution;
+            float x = frame.origin_x + (col0 + 0.5f)*frame.resolution;
+            start = locatePoint(points, lists, start, Point(x, y));
+
+            size_t site = start;
+            size_t previous = NO_NEIGHBOR;
+            uint32_t col = col0;
+            for(size_t steps = 0; col < col1 && steps <= points.size(); steps++) {
+                // the row leaves the cell where it first crosses to the
+                // far side of a bisector
+                const Point& center = points[site];
+                float exit = INFINITY;
+                size_t across = NO_NEIGHBOR;
+                for(size_t jj = lists.offsets[site]; jj < lists.offsets[site + 1]; jj++) {
+                    size_t neighbor = lists.neighbors[jj];
+                    Vector normal = points[neighbor] - center;
+                    if(normal.x <= 0)
+                        continue;
+
+                    Point middle = center + normal*0.5f;
+                    float crossing = middle.x - (y - middle.y)*normal.y / normal.x;
+                    if(neighbor == previous && crossing <= x)
+                        continue;
+                    if(crossing >= x && crossing < exit) {
+                        exit = crossing;
+                        across = neighbor;
+                    }
+                }
+
+                uint32_t end = col1;
+                if(across != NO_NEIGHBOR) {
+                    float position = (exit - frame.origin_x) / frame.resolution - 0.5f;
+                    end = uint32_t(std::min<float>(col1,
+                                std::max<float>(col, std::ceil(position))));
+                }
+                if(end > col)
+                    span(site, row, col, end);
+
+                col = end;
+                x = exit;
+                previous = site;
+                site = across;
+            }
+        }
+    });
+}
+
+}
+
+void forEachSpan(const Voronoi& voronoi, const std::vector<Point>& points,
+        const RasterFrame& frame,
+        const std::function<void(size_t, uint32_t, uint32_t, uint32_t)>& span)
+{
+    if(points.empty() || frame.width == 0 || frame.height == 0)
+        return;
+
+    forEachSpan(points, neighborLists(voronoi, points), frame, span);
+}
+
+void rasterizeLabels(const Voronoi& voronoi, const std::vector<Point>& points,
+        const RasterFrame& frame, uint32_t* labels)
+{
+    forEachSpan(voronoi, points, frame,
+            [&](size_t site, uint32_t row, uint32_t begin, uint32_t end) {
+                uint32_t* out = labels + size_t(row)*frame.width;
+                std::fill(out + begin, out + end, uint32_t(site));
+            });
+}
+
+std::vector<uint32_t> rasterizeLabels(const Voronoi& voronoi,
+        const std::vector<Point>& points, const RasterFrame& frame)
+{
+    std::vector<uint32_t> labels(size_t(frame.width)*frame.height);
+    rasterizeLabels(voronoi, points, frame, labels.data());
+    return labels;
+}
+
+void distanceField(const Voronoi& voronoi, const std::vector<Point>& points,
+        const RasterFrame& frame, float* out)
+{
+    forEachSpan(voronoi, points, frame,
+            [&](size_t site, uint32_t row, uint32_t begin, uint32_t end) {
+                // no branches, so the loop vectorizes
+                float dy = frame.origin_y + (row + 0.5f)*frame.resolution -
+                    points[site].y;
+                float x0 = frame.origin_x + 0.5f*frame.resolution - points[site].x;
+                float* line = out + size_t(row)*frame.width;
+                for(uint32_t col = begin; col < end; col++) {
+                    float dx = x0 + col*frame.resolution;
+                    line[col] = std::sqrt(dx*dx + dy*dy);
+                }
+            });
+}
+
+std::vector<float> distanceField(const Voronoi& voronoi,
+        const std::vector<Point>& points, const RasterFrame& frame)
+{
+    std::vector<float> out(size_t(frame.width)*frame.height);
+    distanceField(voronoi, points, frame, out.data());
+    return out;
+}
+
+void skeletonDistanceField(const Voronoi& voronoi,
+        const std::vector<Point>& points, const RasterFrame& frame, float* out)
+{
+    if(points.empty() || frame.width == 0 || frame.height == 0)
+        return;
+
+    size_t pixels = size_t(frame.width)*frame.height;
+    std::fill(out, out + pixels, INFINITY);
+    if(points.size() < 3)
+        return;
+
+    float area = 0;
+    for(size_t ii = 0; ii < points.size(); ii++) {
+        const Point& next = points[(ii + 1) % points.size()];
+        area += points[ii].x*next.y - next.x*points[ii].y;
+    }
+    float sign = area < 0 ? -1 : 1;
+
+    // The circle of a node inside touches its three samples in the order
+    // they come along the boundary, as in SkeletonHierarchy. Every sample
+    // keeps the circles of its inside nodes, and two inside nodes with a
+    // pair of parents in common are the ends of the edge between them.
+    std::vector<Circle> circles;
+    std::vector<std::tuple<uint32_t, uint32_t>> touching;
+    std::unordered_map<std::tuple<uint32_t, uint32_t>,
+        std::tuple<uint32_t, uint32_t>> open_edges;
+    for(const auto& node : voronoi.getNodes()) {
+        if(node->parents.size() != 3)
+            continue;
+        auto it = node->parents.begin();
+        uint32_t parents[3];
+        parents[0] = *it++;
+        parents[1] = *it++;
+        parents[2] = *it;
+        const Point& pt0 = points[parents[0]];
+        Vector side0 = points[parents[1]] - pt0;
+        Vector side1 = points[parents[2]] - pt0;
+        if(sign*(side0.x*side1.y - side0.y*side1.x) <= 0)
+            continue;
+
+        uint32_t index = circles.size();
+        Point center(node->x, node->y);
+        circles.push_back(Circle{center, distance2d(center, pt0)});
+        for(size_t kk = 0; kk < 3; kk++) {
+            touching.emplace_back(parents[kk], index);
+            auto key = std::make_tuple(parents[kk], parents[(kk + 1) % 3]);
+            if(std::get<0>(key) > std::get<1>(key))
+                std::swap(std::get<0>(key), std::get<1>(key));
+            auto result = open_edges.emplace(key, std::make_tuple(index, NONE));
+            if(!result.second && std::get<1>(result.first->second) == NONE)
+                std::get<1>(result.first->second) = index;
+        }
+    }
+    if(circles.empty())
+        return;
+
+    // An edge between neighboring samples is a spoke out to the boundary
+    // between them, not part of the skeleton. A node whose edges are all
+    // spokes, as in a triangle, is the skeleton on its own.
+    std::vector<Line> skeleton;
+    std::vector<bool> joined(circles.size(), false);
+    for(const auto& entry : open_edges) {
+        uint32_t a = std::get<0>(entry.first);
+        uint32_t b = std::get<1>(entry.first);
+        uint32_t node0 = std::get<0>(entry.second);
+        uint32_t node1 = std::get<1>(entry.second);
+        if(node1 == NONE || b - a == 1 || b - a == points.size() - 1)
+            continue;
+        skeleton.push_back(Line{circles[node0].center, circles[node1].center});
+        joined[node0] = joined[node1] = true;
+    }
+    for(size_t ii = 0; ii < circles.size(); ii++) {
+        if(!joined[ii])
+            skeleton.push_back(Line{circles[ii].center, circles[ii].center});
+    }
+
+    // The inside of the polygon is the union of the circles of the inside
+    // nodes. A pixel inside is in the circle of a node of its own cell: going
+    // on away from its sample it reaches an edge of the cell whose circle
+    // holds it, and that circle is within the circles of the edge's ends.
+    std::sort(touching.begin(), touching.end());
+    std::vector<size_t> offsets(points.size() + 1, 0);
+    for(const auto& entry : touching)
+        offsets[std::get<0>(entry) + 1]++;
+    for(size_t ii = 0; ii < points.size(); ii++)
+        offsets[ii + 1] += offsets[ii];
+
+    NeighborLists lists = neighborLists(voronoi, points);
+    forEachSpan(points, lists, frame,
+            [&](size_t site, uint32_t row, uint32_t begin, uint32_t end) {
+                float* line = out + size_t(row)*frame.width;
+                float y = frame.origin_y + (row + 0.5f)*frame.resolution;
+                float x0 = frame.origin_x + 0.5f*frame.resolution;
+                for(size_t jj = offsets[site]; jj < offsets[site + 1]; jj++) {
+                    const Circle& circle = circles[std::get<1>(touching[jj])];
+                    float dy = y - circle.center.y;
+                    float limit = circle.radius*circle.radius - dy*dy;
+                    for(uint32_t col = begin; col < end; col++) {
+                        float dx = x0 + col*frame.resolution - circle.center.x;
+                        line[col] = dx*dx < limit ? -1 : line[col];
+                    }
+                }
+            });
+
+    SegmentGrid grid(skeleton);
+    uint32_t columns = (frame.width + BLOCK - 1) / BLOCK;
+    uint32_t rows = (frame.height + BLOCK - 1) / BLOCK;
+    parallelFor(0, size_t(columns)*rows, [&](size_t block) {
+        uint32_t col0 = (block % columns)*BLOCK;
+        uint32_t col1 = std::min(frame.width, col0 + BLOCK);
+        uint32_t row0 = (block / columns)*BLOCK;
+        uint32_t row1 = std::min(frame.height, row0 + BLOCK);
+
+        bool inside = false;
+        for(uint32_t row = row0; row < row1 && !inside; row++) {
+            const float* line = out + size_t(row)*frame.width;
+            inside = std::any_of(line + col0, line + col1,
+                    [](float value) { return value < 0; });
+        }
+        if(!inside)
+            return;
+
+        Point low(frame.origin_x + (col0 + 0.5f)*frame.resolution,
+                frame.origin_y + (row0 + 0.5f)*frame.resolution);
+        Point high(frame.origin_x + (col1 - 0.5f)*frame.resolution,
+                frame.origin_y + (row1 - 0.5f)*frame.resolution);
+        std::vector<uint32_t> candidates = grid.candidates(low, high);
+
+        float nearest[BLOCK*BLOCK];
+        std::fill(nearest, nearest + BLOCK*BLOCK, INFINITY);
+        for(uint32_t index : candidates) {
+            const Line& segment = skeleton[index];
+            Vector along = segment.pt1 - segment.pt0;
+            float length2 = normSquared(along);
+            float scale = length2 > 0 ? 1 / length2 : 0;
+            for(uint32_t row = row0; row < row1; row++) {
+                // no branches, so the loop vectorizes
+                float* line = nearest + (row - row0)*BLOCK;
+                float dy = frame.origin_y + (row + 0.5f)*frame.resolution -
+                    segment.pt0.y;
+                float x0 = frame.origin_x + 0.5f*frame.resolution - segment.pt0.x;
+                for(uint32_t col = col0; col < col1; col++) {
+                    float dx = x0 + col*frame.resolution;
+                    float t = std::min(1.0f, std::max(0.0f,
+                                (dx*along.x + dy*along.y)*scale));
+                    float ex = dx - t*along.x;
+                    float ey = dy - t*along.y;
+                    line[col - col0] = std::min(line[col - col0], ex*ex + ey*ey);
+                }
+            }
+        }
+
+        for(uint32_t row = row0; row < row1; row++) {
+            float* line = out + size_t(row)*frame.width;
+            const float* found = nearest + (row - row0)*BLOCK;
+            for(uint32_t col = col0; col < col1; col++) {
+                if(line[col] < 0)
+                    line[col] = std::sqrt(found[col - col0]);
+            }
+        }
+    });
+}
+
+std::vector<float> skeletonDistanceField(const Voronoi& voronoi,
+        const std::vector<Point>& points, const RasterFrame& frame)
+{
+    std::vector<float> out(size_t(frame.width)*frame.height);
+    skeletonDistanceField(voronoi, points, frame, out.data());
+    return out;
+}
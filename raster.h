@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "geometry.h"
+#include "voronoi.h"
+
+/**
+ * Rasters read off a finished Voronoi diagram.
+ *
+ * Each row of pixels is walked left to right through the cells it crosses:
+ * inside a cell the row leaves across the nearest bisector ahead of it, so
+ * every pixel up to there belongs to the cell and is filled as one span.
+ * There is no search per pixel, only per cell crossed, and consecutive rows
+ * start from the cell found for the row before. The raster is split into
+ * tiles that are filled in parallel.
+ *
+ * Within a span the nearest point is known, so the distance field is just
+ * the distance to it. The skeleton is not local to a cell that way: the
+ * nearest skeleton edge to a pixel by a short side of a long rectangle is
+ * on the branch to a corner, not on the cell's own bisectors. Its edges are
+ * binned into a grid instead and each block of pixels searches the grid
+ * outwards until no edge further away can be nearer.
+ */
+
+// Pixel (col, row) is centered at origin + (col + 0.5, row + 0.5)*resolution
+struct RasterFrame
+{
+    float origin_x;
+    float origin_y;
+    float resolution;
+    uint32_t width;
+    uint32_t height;
+};
+
+/**
+ * Call span(site, row, begin, end) for every run of pixels [begin, end) of a
+ * row whose nearest point is points[site]. A pixel centered exactly on a
+ * bisector goes to the cell on its right. Tiles are filled by separate
+ * threads, so span is called concurrently, but never twice for one pixel.
+ */
+void forEachSpan(const Voronoi& voronoi, const std::vector<Point>& points,
+        const RasterFrame& frame,
+        const std::function<void(size_t, uint32_t, uint32_t, uint32_t)>& span);
+
+/**
+ * Index of the nearest point for every pixel, row major into labels which
+ * must hold width*height values
+ */
+void rasterizeLabels(const Voronoi& voronoi, const std::vector<Point>& points,
+        const RasterFrame& frame, uint32_t* labels);
+std::vector<uint32_t> rasterizeLabels(const Voronoi& voronoi,
+        const std::vector<Point>& points, const RasterFrame& frame);
+
+/**
+ * Distance from every pixel center to the nearest point, row major into out
+ * which must hold width*height values
+ */
+void distanceField(const Voronoi& voronoi, const std::vector<Point>& points,
+        const RasterFrame& frame, float* out);
+std::vector<float> distanceField(const Voronoi& voronoi,
+        const std::vector<Point>& points, const RasterFrame& frame);
+
+/**
+ * Distance from every pixel center inside a polygon to its skeleton, e.g.
+ * how far a position is from the center line. points are samples in order
+ * along the closed boundary, as for SkeletonHierarchy, and the skeleton is
+ * the edges between nodes inside it, leaving out the spokes between
+ * neighboring samples that run out to the boundary. A pixel is inside if it
+ * is in the empty circle of a node inside, and every other pixel is
+ * INFINITY.
+ */
+void skeletonDistanceField(const Voronoi& voronoi,
+        const std::vector<Point>& points, const RasterFrame& frame, float* out);
+std::vector<float> skeletonDistanceField(const Voronoi& voronoi,
+        const std::vector<Point>& points, const RasterFrame& frame);
@@ -0,0 +1,392 @@
+#include "server.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "voronoi.h"
+#include "parallel.h"
+
+namespace
+{
+
+// Most bytes read from a connection at once
+const size_t READ_CHUNK = 64 << 10;
+
+bool setNonBlocking(int fd)
+{
+    int flags = ::fcntl(fd, F_GETFL);
+    return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+void append(std::vector<char>& out, const void* data, size_t size)
+{
+    const char* bytes = static_cast<const char*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+bool makeAddress(const std::string& path, sockaddr_un& address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path))
+        return false;
+    std::strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+}
+
+SkeletonServer::Connection::~Connection()
+{
+    ::close(fd);
+}
+
+SkeletonServer::SkeletonServer(const std::string& path, size_t threads,
+        size_t max_batch) :
+    m_path(path), m_thread_count(std::max<size_t>(1, threads)),
+    m_max_batch(std::max<size_t>(1, max_batch)), m_listen_fd(-1),
+    m_running(false), m_queued_points(0)
+{
+    m_wake_fds[0] = m_wake_fds[1] = -1;
+}
+
+SkeletonServer::~SkeletonServer()
+{
+    if(m_listen_fd >= 0) {
+        ::close(m_listen_fd);
+        ::unlink(m_path.c_str());
+    }
+    if(m_wake_fds[0] >= 0) {
+        ::close(m_wake_fds[0]);
+        ::close(m_wake_fds[1]);
+    }
+}
+
+bool SkeletonServer::start()
+{
+    sockaddr_un address;
+    if(!makeAddress(m_path, address))
+        return false;
+
+    // A socket file from a previous run would make bind fail. If nothing
+    // answers on it, it's stale and can go, but one that's still served
+    // must be left alone, as must anything that isn't a socket.
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(probe < 0)
+        return false;
+    int connected = ::connect(probe, reinterpret_cast<sockaddr*>(&address),
+            sizeof(address));
+    int error = errno;
+    ::close(probe);
+    if(connected == 0)
+        return false;
+    if(error == ECONNREFUSED)
+        ::unlink(m_path.c_str());
+
+    if(::pipe(m_wake_fds) != 0 || !setNonBlocking(m_wake_fds[0]) ||
+            !setNonBlocking(m_wake_fds[1]))
+        return false;
+
+    m_listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(m_listen_fd < 0)
+        return false;
+
+    if(::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&address),
+                sizeof(address)) != 0 ||
+            ::listen(m_listen_fd, 64) != 0) {
+        ::close(m_listen_fd);
+        m_listen_fd = -1;
+        return false;
+    }
+
+    m_running = true;
+    return true;
+}
+
+void SkeletonServer::stop()
+{
+    m_running = false;
+    wake();
+}
+
+void SkeletonServer::wake()
+{
+    // the pipe doesn't block, if it's full the polling thread is due to
+    // wake up anyway
+    if(m_wake_fds[1] >= 0) {
+        char byte = 0;
+        ssize_t ignored = ::write(m_wake_fds[1], &byte, 1);
+        (void)ignored;
+    }
+}
+
+bool SkeletonServer::readRequests(const std::shared_ptr<Connection>& connection)
+{
+    std::vector<char>& input = connection->input;
+    size_t used = input.size();
+    input.resize(used + READ_CHUNK);
+    ssize_t count = ::read(connection->fd, input.data() + used, READ_CHUNK);
+    input.resize(used + std::max<ssize_t>(count, 0));
+    if(count < 0)
+        return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+    if(count == 0) {
+        // a request cut short can't be answered, the others still are
+        connection->reading = false;
+        return true;
+    }
+
+    size_t offset = 0;
+    while(input.size() - offset >= sizeof(RequestHeader)) {
+        RequestHeader header;
+        std::memcpy(&header, input.data() + offset, sizeof(header));
+        if(header.magic != REQUEST_MAGIC || header.count > MAX_REQUEST_POINTS)
+            return false;
+        size_t size = sizeof(header) + size_t(header.count)*sizeof(Point);
+        if(input.size() - offset < size)
+            break;
+
+        Request request;
+        request.connection = connection;
+        request.id = header.id;
+        request.points.resize(header.count);
+        std::memcpy(request.points.data(), input.data() + offset + sizeof(header),
+                request.points.size()*sizeof(Point));
+        offset += size;
+
+        {
+            std::lock_guard<std::mutex> lock(connection->output_mutex);
+            connection->in_flight++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            m_queued_points += header.count + 1;
+            m_queue.push_back(std::move(request));
+        }
+        m_queue_cond.notify_one();
+    }
+    input.erase(input.begin(), input.begin() + offset);
+    return true;
+}
+
+bool SkeletonServer::writeResponses(Connection& connection)
+{
+    std::lock_guard<std::mutex> lock(connection.output_mutex);
+    std::vector<char>& output = connection.output;
+    while(connection.sent < output.size()) {
+        ssize_t count = ::send(connection.fd, output.data() + connection.sent,
+                output.size() - connection.sent, MSG_NOSIGNAL);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if(count <= 0)
+            return false;
+        connection.sent += count;
+    }
+
+    // drop what went out once it's most of the buffer, so appending stays
+    // cheap without moving the rest on every send
+    if(connection.sent == output.size() || connection.sent > output.size() / 2) {
+        output.erase(output.begin(), output.begin() + connection.sent);
+        connection.sent = 0;
+    }
+    return true;
+}
+
+bool SkeletonServer::finished(Connection& connection)
+{
+    std::lock_guard<std::mutex> lock(connection.output_mutex);
+    return !connection.reading && connection.in_flight == 0 &&
+        connection.output.empty();
+}
+
+void SkeletonServer::work()
+{
+    // Kept across requests so that a warm worker doesn't allocate for its
+    // batches, responses or sweeps
+    std::vector<Request> batch;
+    std::vector<char> buffer;
+    batch.reserve(m_max_batch);
+    Voronoi::Workspace workspace;
+    Voronoi::Options options;
+    options.workspace = &workspace;
+
+    // the workers already take a core each
+    onWorkerThread() = true;
+
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            m_queue_cond.wait(lock, [this]() {
+                return !m_queue.empty() || !m_running;
+            });
+            if(m_queue.empty())
+                return;
+
+            size_t count = std::min(m_max_batch, m_queue.size());
+            for(size_t ii = 0; ii < count; ii++)
+                m_queued_points -= m_queue[ii].points.size() + 1;
+            std::move(m_queue.begin(), m_queue.begin() + count,
+                    std::back_inserter(batch));
+            m_queue.erase(m_queue.begin(), m_queue.begin() + count);
+        }
+
+        for(auto& request : batch) {
+            ResponseHeader header{request.id, STATUS_OK};
+            FlatDiagram diagram;
+            try {
+                if(!request.points.empty()) {
+                    Voronoi voronoi(request.points, options);
+                    diagram = flatten(voronoi);
+                }
+            } catch(...) {
+                header.status = STATUS_FAILED;
+            }
+
+            serialize(diagram, buffer);
+            uint64_t size = buffer.size();
+
+            // responses from different workers go out whole, one after
+            // the other
+            Connection& connection = *request.connection;
+            std::lock_guard<std::mutex> lock(connection.output_mutex);
+            append(connection.output, &header, sizeof(header));
+            if(header.status == STATUS_OK) {
+                append(connection.output, &size, sizeof(size));
+                append(connection.output, buffer.data(), buffer.size());
+            }
+            connection.in_flight--;
+        }
+        batch.clear();
+
+        // there's output to send, and maybe room in the queue again
+        wake();
+    }
+}
+
+void SkeletonServer::run()
+{
+    for(size_t ii = 0; ii < m_thread_count; ii++)
+        m_workers.emplace_back(&SkeletonServer::work, this);
+
+    std::vector<std::shared_ptr<Connection>> connections;
+    std::vector<pollfd> fds;
+    while(m_running) {
+        bool room;
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            room = m_queued_points < MAX_QUEUED_POINTS;
+        }
+
+        fds.clear();
+        fds.push_back(pollfd{m_wake_fds[0], POLLIN, 0});
+        fds.push_back(pollfd{m_listen_fd, POLLIN, 0});
+        for(const auto& connection : connections) {
+            size_t pending;
+            {
+                std::lock_guard<std::mutex> lock(connection->output_mutex);
+                pending = connection->output.size() - connection->sent;
+            }
+            short events = 0;
+            if(connection->reading && room && pending < MAX_PENDING_OUTPUT)
+                events |= POLLIN;
+            if(pending > 0)
+                events |= POLLOUT;
+            fds.push_back(pollfd{connection->fd, events, 0});
+        }
+
+        if(::poll(fds.data(), fds.size(), -1) < 0) {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+
+        if(fds[0].revents) {
+            char bytes[64];
+            while(::read(m_wake_fds[0], bytes, sizeof(bytes)) > 0) {}
+            if(!m_running)
+                break;
+        }
+
+        // go backwards so that erasing doesn't shift the ones still to check
+        for(size_t ii = fds.size() - 1; ii >= 2; ii--) {
+            const auto& connection = connections[ii - 2];
+            short revents = fds[ii].revents;
+            bool keep = !(revents & (POLLERR | POLLNVAL)) &&
+                (!(revents & POLLHUP) || (revents & POLLIN));
+            if(keep && (revents & POLLIN))
+                keep = readRequests(connection);
+            if(keep && (revents & POLLOUT))
+                keep = writeResponses(*connection);
+            if(!keep || finished(*connection))
+                connections.erase(connections.begin() + (ii - 2));
+        }
+
+        if(fds[1].revents & POLLIN) {
+            int fd = ::accept(m_listen_fd, nullptr, nullptr);
+            if(fd >= 0 && setNonBlocking(fd))
+                connections.push_back(std::make_shared<Connection>(fd));
+            else if(fd >= 0)
+                ::close(fd);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_running = false;
+    }
+    m_queue_cond.notify_all();
+    for(auto& worker : m_workers)
+        worker.join();
+    m_workers.clear();
+}
+
+int connectSkeleton(const std::string& path)
+{
+    sockaddr_un address;
+    if(!makeAddress(path, address))
+        return -1;
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+        return -1;
+
+    if(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool sendRequest(int fd, uint32_t id, const std::vector<Point>& points)
+{
+    RequestHeader header{REQUEST_MAGIC, id, uint32_t(points.size())};
+    return sendAll(fd, &header, sizeof(header)) &&
+        sendAll(fd, points.data(), points.size()*sizeof(Point));
+}
+
+bool readResponse(int fd, ResponseHeader& header, FlatDiagram& diagram)
+{
+    if(!readAll(fd, &header, sizeof(header)))
+        return false;
+    if(header.status != STATUS_OK)
+        return true;
+    return readDiagram(fd, diagram);
+}
+
+bool requestSkeleton(int fd, const std::vector<Point>& points, FlatDiagram& out)
+{
+    static std::atomic<uint32_t> next_id(0);
+    uint32_t id = next_id++;
+
+    ResponseHeader header;
+    return sendRequest(fd, id, points) && readResponse(fd, header, out) &&
+        header.id == id && header.status == STATUS_OK;
+}
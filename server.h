@@ -0,0 +1,154 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
+#include <cstdint>
+
+#include "geometry.h"
+#include "diagram_io.h"
+
+/**
+ * Long running skeleton server on a local Unix domain socket.
+ *
+ * Clients send requests framed as a RequestHeader followed by count points
+ * (x, y floats). Each request is answered with a ResponseHeader and, when the
+ * status is STATUS_OK, a length prefixed diagram in the binary format from
+ * diagram_io.h. A client may pipeline several requests on one connection,
+ * responses carry the request id since they can come back in any order.
+ *
+ * One thread polls every connection, and a pool of worker threads takes
+ * requests off a queue in batches so that a burst of small requests costs
+ * one wake up instead of one per request. The sockets don't block: the
+ * polling thread keeps the bytes of a request that hasn't fully arrived with
+ * its connection and only queues whole requests, and workers append their
+ * responses to the connection's output, which the polling thread sends as
+ * the socket takes it. So a slow client holds up neither the other clients
+ * nor a worker.
+ *
+ * The polling thread stops reading requests while MAX_QUEUED_POINTS are
+ * queued, and stops reading from a connection while more than
+ * MAX_PENDING_OUTPUT bytes of its responses are unsent, so a client must
+ * read its responses to have more of its requests read. Each worker keeps a
+ * Voronoi::Workspace and builds every diagram in it.
+ */
+
+const uint32_t REQUEST_MAGIC = 0x534b454c;
+const uint32_t MAX_REQUEST_POINTS = 1 << 20;
+const size_t MAX_QUEUED_POINTS = size_t(1) << 24;
+const size_t MAX_PENDING_OUTPUT = size_t(64) << 20;
+
+enum ResponseStatus : uint32_t
+{
+    STATUS_OK = 0,
+    STATUS_FAILED = 1,
+};
+
+struct RequestHeader
+{
+    uint32_t magic;
+    uint32_t id;
+    uint32_t count;
+};
+
+struct ResponseHeader
+{
+    uint32_t id;
+    uint32_t status;
+};
+
+class SkeletonServer
+{
+public:
+    SkeletonServer(const std::string& path, size_t threads, size_t max_batch);
+    ~SkeletonServer();
+
+    // Bind and listen, returns false if the socket could not be created or
+    // another server is listening on the path. A socket file left behind by
+    // a server that's gone is replaced.
+    bool start();
+
+    // Serve requests until stop() is called
+    void run();
+
+    // Safe to call from a signal handler
+    void stop();
+
+private:
+    struct Connection
+    {
+        Connection(int fd) : fd(fd), reading(true), in_flight(0), sent(0) {};
+        ~Connection();
+
+        int fd;
+
+        // bytes of a request that hasn't fully arrived, and false once the
+        // client has closed its side. Only the polling thread uses these.
+        std::vector<char> input;
+        bool reading;
+
+        // Guards the rest, which the workers update too. in_flight counts
+        // requests queued or being worked on, and output holds responses
+        // of which the first sent bytes have gone out.
+        std::mutex output_mutex;
+        size_t in_flight;
+        std::vector<char> output;
+        size_t sent;
+    };
+
+    struct Request
+    {
+        std::shared_ptr<Connection> connection;
+        uint32_t id;
+        std::vector<Point> points;
+    };
+
+    // Read what has arrived and queue the requests that are complete,
+    // returns false if the connection failed or sent something malformed
+    bool readRequests(const std::shared_ptr<Connection>& connection);
+
+    // Send as much of the pending output as the socket takes, returns false
+    // if the connection failed
+    bool writeResponses(Connection& connection);
+
+    // True once the client closed its side and has all of its responses
+    bool finished(Connection& connection);
+
+    // Get the polling thread to look at the queue and outputs again
+    void wake();
+
+    void work();
+
+    std::string m_path;
+    size_t m_thread_count;
+    size_t m_max_batch;
+
+    int m_listen_fd;
+    int m_wake_fds[2];
+    std::atomic<bool> m_running;
+
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cond;
+    std::deque<Request> m_queue;
+    // points of the queued requests, plus one per request
+    size_t m_queued_points;
+    std::vector<std::thread> m_workers;
+};
+
+// Client side
+
+// Connect to a server, returns the socket or -1
+int connectSkeleton(const std::string& path);
+
+bool sendRequest(int fd, uint32_t id, const std::vector<Point>& points);
+
+// Wait for the next response, diagram is filled in if the status is STATUS_OK
+bool readResponse(int fd, ResponseHeader& header, FlatDiagram& diagram);
+
+// Send one request and wait for its answer
+bool requestSkeleton(int fd, const std::vector<Point>& points, FlatDiagram& out);
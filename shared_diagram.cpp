@@ -0,0 +1,221 @@
+#include "shared_diagram.h"
+
+#include <cstring>
+#include <cassert>
+#include <new>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+        "epochs are shared between processes and must be lock free");
+
+namespace
+{
+
+const char MAGIC[8] = {'V', 'D', 'G', 'S', 'H', 'M', '0', '1'};
+const uint32_t VERSION = 1;
+const size_t ALIGNMENT = 64;
+
+size_t align(size_t size)
+{
+    return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+size_t slotOffset(uint64_t epoch, size_t slot_capacity)
+{
+    return align(sizeof(SharedDiagramHeader)) + (epoch % 2)*align(slot_capacity);
+}
+
+size_t segmentSize(size_t slot_capacity)
+{
+    return align(sizeof(SharedDiagramHeader)) + 2*align(slot_capacity);
+}
+
+}
+
+DiagramPublisher::DiagramPublisher(const std::string& name,
+        size_t slot_capacity) :
+    m_name(name), m_slot_capacity(slot_capacity),
+    m_size(segmentSize(slot_capacity)), m_data(nullptr)
+{
+}
+
+DiagramPublisher::~DiagramPublisher()
+{
+    if(m_data) {
+        ::munmap(m_data, m_size);
+        ::shm_unlink(m_name.c_str());
+    }
+}
+
+/**
+ * Attach to the segment a previous publisher left under the name if it has
+ * the same layout, carrying on from its epoch so that readers still mapping
+ * it see epochs keep going up. Anything else under the name is unlinked
+ * rather than truncated, readers of it keep their mapping of the old object
+ * instead of faulting on pages cut from under them, and a new segment is
+ * created in its place.
+ */
+bool DiagramPublisher::open()
+{
+    int fd = ::shm_open(m_name.c_str(), O_RDWR, 0);
+    if(fd >= 0) {
+        struct stat info;
+        void* data = MAP_FAILED;
+        if(::fstat(fd, &info) == 0 && size_t(info.st_size) == m_size)
+            data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if(data != MAP_FAILED) {
+            auto header = static_cast<const SharedDiagramHeader*>(data);
+            if(std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                    header->version == VERSION &&
+                    header->slot_capacity == m_slot_capacity) {
+                m_data = static_cast<char*>(data);
+                return true;
+            }
+            ::munmap(data, m_size);
+        }
+        ::shm_unlink(m_name.c_str());
+    }
+
+    fd = ::shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0)
+        return false;
+
+    if(::ftruncate(fd, m_size) != 0) {
+        ::close(fd);
+        ::shm_unlink(m_name.c_str());
+        return false;
+    }
+
+    void* data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        ::shm_unlink(m_name.c_str());
+        return false;
+    }
+
+    m_data = static_cast<char*>(data);
+    auto header = new(m_data) SharedDiagramHeader;
+    header->version = VERSION;
+    header->reserved = 0;
+    header->slot_capacity = m_slot_capacity;
+    header->slot_size[0] = header->slot_size[1] = 0;
+    header->writing.store(0, std::memory_order_relaxed);
+    header->published.store(0, std::memory_order_relaxed);
+
+    // the magic goes in last, a publisher or reader opening the segment
+    // before then takes it for something else
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+    return true;
+}
+
+bool DiagramPublisher::publish(const FlatDiagram& diagram)
+{
+    assert(m_data);
+    size_t size = serializedSize(diagram);
+    if(size > m_slot_capacity)
+        return false;
+
+    auto header = reinterpret_cast<SharedDiagramHeader*>(m_data);
+    uint64_t next = header->published.load(std::memory_order_relaxed) + 1;
+
+    // announce the write before touching the slot, readers still holding the
+    // diagram from two epochs ago use this to notice
+    header->writing.store(next, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    serialize(diagram, m_data + slotOffset(next, m_slot_capacity));
+    header->slot_size[next % 2] = size;
+    header->published.store(next, std::memory_order_release);
+    return true;
+}
+
+uint64_t DiagramPublisher::epoch() const
+{
+    assert(m_data);
+    auto header = reinterpret_cast<const SharedDiagramHeader*>(m_data);
+    return header->published.load(std::memory_order_relaxed);
+}
+
+DiagramSubscriber::DiagramSubscriber(const std::string& name) :
+    m_name(name), m_size(0), m_data(nullptr)
+{
+}
+
+DiagramSubscriber::~DiagramSubscriber()
+{
+    if(m_data)
+        ::munmap(const_cast<char*>(m_data), m_size);
+}
+
+bool DiagramSubscriber::open()
+{
+    int fd = ::shm_open(m_name.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+        return false;
+
+    struct stat info;
+    if(::fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(SharedDiagramHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    m_size = info.st_size;
+    void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED)
+        return false;
+
+    m_data = static_cast<const char*>(data);
+    auto header = reinterpret_cast<const SharedDiagramHeader*>(m_data);
+    if(std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header->version != VERSION ||
+            segmentSize(header->slot_capacity) > m_size) {
+        ::munmap(const_cast<char*>(m_data), m_size);
+        m_data = nullptr;
+        return false;
+    }
+    return true;
+}
+
+uint64_t DiagramSubscriber::epoch() const
+{
+    assert(m_data);
+    auto header = reinterpret_cast<const SharedDiagramHeader*>(m_data);
+    return header->published.load(std::memory_order_acquire);
+}
+
+bool DiagramSubscriber::acquire(DiagramView& out, uint64_t& epoch) const
+{
+    assert(m_data);
+    auto header = reinterpret_cast<const SharedDiagramHeader*>(m_data);
+    while(true) {
+        epoch = header->published.load(std::memory_order_acquire);
+        if(epoch == 0)
+            return false;
+
+        const char* slot = m_data + slotOffset(epoch, header->slot_capacity);
+        size_t size = header->slot_size[epoch % 2];
+        bool success = view(slot, size, out);
+
+        // the slot was being rewritten while we looked at it, try again with
+        // the newer epoch
+        if(!valid(epoch))
+            continue;
+        return success;
+    }
+}
+
+bool DiagramSubscriber::valid(uint64_t epoch) const
+{
+    assert(m_data);
+    auto header = reinterpret_cast<const SharedDiagramHeader*>(m_data);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header->writing.load(std::memory_order_relaxed) <= epoch + 1;
+}
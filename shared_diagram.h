@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+#include "diagram_io.h"
+
+/**
+ * Publish diagrams through a named shared memory segment so that any number of
+ * local processes can read them in place.
+ *
+ * The segment holds a small header and two slots, each holding a diagram in
+ * the binary format from diagram_io.h. The publisher always writes into the
+ * slot that readers are not being pointed at, then bumps the published epoch,
+ * which flips readers over to the new slot in one atomic store. A reader only
+ * loads the epoch and gets pointers straight into the slot: there are no
+ * locks or copies on the read side.
+ *
+ * Since there are only two slots, a reader that holds on to an old diagram
+ * while two more are published would see its slot being rewritten. The header
+ * also records which epoch is currently being written so that readers can
+ * check, seqlock style, that what they read is still intact.
+ */
+
+struct SharedDiagramHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t slot_capacity;
+
+    // last complete diagram, lives in slot published % 2
+    std::atomic<uint64_t> published;
+
+    // diagram currently being written, equal to published when idle
+    std::atomic<uint64_t> writing;
+
+    uint64_t slot_size[2];
+};
+
+class DiagramPublisher
+{
+public:
+    // slot_capacity is the largest serialized diagram that can be published
+    DiagramPublisher(const std::string& name, size_t slot_capacity);
+
+    // Unmaps and removes the segment, attached readers keep their mapping
+    ~DiagramPublisher();
+
+    // Create the segment, or carry on with one of the same layout left
+    // under the name, e.g. by a publisher that was restarted
+    bool open();
+
+    // Returns false if the diagram doesn't fit in a slot
+    bool publish(const FlatDiagram& diagram);
+
+    uint64_t epoch() const;
+
+private:
+    std::string m_name;
+    size_t m_slot_capacity;
+    size_t m_size;
+    char* m_data;
+};
+
+class DiagramSubscriber
+{
+public:
+    DiagramSubscriber(const std::string& name);
+    ~DiagramSubscriber();
+
+    bool open();
+
+    // Latest epoch, 0 if nothing has been published yet
+    uint64_t epoch() const;
+
+    /**
+     * Point view at the latest published diagram
+     *
+     * @param epoch Output, the epoch of the diagram, pass to valid() once
+     * done reading
+     * @return false if nothing has been published yet
+     */
+    bool acquire(DiagramView& view, uint64_t& epoch) const;
+
+    // True if everything read from the diagram of this epoch so far is intact
+    bool valid(uint64_t epoch) const;
+
+private:
+    std::string m_name;
+    size_t m_size;
+    const char* m_data;
+};
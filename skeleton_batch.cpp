@@ -0,0 +1,59 @@
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <thread>
+
+#include "pipeline.h"
+
+// Usage: skeleton_batch [threads] [window] [numa] < points > diagrams
+//
+// Reads polygons from stdin, one per line as "x0 y0 x1 y1 ...", and writes
+// their diagrams to stdout in input order, each length prefixed as by
+// writeDiagram (an empty diagram for any that failed). Throughput of each
+// stage goes to stderr. A nonzero numa pins the workers to NUMA nodes.
+
+namespace
+{
+
+void report(const char* name, const StageStats& stage, double seconds)
+{
+    std::cerr << name << ": " << stage.items << " items, " <<
+        stage.busy_seconds << "s busy, " << stage.stall_seconds << "s stalled, " <<
+        (seconds > 0 ? stage.items / seconds : 0) << " items/s" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t threads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    size_t window = argc > 2 ? std::atoi(argv[2]) : 4*threads;
+    bool numa = argc > 3 && std::atoi(argv[3]) != 0;
+
+    BatchPipeline pipeline(threads, window, numa);
+    bool failed_write = false;
+    PipelineStats stats = pipeline.run(
+            [](std::vector<Point>& points) {
+                std::string line;
+                while(std::getline(std::cin, line)) {
+                    std::istringstream iss(line);
+                    float x, y;
+                    while(iss >> x >> y)
+                        points.push_back(Point(x, y));
+                    if(!points.empty())
+                        return true;
+                }
+                return false;
+            },
+            [&](size_t, const FlatDiagram& diagram, bool) {
+                if(!failed_write && !writeDiagram(1, diagram))
+                    failed_write = true;
+            });
+
+    report("parse", stats.parse, stats.seconds);
+    report("compute", stats.compute, stats.seconds);
+    report("write", stats.write, stats.seconds);
+    std::cerr << stats.failed << " failed, " << stats.seconds << "s total" << std::endl;
+    return failed_write ? 1 : 0;
+}
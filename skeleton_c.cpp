@@ -0,0 +1,180 @@
+#include "skeleton_c.h"
+
+#include <vector>
+#include <new>
+#include <algorithm>
+
+#include "voronoi.h"
+#include "diagram_io.h"
+
+struct sk_engine
+{
+    // reused between calls so that repeated computations don't reallocate
+    std::vector<Point> points;
+
+    // current result as structure of arrays
+    std::vector<float> node_x;
+    std::vector<float> node_y;
+    std::vector<float> node_radius;
+    std::vector<uint32_t> node_parents;
+    std::vector<uint32_t> edge_nodes;
+    std::vector<uint32_t> edge_parents;
+};
+
+namespace
+{
+
+void clearResult(sk_engine* engine)
+{
+    engine->node_x.clear();
+    engine->node_y.clear();
+    engine->node_radius.clear();
+    engine->node_parents.clear();
+    engine->edge_nodes.clear();
+    engine->edge_parents.clear();
+}
+
+void storeResult(sk_engine* engine, const FlatDiagram& diagram)
+{
+    size_t node_count = diagram.nodes.size();
+    engine->node_x.resize(node_count);
+    engine->node_y.resize(node_count);
+    engine->node_radius.resize(node_count);
+    engine->node_parents.resize(3*node_count);
+    for(size_t ii = 0; ii < node_count; ii++) {
+        const auto& node = diagram.nodes[ii];
+        engine->node_x[ii] = node.x;
+        engine->node_y[ii] = node.y;
+        engine->node_radius[ii] = node.radius;
+        std::copy(node.parents, node.parents + 3, &engine->node_parents[3*ii]);
+    }
+
+    size_t edge_count = diagram.edges.size();
+    engine->edge_nodes.resize(2*edge_count);
+    engine->edge_parents.resize(2*edge_count);
+    for(size_t ii = 0; ii < edge_count; ii++) {
+        const auto& edge = diagram.edges[ii];
+        std::copy(edge.nodes, edge.nodes + 2, &engine->edge_nodes[2*ii]);
+        std::copy(edge.parents, edge.parents + 2, &engine->edge_parents[2*ii]);
+    }
+}
+
+template <typename T>
+void copyOut(const std::vector<T>& from, T* to)
+{
+    if(to)
+        std::copy(from.begin(), from.end(), to);
+}
+
+}
+
+static_assert(SK_NO_PARENT == NO_PARENT, "parent markers must agree");
+
+extern "C" {
+
+uint32_t sk_abi_version(void)
+{
+    return SK_ABI_VERSION;
+}
+
+sk_engine* sk_engine_create(void)
+{
+    return new(std::nothrow) sk_engine;
+}
+
+void sk_engine_destroy(sk_engine* engine)
+{
+    delete engine;
+}
+
+sk_status sk_compute(sk_engine* engine, const float* x, const float* y,
+        size_t count)
+{
+    if(!engine || (count > 0 && (!x || !y)))
+        return SK_ERR_INVALID_ARGUMENT;
+
+    clearResult(engine);
+    try {
+        engine->points.resize(count);
+        for(size_t ii = 0; ii < count; ii++)
+            engine->points[ii] = Point(x[ii], y[ii]);
+
+        if(count > 0) {
+            Voronoi voronoi(engine->points);
+            storeResult(engine, flatten(voronoi));
+        }
+    } catch(const std::bad_alloc&) {
+        clearResult(engine);
+        return SK_ERR_OUT_OF_MEMORY;
+    } catch(...) {
+        clearResult(engine);
+        return SK_ERR_COMPUTE_FAILED;
+    }
+    return SK_OK;
+}
+
+sk_status sk_result_size(const sk_engine* engine, size_t* node_count,
+        size_t* edge_count)
+{
+    if(!engine)
+        return SK_ERR_INVALID_ARGUMENT;
+    if(node_count)
+        *node_count = engine->node_x.size();
+    if(edge_count)
+        *edge_count = engine->edge_nodes.size() / 2;
+    return SK_OK;
+}
+
+sk_status sk_copy_nodes(const sk_engine* engine, float* x, float* y,
+        float* radius, uint32_t* parents, size_t capacity)
+{
+    if(!engine)
+        return SK_ERR_INVALID_ARGUMENT;
+    if(capacity < engine->node_x.size())
+        return SK_ERR_BUFFER_TOO_SMALL;
+
+    copyOut(engine->node_x, x);
+    copyOut(engine->node_y, y);
+    copyOut(engine->node_radius, radius);
+    copyOut(engine->node_parents, parents);
+    return SK_OK;
+}
+
+sk_status sk_copy_edges(const sk_engine* engine, uint32_t* nodes,
+        uint32_t* parents, size_t capacity)
+{
+    if(!engine)
+        return SK_ERR_INVALID_ARGUMENT;
+    if(capacity < engine->edge_nodes.size() / 2)
+        return SK_ERR_BUFFER_TOO_SMALL;
+
+    copyOut(engine->edge_nodes, nodes);
+    copyOut(engine->edge_parents, parents);
+    return SK_OK;
+}
+
+sk_status sk_borrow_nodes(const sk_engine* engine, sk_nodes_view* out)
+{
+    if(!engine || !out)
+        return SK_ERR_INVALID_ARGUMENT;
+
+    out->x = engine->node_x.data();
+    out->y = engine->node_y.data();
+    out->radius = engine->node_radius.data();
+    out->parents = engine->node_parents.data();
+    out->count = engine->node_x.size();
+    return SK_OK;
+}
+
+sk_status sk_borrow_edges(const sk_engine* engine, sk_edges_view* out)
+{
+    if(!engine || !out)
+        return SK_ERR_INVALID_ARGUMENT;
+
+    out->nodes = engine->edge_nodes.data();
+    out->parents = engine->edge_parents.data();
+    out->count = engine->edge_nodes.size() / 2;
+    return SK_OK;
+}
+
+}
@@ -0,0 +1,111 @@
+#ifndef SKELETON_C_H
+#define SKELETON_C_H
+
+/*
+ * C interface to the Voronoi engine for use from other languages.
+ *
+ * Points go in as separate x and y arrays. Results come back as flat arrays,
+ * either copied into buffers the caller allocated (sk_copy_*) or borrowed
+ * straight from the engine handle (sk_borrow_*), so a binding can hand them to
+ * its own array types without converting element by element.
+ *
+ * Typical use:
+ *
+ *   sk_engine* engine = sk_engine_create();
+ *   sk_compute(engine, xs, ys, count);
+ *   sk_result_size(engine, &node_count, &edge_count);
+ *   ... allocate node_count / edge_count sized buffers ...
+ *   sk_copy_nodes(engine, x, y, radius, parents, node_count);
+ *   sk_copy_edges(engine, nodes, parents, edge_count);
+ *   sk_engine_destroy(engine);
+ *
+ * Only opaque handles, fixed width integers and plain structs cross this
+ * interface. Nothing here throws, errors are returned as sk_status.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SK_ABI_VERSION 1
+
+/* marks unused entries in parent arrays */
+#define SK_NO_PARENT 0xffffffffu
+
+typedef struct sk_engine sk_engine;
+
+typedef enum sk_status
+{
+    SK_OK = 0,
+    SK_ERR_INVALID_ARGUMENT = 1,
+    SK_ERR_BUFFER_TOO_SMALL = 2,
+    SK_ERR_COMPUTE_FAILED = 3,
+    SK_ERR_OUT_OF_MEMORY = 4
+} sk_status;
+
+/*
+ * Engine owned node arrays, valid until the next sk_compute on the same engine
+ * or sk_engine_destroy. parents holds 3 entries per node.
+ */
+typedef struct sk_nodes_view
+{
+    const float* x;
+    const float* y;
+    const float* radius;
+    const uint32_t* parents;
+    size_t count;
+} sk_nodes_view;
+
+/*
+ * Engine owned edge arrays, same lifetime as sk_nodes_view. nodes and parents
+ * hold 2 entries per edge, nodes index into the node arrays.
+ */
+typedef struct sk_edges_view
+{
+    const uint32_t* nodes;
+    const uint32_t* parents;
+    size_t count;
+} sk_edges_view;
+
+/* SK_ABI_VERSION of the library that was loaded */
+uint32_t sk_abi_version(void);
+
+/* returns NULL if out of memory */
+sk_engine* sk_engine_create(void);
+void sk_engine_destroy(sk_engine* engine);
+
+/*
+ * Compute the diagram of count points, replacing the previous result of the
+ * engine. x and y may be NULL when count is 0.
+ */
+sk_status sk_compute(sk_engine* engine, const float* x, const float* y,
+        size_t count);
+
+/* Size of the current result, either output may be NULL */
+sk_status sk_result_size(const sk_engine* engine, size_t* node_count,
+        size_t* edge_count);
+
+/*
+ * Copy the nodes of the current result into caller buffers. Any of the
+ * buffers may be NULL to skip that field, the rest must hold node_count
+ * entries (3*node_count for parents). Returns SK_ERR_BUFFER_TOO_SMALL without
+ * copying anything if capacity < node_count.
+ */
+sk_status sk_copy_nodes(const sk_engine* engine, float* x, float* y,
+        float* radius, uint32_t* parents, size_t capacity);
+
+/* Same as sk_copy_nodes for edges, nodes and parents hold 2*edge_count */
+sk_status sk_copy_edges(const sk_engine* engine, uint32_t* nodes,
+        uint32_t* parents, size_t capacity);
+
+sk_status sk_borrow_nodes(const sk_engine* engine, sk_nodes_view* out);
+sk_status sk_borrow_edges(const sk_engine* engine, sk_edges_view* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
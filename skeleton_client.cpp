@@ -0,0 +1,64 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "server.h"
+
+// Usage: skeleton_client [socket path] < points
+//
+// Reads polygons from stdin, one per line as "x0 y0 x1 y1 ...", sends them all
+// to the server in one go and prints the size of each returned diagram.
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : "/tmp/skeleton.sock";
+    int fd = connectSkeleton(path);
+    if(fd < 0) {
+        std::cerr << "Failed to connect to " << path << std::endl;
+        return 1;
+    }
+
+    std::vector<std::vector<Point>> polygons;
+    std::string line;
+    while(std::getline(std::cin, line)) {
+        std::istringstream iss(line);
+        std::vector<Point> points;
+        float x, y;
+        while(iss >> x >> y)
+            points.push_back(Point(x, y));
+        if(!points.empty())
+            polygons.push_back(points);
+    }
+
+    // pipeline all of the requests so the server can batch them
+    for(uint32_t ii = 0; ii < polygons.size(); ii++) {
+        if(!sendRequest(fd, ii, polygons[ii])) {
+            std::cerr << "Failed to send request " << ii << std::endl;
+            return 1;
+        }
+    }
+
+    int result = 0;
+    for(size_t ii = 0; ii < polygons.size(); ii++) {
+        ResponseHeader header;
+        FlatDiagram diagram;
+        if(!readResponse(fd, header, diagram)) {
+            std::cerr << "Connection closed" << std::endl;
+            return 1;
+        }
+
+        if(header.status != STATUS_OK) {
+            std::cout << header.id << ": failed" << std::endl;
+            result = 1;
+        } else {
+            std::cout << header.id << ": " << diagram.nodes.size() << " nodes, "
+                << diagram.edges.size() << " edges" << std::endl;
+        }
+    }
+
+    ::close(fd);
+    return result;
+}
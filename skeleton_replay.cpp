@@ -0,0 +1,107 @@
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "voronoi.h"
+#include "event_log.h"
+
+// Usage: skeleton_replay record <log> < points
+//        skeleton_replay replay <log> [repeats]
+//
+// record computes the diagram of the points on stdin, "x0 y0 x1 y1 ...", and
+// writes the events the sweep handled to log. replay rebuilds the diagram from
+// the log repeats times, in the recorded order every time, so runs before and
+// after a change to the beach line or graph code do the same work. Both print
+// the time of each phase and the size of the diagram to stdout.
+
+namespace
+{
+
+void report(const Voronoi& voronoi)
+{
+    const Voronoi::Stats& stats = voronoi.getStats();
+    std::cout << "sort " << stats.sort.seconds << "s, sweep " <<
+        stats.sweep.seconds << "s, assembly " << stats.assembly.seconds <<
+        "s, " << voronoi.getNodes().size() << " nodes, " <<
+        voronoi.getEdges().size() << " edges" << std::endl;
+}
+
+void summarize(const EventLog& log)
+{
+    size_t sites = 0;
+    uint32_t queue = 0, beach = 0;
+    for(const auto& event : log.events) {
+        if(event.type == EVENT_SITE)
+            sites++;
+        queue = std::max(queue, event.queue_size);
+        beach = std::max(beach, event.beach_size);
+    }
+    std::cout << log.points.size() << " points, " << sites << " site events, " <<
+        log.events.size() - sites << " circle events, queue at most " << queue <<
+        ", beach line at most " << beach << std::endl;
+}
+
+int record(const char* path)
+{
+    std::vector<Point> points;
+    float x, y;
+    while(std::cin >> x >> y)
+        points.push_back(Point(x, y));
+    if(points.empty()) {
+        std::cerr << "no points" << std::endl;
+        return 1;
+    }
+
+    EventLog log;
+    Voronoi::Options options;
+    options.event_log = &log;
+    Voronoi voronoi(points, options);
+    report(voronoi);
+    summarize(log);
+
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0 || !writeEventLog(fd, log)) {
+        std::cerr << "couldn't write " << path << std::endl;
+        return 1;
+    }
+    ::close(fd);
+    return 0;
+}
+
+int replay(const char* path, size_t repeats)
+{
+    EventLog log;
+    int fd = ::open(path, O_RDONLY);
+    if(fd < 0 || !readEventLog(fd, log)) {
+        std::cerr << "couldn't read " << path << std::endl;
+        return 1;
+    }
+    ::close(fd);
+    summarize(log);
+
+    for(size_t ii = 0; ii < repeats; ii++) {
+        Voronoi voronoi(log);
+        report(voronoi);
+    }
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if(argc > 2 && std::strcmp(argv[1], "record") == 0)
+        return record(argv[2]);
+    if(argc > 2 && std::strcmp(argv[1], "replay") == 0)
+        return replay(argv[2], argc > 3 ? std::atoi(argv[3]) : 1);
+
+    std::cerr << "usage: skeleton_replay record <log> < points" << std::endl;
+    std::cerr << "       skeleton_replay replay <log> [repeats]" << std::endl;
+    return 1;
+}
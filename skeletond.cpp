@@ -0,0 +1,42 @@
+#include <iostream>
+#include <csignal>
+#include <cstdlib>
+#include <thread>
+
+#include "server.h"
+
+// Usage: skeletond [socket path] [threads] [max batch]
+
+namespace
+{
+
+SkeletonServer* g_server = nullptr;
+
+void handleSignal(int)
+{
+    if(g_server)
+        g_server->stop();
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : "/tmp/skeleton.sock";
+    size_t threads = argc > 2 ? std::atoi(argv[2]) : std::thread::hardware_concurrency();
+    size_t max_batch = argc > 3 ? std::atoi(argv[3]) : 16;
+
+    SkeletonServer server(path, threads, max_batch);
+    if(!server.start()) {
+        std::cerr << "Failed to listen on " << path << std::endl;
+        return 1;
+    }
+
+    g_server = &server;
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
+
+    server.run();
+    g_server = nullptr;
+    return 0;
+}
@@ -1,8 +1,1096 @@
 #include <vector>
 #include <tuple>
+#include <set>
+#include <map>
+#include <functional>
+#include <queue>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <unistd.h>
 #include "geometry.h"
 #include "simple_svg.hpp"
 #include "voronoi.h"
+#include "clearance.h"
+#include "diagram_io.h"
+#include "archive.h"
+#include "cells.h"
+#include "shared_diagram.h"
+#include "event_log.h"
+#include "raster.h"
+#include "fixed_point.h"
+#include "offset.h"
+#include "interpolate.h"
+#include "planner.h"
+#include "hierarchy.h"
+
+namespace
+{
+
+size_t failures = 0;
+
+void fail(const std::string& name, const std::string& what)
+{
+    std::cerr << "FAILED " << name << ": " << what << std::endl;
+    failures++;
+}
+
+// Twice the signed area of abc, positive when it turns counterclockwise
+double cross(const Point& a, const Point& b, const Point& c)
+{
+    return (double(b.x) - a.x)*(double(c.y) - a.y) -
+        (double(b.y) - a.y)*(double(c.x) - a.x);
+}
+
+double hullArea(std::vector<Point> points)
+{
+    std::sort(points.begin(), points.end(), [](const Point& a, const Point& b) {
+        return std::make_tuple(a.x, a.y) < std::make_tuple(b.x, b.y);
+    });
+    std::vector<Point> hull;
+    for(size_t pass = 0; pass < 2; pass++) {
+        size_t start = hull.size();
+        for(const auto& pt : points) {
+            while(hull.size() >= start + 2 &&
+                    cross(hull[hull.size() - 2], hull.back(), pt) <= 0)
+                hull.pop_back();
+            hull.push_back(pt);
+        }
+        hull.pop_back();
+        std::reverse(points.begin(), points.end());
+    }
+
+    double area = 0;
+    for(size_t ii = 0; ii < hull.size(); ii++)
+        area += cross(Point(), hull[ii], hull[(ii + 1) % hull.size()]);
+    return area*0.5;
+}
+
+/**
+ * Every node with three parents must be the center of a circle through them
+ * with no point inside, and the triangles of those parents must cover the
+ * convex hull of the points, so that no node is missing. Positions are
+ * floats, so a point only counts as inside by more than rounding.
+ */
+void checkEmptyCircles(const std::string& name, const std::vector<Point>& points)
+{
+    std::vector<Voronoi::Node::Ptr> nodes;
+    try {
+        nodes = Voronoi(points).getNodes();
+    } catch(const Voronoi::Error& e) {
+        fail(name, e.what());
+        return;
+    }
+
+    double area = 0;
+    for(const auto& node : nodes) {
+        if(node->parents.size() != 3)
+            continue;
+        Point center(node->x, node->y);
+        float tolerance = 1e-3f*std::max(1.0f, node->radius);
+        std::vector<Point> corners;
+        for(size_t parent : node->parents) {
+            corners.push_back(points[parent]);
+            if(std::abs(distance2d(center, points[parent]) - node->radius) >
+                    tolerance) {
+                fail(name, "node isn't on the circle of its parents");
+                return;
+            }
+        }
+        for(const auto& pt : points) {
+            if(distance2d(center, pt) < node->radius - tolerance) {
+                fail(name, "node's circle has a point inside");
+                return;
+            }
+        }
+        area += std::abs(cross(corners[0], corners[1], corners[2]))*0.5;
+    }
+
+    double hull = hullArea(points);
+    if(std::abs(area - hull) > 1e-6*std::max(1.0, hull))
+        fail(name, "triangles of the nodes don't cover the hull");
+}
+
+/**
+ * Power diagram version of checkEmptyCircles: a node with three parents is
+ * where their power distances |x - p|^2 - w are equal, and no point may be
+ * nearer than that. Power distances are differences of squares, so the
+ * rounding allowed grows with the squared size of the input.
+ */
+void checkEmptyPower(const std::string& name, const std::vector<Point>& points,
+        const std::vector<float>& weights)
+{
+    std::vector<Voronoi::Node::Ptr> nodes;
+    try {
+        nodes = Voronoi(points, weights).getNodes();
+    } catch(const Voronoi::Error& e) {
+        fail(name, e.what());
+        return;
+    }
+
+    auto power = [&](const Voronoi::Node& node, size_t site) {
+        double dx = double(node.x) - points[site].x;
+        double dy = double(node.y) - points[site].y;
+        return dx*dx + dy*dy - weights[site];
+    };
+
+    std::vector<bool> seen(points.size(), false);
+    for(const auto& node : nodes) {
+        for(size_t parent : node->parents)
+            seen[parent] = true;
+        if(node->parents.size() != 3)
+            continue;
+        double own = power(*node, *node->parents.begin());
+        double tolerance = 1e-3*std::max(1.0, std::abs(own));
+        for(size_t parent : node->parents) {
+            if(std::abs(power(*node, parent) - own) > tolerance) {
+                fail(name, "node isn't equally far from its parents");
+                return;
+            }
+        }
+        for(size_t ii = 0; ii < points.size(); ii++) {
+            if(power(*node, ii) < own - tolerance) {
+                fail(name, "node has a point nearer than its parents");
+                return;
+            }
+        }
+    }
+
+    // with equal weights nothing can be hidden
+    if(std::all_of(weights.begin(), weights.end(),
+                [&](float weight) { return weight == weights[0]; }) &&
+            std::find(seen.begin(), seen.end(), false) != seen.end())
+        fail(name, "point with an equal weight has no cell");
+}
+
+/**
+ * Circle site version of checkEmptyCircles: a node with three parents is the
+ * center of a circle touching the three of them that overlaps no circle, and
+ * every circle that isn't inside another has a cell.
+ */
+void checkEmptyCircleSites(const std::string& name,
+        const std::vector<Circle>& circles)
+{
+    std::vector<Voronoi::Node::Ptr> nodes;
+    try {
+        nodes = Voronoi(circles).getNodes();
+    } catch(const Voronoi::Error& e) {
+        fail(name, e.what());
+        return;
+    }
+
+    auto gap = [&](const Voronoi::Node& node, size_t site) {
+        return std::hypot(double(node.x) - circles[site].center.x,
+                double(node.y) - circles[site].center.y) - circles[site].radius;
+    };
+
+    std::vector<bool> seen(circles.size(), false);
+    for(const auto& node : nodes) {
+        for(size_t parent : node->parents)
+            seen[parent] = true;
+        if(node->parents.size() != 3)
+            continue;
+        double own = gap(*node, *node->parents.begin());
+        double tolerance = 1e-3*std::max(1.0, std::abs(own));
+        for(size_t parent : node->parents) {
+            if(std::abs(gap(*node, parent) - own) > tolerance) {
+                fail(name, "node's circle doesn't touch its parents");
+                return;
+            }
+        }
+        for(size_t ii = 0; ii < circles.size(); ii++) {
+            if(gap(*node, ii) < own - tolerance) {
+                fail(name, "node's circle overlaps a site");
+                return;
+            }
+        }
+    }
+
+    for(size_t ii = 0; ii < circles.size(); ii++) {
+        if(seen[ii])
+            continue;
+        bool inside = false;
+        for(size_t jj = 0; jj < circles.size() && !inside; jj++) {
+            inside = jj != ii && distance2d(circles[ii].center,
+                    circles[jj].center) + circles[ii].radius <=
+                circles[jj].radius;
+        }
+        if(!inside) {
+            fail(name, "circle that isn't inside another has no cell");
+            return;
+        }
+    }
+}
+
+/**
+ * The circles largestCircles reports in a window must be centered in it,
+ * come largest first, contain no point, and start with the largest circle of
+ * any node with three parents in the window.
+ */
+void checkLargestCircles(const std::string& name,
+        const std::vector<Point>& points, std::mt19937& rng)
+{
+    Voronoi voronoi(points);
+    ClearanceIndex index(voronoi, points);
+    std::uniform_real_distribution<float> coord(0, 1000);
+    for(size_t query = 0; query < 20; query++) {
+        Point lo(coord(rng), coord(rng));
+        Point hi(coord(rng), coord(rng));
+        if(lo.x > hi.x)
+            std::swap(lo.x, hi.x);
+        if(lo.y > hi.y)
+            std::swap(lo.y, hi.y);
+
+        float largest = -1;
+        for(const auto& node : voronoi.getNodes()) {
+            if(node->parents.size() == 3 && node->x >= lo.x &&
+                    node->x <= hi.x && node->y >= lo.y && node->y <= hi.y)
+                largest = std::max(largest, node->radius);
+        }
+
+        auto circles = index.largestCircles(lo, hi, 5);
+        if(largest < 0 ? !circles.empty() : circles.empty() ||
+                circles[0].radius != largest) {
+            fail(name, "largest circle in the window isn't first");
+            return;
+        }
+        for(size_t ii = 0; ii < circles.size(); ii++) {
+            const auto& circle = circles[ii];
+            float tolerance = 1e-3f*std::max(1.0f, circle.radius);
+            if(circle.center.x < lo.x || circle.center.x > hi.x ||
+                    circle.center.y < lo.y || circle.center.y > hi.y ||
+                    (ii > 0 && circle.radius > circles[ii - 1].radius)) {
+                fail(name, "circle outside the window or out of order");
+                return;
+            }
+            for(const auto& pt : points) {
+                if(distance2d(circle.center, pt) < circle.radius - tolerance) {
+                    fail(name, "largest circle has a point inside");
+                    return;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Replaying a recorded log gives the nodes of the run that recorded it, and a
+ * log with a record that doesn't fit its points is refused rather than read
+ * out of bounds.
+ */
+void checkReplay(const std::string& name, const std::vector<Point>& points)
+{
+    EventLog log;
+    Voronoi::Options options;
+    options.event_log = &log;
+    size_t recorded = Voronoi(points, options).getNodes().size();
+    if(Voronoi(log).getNodes().size() != recorded)
+        fail(name, "replay gives different nodes");
+
+    EventLog bad = log;
+    bad.events.front().sites[0] = points.size();
+    EventLog unknown = log;
+    unknown.events.back().type = EVENT_CIRCLE + 1;
+    for(const EventLog* corrupt : {&bad, &unknown}) {
+        try {
+            Voronoi replayed(*corrupt);
+            fail(name, "corrupt log replayed");
+        } catch(const Voronoi::Error&) {
+        }
+    }
+}
+
+/**
+ * A serialized diagram reads back the same, a buffer with an edge pointing
+ * past its nodes isn't viewed, and readDiagram refuses a length prefix over
+ * its limit instead of allocating it.
+ */
+void checkDiagramIO(const std::string& name, const std::vector<Point>& points)
+{
+    FlatDiagram flat = flatten(Voronoi(points));
+    std::vector<char> buffer;
+    serialize(flat, buffer);
+    FlatDiagram copy;
+    if(!deserialize(buffer.data(), buffer.size(), copy) ||
+            copy.nodes.size() != flat.nodes.size() ||
+            copy.edges.size() != flat.edges.size())
+        fail(name, "diagram doesn't read back");
+
+    if(!flat.edges.empty()) {
+        FlatDiagram::Edge edge;
+        size_t offset = sizeof(DiagramHeader) +
+            flat.nodes.size()*sizeof(FlatDiagram::Node);
+        std::memcpy(&edge, buffer.data() + offset, sizeof(edge));
+        edge.nodes[1] = flat.nodes.size();
+        std::memcpy(buffer.data() + offset, &edge, sizeof(edge));
+        DiagramView diagram;
+        if(view(buffer.data(), buffer.size(), diagram))
+            fail(name, "edge to a missing node viewed");
+    }
+
+    int fds[2];
+    if(::pipe(fds) != 0)
+        return;
+    uint64_t size = uint64_t(1) << 40;
+    if(!writeAll(fds[1], &size, sizeof(size)) || readDiagram(fds[0], copy))
+        fail(name, "oversized length prefix read");
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+/**
+ * An archive decodes to the flattened diagram up to the order of nodes and
+ * edges, with coordinates within half the quantization step and parents
+ * exact. Nodes are matched by their parents, which are unique for points in
+ * general position. An index claiming more than its blocks can hold is
+ * refused.
+ */
+void checkArchive(const std::string& name, const std::vector<Point>& points)
+{
+    typedef std::tuple<uint32_t, uint32_t, uint32_t> Parents;
+    auto parents = [](const FlatDiagram::Node& node) {
+        return std::make_tuple(node.parents[0], node.parents[1],
+                node.parents[2]);
+    };
+
+    FlatDiagram flat = flatten(Voronoi(points));
+    ArchiveOptions options;
+    options.resolution = 1.0f / 64;
+    options.block_nodes = 64;
+    std::vector<char> archive;
+    FlatDiagram decoded;
+    if(!encodeArchive(flat, options, archive) ||
+            !decodeArchive(archive.data(), archive.size(), decoded) ||
+            decoded.nodes.size() != flat.nodes.size() ||
+            decoded.edges.size() != flat.edges.size()) {
+        fail(name, "archive doesn't decode to as many nodes and edges");
+        return;
+    }
+
+    std::map<Parents, const FlatDiagram::Node*> original;
+    for(const auto& node : flat.nodes)
+        original[parents(node)] = &node;
+    for(const auto& node : decoded.nodes) {
+        auto it = original.find(parents(node));
+        float step = options.resolution*0.5f*(1 + 1e-3f);
+        if(it == original.end() ||
+                std::abs(it->second->x - node.x) > step ||
+                std::abs(it->second->y - node.y) > step ||
+                std::abs(it->second->radius - node.radius) > step) {
+            fail(name, "archived node doesn't match");
+            return;
+        }
+    }
+
+    std::multiset<std::tuple<Parents, Parents, uint32_t, uint32_t>> edges;
+    auto key = [&](const FlatDiagram& diagram, const FlatDiagram::Edge& edge) {
+        Parents a = parents(diagram.nodes[edge.nodes[0]]);
+        Parents b = parents(diagram.nodes[edge.nodes[1]]);
+        return std::make_tuple(std::min(a, b), std::max(a, b),
+                edge.parents[0], edge.parents[1]);
+    };
+    for(const auto& edge : flat.edges)
+        edges.insert(key(flat, edge));
+    for(const auto& edge : decoded.edges) {
+        auto it = edges.find(key(decoded, edge));
+        if(it == edges.end()) {
+            fail(name, "archived edge doesn't match");
+            return;
+        }
+        edges.erase(it);
+    }
+
+    ArchiveHeader header;
+    std::memcpy(&header, archive.data(), sizeof(header));
+    ArchiveBlock block;
+    std::memcpy(&block, archive.data() + sizeof(header), sizeof(block));
+    block.node_count += 1 << 30;
+    header.node_count += 1 << 30;
+    std::memcpy(archive.data(), &header, sizeof(header));
+    std::memcpy(archive.data() + sizeof(header), &block, sizeof(block));
+    ArchiveView viewed;
+    if(viewArchive(archive.data(), archive.size(), viewed))
+        fail(name, "archive with an oversized block viewed");
+}
+
+double ringArea(const std::vector<Point>& ring)
+{
+    double area = 0;
+    for(size_t ii = 0; ii < ring.size(); ii++)
+        area += cross(Point(), ring[ii], ring[(ii + 1) % ring.size()]);
+    return area*0.5;
+}
+
+/**
+ * Clipped cells tile the boundary: their rings are counterclockwise and add
+ * up to its area, and the average of each ring's corners is in the convex
+ * cell too, so nearest its site.
+ */
+void checkClippedCells(const std::string& name,
+        const std::vector<Point>& points, const std::vector<Point>& boundary)
+{
+    std::vector<ClippedCell> cells;
+    try {
+        cells = clipCells(Voronoi(points), points, boundary);
+    } catch(const Voronoi::Error& e) {
+        fail(name, e.what());
+        return;
+    }
+
+    double expected = std::abs(ringArea(boundary));
+    double total = 0;
+    for(const auto& cell : cells) {
+        for(const auto& ring : cell.rings) {
+            double area = ringArea(ring);
+            if(area < -1e-6*expected) {
+                fail(name, "clipped ring is clockwise");
+                return;
+            }
+            total += area;
+
+            Point middle;
+            for(const auto& pt : ring)
+                middle += pt*(1.0f/ring.size());
+            float own = distance2d(middle, points[cell.site]);
+            for(const auto& pt : points) {
+                if(distance2d(middle, pt) < own*(1 - 1e-4f) - 1e-3f) {
+                    fail(name, "clipped ring is nearer another site");
+                    return;
+                }
+            }
+        }
+    }
+    if(std::abs(total - expected) > 1e-4*expected)
+        fail(name, "clipped areas add up to " + std::to_string(total) +
+                " not " + std::to_string(expected));
+}
+
+/**
+ * A publisher opening a segment of the same layout left under its name
+ * carries on from its epoch, so a reader holding an older diagram can still
+ * tell when its slot is rewritten. One with a different layout gets a new
+ * segment and leaves mapped readers alone.
+ */
+void checkRepublish(const std::string& name, const std::vector<Point>& points)
+{
+    std::string segment = "/voronoi_test_" + std::to_string(::getpid());
+    FlatDiagram flat = flatten(Voronoi(points));
+    size_t capacity = serializedSize(flat);
+
+    DiagramPublisher first(segment, capacity);
+    DiagramSubscriber reader(segment);
+    if(!first.open() || !first.publish(flat) || !first.publish(flat) ||
+            !reader.open()) {
+        fail(name, "can't publish");
+        return;
+    }
+    DiagramView view;
+    uint64_t epoch;
+    if(!reader.acquire(view, epoch) || epoch != 2) {
+        fail(name, "can't read the published diagram");
+        return;
+    }
+
+    DiagramPublisher restarted(segment, capacity);
+    if(!restarted.open() || restarted.epoch() != 2 ||
+            !restarted.publish(flat) || !reader.valid(epoch) ||
+            !restarted.publish(flat) || reader.valid(epoch))
+        fail(name, "restarted publisher doesn't carry on the epochs");
+
+    DiagramPublisher resized(segment, 2*capacity);
+    if(!resized.open() || resized.epoch() != 0 || reader.epoch() != 4)
+        fail(name, "publisher of another layout reused the segment");
+}
+
+/**
+ * The medial axis of a width by height rectangle runs along its middle
+ * between two points as far from the long sides as from the short ones, and
+ * out from them to the corners. Sampled every unit along its sides, the
+ * skeleton distance field must match the distance to that axis inside and
+ * be INFINITY outside, leaving a unit either side of the boundary as slack.
+ */
+void checkSkeletonDistance(const std::string& name, int width, int height)
+{
+    std::vector<Point> boundary;
+    for(int x = 0; x < width; x++)
+        boundary.push_back(Point(x, 0));
+    for(int y = 0; y < height; y++)
+        boundary.push_back(Point(width, y));
+    for(int x = width; x > 0; x--)
+        boundary.push_back(Point(x, height));
+    for(int y = height; y > 0; y--)
+        boundary.push_back(Point(0, y));
+
+    float half = std::min(width, height)*0.5f;
+    Point end0(half, half);
+    Point end1(width - half, height - half);
+    std::vector<Line> axis{{end0, end1}};
+    for(const Point& corner : {Point(0, 0), Point(width, 0), Point(0, height),
+                Point(width, height)})
+        axis.push_back(Line{corner, distance2d(corner, end0) <
+                distance2d(corner, end1) ? end0 : end1});
+
+    RasterFrame frame{-5, -5, 0.5f, uint32_t(2*width + 20), uint32_t(2*height + 20)};
+    std::vector<float> field;
+    try {
+        field = skeletonDistanceField(Voronoi(boundary), boundary, frame);
+    } catch(const Voronoi::Error& e) {
+        fail(name, e.what());
+        return;
+    }
+
+    for(uint32_t row = 0; row < frame.height; row++) {
+        for(uint32_t col = 0; col < frame.width; col++) {
+            Point pt(frame.origin_x + (col + 0.5f)*frame.resolution,
+                    frame.origin_y + (row + 0.5f)*frame.resolution);
+            float inside = std::min({pt.x, width - pt.x, pt.y, height - pt.y});
+            float value = field[size_t(row)*frame.width + col];
+            if(inside < -1 && !std::isinf(value)) {
+                fail(name, "pixel outside has a distance");
+                return;
+            }
+            if(inside <= 1)
+                continue;
+
+            float expected = INFINITY;
+            for(const Line& segment : axis) {
+                Vector along = segment.pt1 - segment.pt0;
+                float length2 = normSquared(along);
+                float t = length2 > 0 ? dot(pt - segment.pt0, along) / length2 : 0;
+                t = std::min(1.0f, std::max(0.0f, t));
+                expected = std::min(expected,
+                        distance2d(pt, segment.pt0 + along*t));
+            }
+            if(!(std::abs(value - expected) <= 0.01f)) {
+                fail(name, "pixel inside is " + std::to_string(value) +
+                        " from the skeleton, not " + std::to_string(expected));
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Fixed point positions written while the nodes are built must be the ones
+ * converted from the finished diagram, including the count clamped. The
+ * resolution is fine enough that some positions don't fit in 16 bits.
+ */
+void checkFixedNodes(const std::string& name, const std::vector<Point>& points)
+{
+    TileFrame frame{100, 100, 0.02f};
+    FixedNodes16 nodes16, expected16;
+    FixedNodes32 nodes32, expected32;
+    FixedOutput output16(frame, nodes16);
+    FixedOutput output32(frame, nodes32);
+    Voronoi::Options options;
+    try {
+        options.fixed = &output16;
+        Voronoi voronoi(points, options);
+        options.fixed = &output32;
+        Voronoi again(points, options);
+        toFixed(voronoi, frame, expected16);
+        toFixed(again, frame, expected32);
+    } catch(const Voronoi::Error& e) {
+        fail(name, e.what());
+        return;
+    }
+
+    if(nodes16.x != expected16.x || nodes16.y != expected16.y ||
+            nodes16.clipped != expected16.clipped || expected16.clipped == 0)
+        fail(name, "16 bit nodes differ from converting the diagram");
+    if(nodes32.x != expected32.x || nodes32.y != expected32.y ||
+            nodes32.clipped != expected32.clipped)
+        fail(name, "32 bit nodes differ from converting the diagram");
+}
+
+/**
+ * Every arc of an offset at distance d must have no point nearer than d, and
+ * end where the next arc of its ring starts. The other way around, every
+ * position d from a point and clearly further from all others must be on an
+ * arc around that point. The batch form must give the same rings.
+ */
+void checkOffsets(const std::string& name, const std::vector<Point>& points)
+{
+    Voronoi voronoi(points);
+    OffsetCurves offsets(voronoi, points);
+    std::vector<float> distances{5, 20, 60, 150};
+    auto batch = offsets.compute(distances);
+    for(size_t ii = 0; ii < distances.size(); ii++) {
+        float distance = distances[ii];
+        float tolerance = 1e-3f*distance;
+        auto rings = offsets.compute(distance);
+        if(rings.size() != batch[ii].size()) {
+            fail(name, "batch gives different rings");
+            return;
+        }
+
+        auto nearest = [&](const Point& pt) {
+            float out = INFINITY;
+            for(const auto& site : points)
+                out = std::min(out, distance2d(pt, site));
+            return out;
+        };
+        auto at = [&](size_t site, float angle) {
+            return points[site] + Vector(std::cos(angle), std::sin(angle))*
+                distance;
+        };
+
+        std::vector<std::vector<OffsetCurves::Arc>> around(points.size());
+        for(const auto& ring : rings) {
+            for(size_t jj = 0; jj < ring.arcs.size(); jj++) {
+                const auto& arc = ring.arcs[jj];
+                const auto& next = ring.arcs[(jj + 1) % ring.arcs.size()];
+                around[arc.site].push_back(arc);
+                if(distance2d(at(arc.site, arc.end_angle),
+                            at(next.site, next.start_angle)) > tolerance) {
+                    fail(name, "ring isn't closed");
+                    return;
+                }
+                for(float t : {0.0f, 0.25f, 0.5f, 0.75f, 1.0f}) {
+                    float angle = arc.start_angle +
+                        t*(arc.end_angle - arc.start_angle);
+                    if(nearest(at(arc.site, angle)) < distance - tolerance) {
+                        fail(name, "offset at " + std::to_string(distance) +
+                                " has a point nearer");
+                        return;
+                    }
+                }
+            }
+        }
+
+        for(size_t site = 0; site < points.size(); site++) {
+            for(int step = 0; step < 16; step++) {
+                float angle = step*float(M_PI) / 8;
+                if(nearest(at(site, angle)) < distance - tolerance)
+                    continue;
+                float others = INFINITY;
+                for(size_t jj = 0; jj < points.size(); jj++) {
+                    if(jj != site)
+                        others = std::min(others,
+                                distance2d(at(site, angle), points[jj]));
+                }
+                if(others < distance + 1e-2f*distance)
+                    continue;
+
+                bool covered = false;
+                for(const auto& arc : around[site]) {
+                    float turn = std::fmod(angle - arc.start_angle,
+                            2*float(M_PI));
+                    if(turn < 0)
+                        turn += 2*float(M_PI);
+                    if(turn <= arc.end_angle - arc.start_angle + 1e-3f ||
+                            turn >= 2*float(M_PI) - 1e-3f)
+                        covered = true;
+                }
+                if(!covered) {
+                    fail(name, "offset at " + std::to_string(distance) +
+                            " misses a position around a point");
+                    return;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Natural neighbor weights reproduce linear functions inside the hull, so
+ * interpolating one must give it back, one query at a time or in a batch.
+ * The corners put the whole square of queries inside the hull.
+ */
+void checkLinearPrecision(const std::string& name,
+        std::vector<Point> points, std::mt19937& rng)
+{
+    for(const Point& corner : {Point(-1, -1), Point(1001, -1),
+                Point(1001, 1001), Point(-1, 1001)})
+        points.push_back(corner);
+    auto linear = [](const Point& pt) {
+        return 3 + 0.5f*pt.x - 0.25f*pt.y;
+    };
+    std::vector<float> values;
+    for(const auto& pt : points)
+        values.push_back(linear(pt));
+
+    NaturalNeighborInterpolator interpolator(Voronoi(points), points, values);
+    std::uniform_real_distribution<float> coord(0, 1000);
+    std::vector<Point> queries(points.begin(), points.begin() + 20);
+    while(queries.size() < 200)
+        queries.push_back(Point(coord(rng), coord(rng)));
+
+    auto batch = interpolator.interpolate(queries);
+    for(size_t ii = 0; ii < queries.size(); ii++) {
+        float value = interpolator.interpolate(queries[ii]);
+        float expected = linear(queries[ii]);
+        if(!(std::abs(value - expected) <= 1e-2f)) {
+            fail(name, "interpolated " + std::to_string(value) +
+                    " instead of " + std::to_string(expected));
+            return;
+        }
+        if(batch[ii] != value) {
+            fail(name, "batch interpolation differs");
+            return;
+        }
+    }
+}
+
+/**
+ * Every pixel of a label raster must name a point as near as the nearest one
+ * found by trying them all, and the distance field must be that distance.
+ * The frame reaches past the points and its pixels don't line up with them.
+ */
+void checkLabels(const std::string& name, const std::vector<Point>& points)
+{
+    RasterFrame frame{-60, -45, 13.7f, 85, 81};
+    Voronoi voronoi(points);
+    auto labels = rasterizeLabels(voronoi, points, frame);
+    auto field = distanceField(voronoi, points, frame);
+    for(uint32_t row = 0; row < frame.height; row++) {
+        for(uint32_t col = 0; col < frame.width; col++) {
+            Point pt(frame.origin_x + (col + 0.5f)*frame.resolution,
+                    frame.origin_y + (row + 0.5f)*frame.resolution);
+            float nearest = INFINITY;
+            for(const auto& site : points)
+                nearest = std::min(nearest, distance2d(pt, site));
+
+            size_t index = size_t(row)*frame.width + col;
+            float tolerance = 1e-3f*std::max(1.0f, nearest);
+            if(labels[index] >= points.size() ||
+                    distance2d(pt, points[labels[index]]) > nearest + tolerance) {
+                fail(name, "pixel isn't labeled with its nearest point");
+                return;
+            }
+            if(!(std::abs(field[index] - nearest) <= tolerance)) {
+                fail(name, "pixel distance isn't to its nearest point");
+                return;
+            }
+        }
+    }
+}
+
+// Distance from pt to the segment from pt0 to pt1
+float segmentDistance(const Point& pt, const Point& pt0, const Point& pt1)
+{
+    Vector along = pt1 - pt0;
+    float length2 = normSquared(along);
+    float t = length2 > 0 ? dot(pt - pt0, along) / length2 : 0;
+    t = std::min(1.0f, std::max(0.0f, t));
+    return distance2d(pt, pt0 + along*t);
+}
+
+/**
+ * A planned path must keep radius from every point along each of its
+ * segments, and be as long as the shortest one Dijkstra's algorithm finds
+ * over the same graph: the edges between the corners of the cells and
+ * straight connectors from start and goal to the corners of their own cells,
+ * each kept only if it's clear of every point by radius. Either both find a
+ * path or neither does.
+ */
+void checkPlanner(const std::string& name, const std::vector<Point>& points,
+        std::mt19937& rng)
+{
+    Voronoi voronoi(points);
+    SkeletonPlanner planner(voronoi, points);
+
+    // corners of the cells, and edges between corners with two parents in
+    // common
+    std::vector<Voronoi::Node::Ptr> nodes;
+    for(const auto& node : voronoi.getNodes()) {
+        if(node->parents.size() == 3)
+            nodes.push_back(node);
+    }
+    std::map<std::pair<size_t, size_t>, std::vector<size_t>> pairs;
+    for(size_t ii = 0; ii < nodes.size(); ii++) {
+        std::vector<size_t> parents(nodes[ii]->parents.begin(),
+                nodes[ii]->parents.end());
+        pairs[std::make_pair(parents[0], parents[1])].push_back(ii);
+        pairs[std::make_pair(parents[1], parents[2])].push_back(ii);
+        pairs[std::make_pair(parents[0], parents[2])].push_back(ii);
+    }
+    auto position = [&](size_t node) {
+        return Point(nodes[node]->x, nodes[node]->y);
+    };
+    auto clearance = [&](const Point& pt0, const Point& pt1) {
+        float out = INFINITY;
+        for(const auto& pt : points)
+            out = std::min(out, segmentDistance(pt, pt0, pt1));
+        return out;
+    };
+    auto nearest = [&](const Point& pt) {
+        size_t out = 0;
+        for(size_t ii = 1; ii < points.size(); ii++) {
+            if(distance2d(pt, points[ii]) < distance2d(pt, points[out]))
+                out = ii;
+        }
+        return out;
+    };
+
+    std::uniform_real_distribution<float> coord(0, 1000);
+    std::uniform_real_distribution<float> size(0, 30);
+    for(size_t query = 0; query < 10; query++) {
+        Point start(coord(rng), coord(rng));
+        Point goal(coord(rng), coord(rng));
+        float radius = size(rng);
+
+        // the start and goal are nodes past the end of the diagram's
+        std::vector<std::vector<std::pair<size_t, float>>> adjacent(
+                nodes.size() + 2);
+        const size_t START = nodes.size(), GOAL = nodes.size() + 1;
+        auto join = [&](size_t node0, const Point& pt0, size_t node1,
+                const Point& pt1) {
+            if(clearance(pt0, pt1) >= radius) {
+                adjacent[node0].emplace_back(node1, distance2d(pt0, pt1));
+                adjacent[node1].emplace_back(node0, distance2d(pt0, pt1));
+            }
+        };
+        for(const auto& pair : pairs) {
+            if(pair.second.size() == 2)
+                join(pair.second[0], position(pair.second[0]), pair.second[1],
+                        position(pair.second[1]));
+        }
+        size_t start_site = nearest(start), goal_site = nearest(goal);
+        for(size_t ii = 0; ii < nodes.size(); ii++) {
+            if(nodes[ii]->parents.count(start_site))
+                join(START, start, ii, position(ii));
+            if(nodes[ii]->parents.count(goal_site))
+                join(GOAL, goal, ii, position(ii));
+        }
+        if(start_site == goal_site)
+            join(START, start, GOAL, goal);
+
+        std::vector<float> cost(adjacent.size(), INFINITY);
+        typedef std::pair<float, size_t> Entry;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+        if(distance2d(start, points[start_site]) >= radius &&
+                distance2d(goal, points[goal_site]) >= radius) {
+            cost[START] = 0;
+            open.push(Entry(0, START));
+        }
+        while(!open.empty()) {
+            Entry entry = open.top();
+            open.pop();
+            if(entry.first > cost[entry.second])
+                continue;
+            for(const auto& next : adjacent[entry.second]) {
+                if(entry.first + next.second < cost[next.first]) {
+                    cost[next.first] = entry.first + next.second;
+                    open.push(Entry(cost[next.first], next.first));
+                }
+            }
+        }
+
+        std::vector<Point> path;
+        bool found = planner.plan(start, goal, radius, path);
+        if(found != !std::isinf(cost[GOAL])) {
+            fail(name, found ? "path planned where there is none" :
+                    "no path planned where there is one");
+            return;
+        }
+        if(!found)
+            continue;
+
+        float length = 0;
+        for(size_t ii = 1; ii < path.size(); ii++) {
+            length += distance2d(path[ii - 1], path[ii]);
+            if(clearance(path[ii - 1], path[ii]) < radius*(1 - 1e-4f)) {
+                fail(name, "path comes closer than radius to a point ");
+                return;
+            }
+        }
+        if(distance2d(path.front(), start) > 0 ||
+                distance2d(path.back(), goal) > 0 ||
+                std::abs(length - cost[GOAL]) > 1e-3f*std::max(1.0f, length)) {
+            fail(name, "path is " + std::to_string(length) +
+                    " long, not the shortest " + std::to_string(cost[GOAL]));
+            return;
+        }
+    }
+}
+
+/**
+ * The skeleton of a lobed star polygon at every scale must be a prefix of the
+ * edges that's connected: whenever the scale drops past one more value, the
+ * edges up to there must join all the nodes they touch into one piece, and
+ * count and level must cut the edges at exactly that place.
+ */
+void checkHierarchy(const std::string& name, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(0, 1);
+    float phase0 = 2*M_PI*unit(rng), phase1 = 2*M_PI*unit(rng);
+    float lobes0 = 40 + 60*unit(rng), lobes1 = 20 + 40*unit(rng);
+    std::vector<Point> boundary;
+    for(size_t ii = 0; ii < 600; ii++) {
+        float angle = 2*M_PI*ii / 600;
+        float radius = 250 + lobes0*std::sin(3*angle + phase0) +
+            lobes1*std::sin(7*angle + phase1);
+        boundary.push_back(Point(500 + radius*std::cos(angle),
+                    500 + radius*std::sin(angle)));
+    }
+
+    SkeletonHierarchy hierarchy(Voronoi(boundary), boundary);
+    const auto& edges = hierarchy.edges();
+    if(edges.empty()) {
+        fail(name, "polygon has no skeleton");
+        return;
+    }
+
+    // union find over the nodes, with the number of pieces among those
+    // touched so far
+    std::vector<uint32_t> root(hierarchy.nodes().size());
+    for(uint32_t ii = 0; ii < root.size(); ii++)
+        root[ii] = ii;
+    std::function<uint32_t(uint32_t)> find = [&](uint32_t node) {
+        return root[node] == node ? node : root[node] = find(root[node]);
+    };
+    std::vector<bool> touched(root.size(), false);
+    size_t pieces = 0;
+    for(size_t ii = 0; ii < edges.size(); ii++) {
+        const auto& edge = edges[ii];
+        if(ii > 0 && edge.scale > edges[ii - 1].scale) {
+            fail(name, "edges aren't in order of decreasing scale");
+            return;
+        }
+        for(uint32_t node : edge.nodes) {
+            if(!touched[node]) {
+                touched[node] = true;
+                pieces++;
+            }
+        }
+        uint32_t root0 = find(edge.nodes[0]), root1 = find(edge.nodes[1]);
+        if(root0 != root1) {
+            root[root0] = root1;
+            pieces--;
+        }
+
+        if(ii + 1 < edges.size() && edges[ii + 1].scale == edge.scale)
+            continue;
+        if(pieces != 1) {
+            fail(name, "skeleton at scale " + std::to_string(edge.scale) +
+                    " is in " + std::to_string(pieces) + " pieces");
+            return;
+        }
+        auto level = hierarchy.level(edge.scale);
+        if(hierarchy.count(edge.scale) != ii + 1 || level.size() != ii + 1 ||
+                !std::equal(level.begin(), level.end(), edges.begin(),
+                    [](const SkeletonHierarchy::Edge& lhs,
+                        const SkeletonHierarchy::Edge& rhs) {
+                        return lhs.nodes[0] == rhs.nodes[0] &&
+                            lhs.nodes[1] == rhs.nodes[1] &&
+                            lhs.scale == rhs.scale;
+                    })) {
+            fail(name, "level isn't the prefix of edges down to its scale");
+            return;
+        }
+    }
+}
+
+// Distinct points from gen, which is called with rng until there are count
+template <typename Generator>
+std::vector<Point> distinctPoints(unsigned seed, size_t count, Generator gen)
+{
+    std::mt19937 rng(seed);
+    std::set<std::tuple<float, float>> seen;
+    std::vector<Point> points;
+    while(points.size() < count) {
+        Point pt = gen(rng);
+        if(seen.insert(std::make_tuple(pt.x, pt.y)).second)
+            points.push_back(pt);
+    }
+    return points;
+}
+
+void checkDiagrams()
+{
+    // level sites that once went through the same arc twice
+    checkEmptyCircles("level pairs", {{5, 0}, {2, 1}, {6, 0}, {3, 1}});
+
+    // enough nodes to be built on several threads
+    std::uniform_real_distribution<float> wide(0, 1000);
+    checkFixedNodes("threaded fixed", distinctPoints(1, 5000,
+                [&](std::mt19937& rng) {
+                    return Point(wide(rng), wide(rng));
+                }));
+
+    for(unsigned seed = 1; seed <= 20; seed++) {
+        std::string suffix = " " + std::to_string(seed);
+
+        std::uniform_real_distribution<float> coord(0, 1000);
+        checkEmptyCircles("random" + suffix, distinctPoints(seed, 500,
+                    [&](std::mt19937& rng) {
+                        return Point(coord(rng), coord(rng));
+                    }));
+
+        // a few rows of sites at exactly the same height
+        std::uniform_int_distribution<int> row(0, 30);
+        checkEmptyCircles("rows" + suffix, distinctPoints(seed, 300,
+                    [&](std::mt19937& rng) {
+                        return Point(coord(rng), row(rng));
+                    }));
+
+        // every site on four or more circles with others
+        std::uniform_int_distribution<int> cell(0, 25);
+        checkEmptyCircles("grid" + suffix, distinctPoints(seed, 300,
+                    [&](std::mt19937& rng) {
+                        return Point(cell(rng), cell(rng));
+                    }));
+
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(0, 1);
+        auto random = distinctPoints(seed, 200, [&](std::mt19937& rng) {
+            return Point(coord(rng), coord(rng));
+        });
+        auto grid = distinctPoints(seed, 200, [&](std::mt19937& rng) {
+            return Point(cell(rng)*40, cell(rng)*40);
+        });
+
+        std::vector<float> weights, level(grid.size(), 100);
+        std::vector<Circle> circles, equal, sized;
+        for(const auto& pt : random) {
+            weights.push_back(400*unit(rng));
+            circles.push_back(Circle{pt, 20*unit(rng)});
+        }
+        for(const auto& pt : grid) {
+            equal.push_back(Circle{pt, 10});
+            sized.push_back(Circle{pt, 30*unit(rng)});
+        }
+        checkEmptyPower("power" + suffix, random, weights);
+        checkEmptyPower("level power" + suffix, grid, level);
+        checkEmptyCircleSites("circles" + suffix, circles);
+        checkEmptyCircleSites("equal circles" + suffix, equal);
+        checkEmptyCircleSites("grid circles" + suffix, sized);
+
+        checkReplay("replay" + suffix, random);
+        checkDiagramIO("diagram io" + suffix, random);
+        checkArchive("archive" + suffix, random);
+        checkRepublish("republish" + suffix, random);
+        checkFixedNodes("fixed" + suffix, random);
+        checkOffsets("offset" + suffix, random);
+        checkLinearPrecision("sibson" + suffix, random, rng);
+        checkLinearPrecision("grid sibson" + suffix, grid, rng);
+        checkLabels("labels" + suffix, random);
+        checkLabels("grid labels" + suffix, grid);
+        checkPlanner("planner" + suffix, random, rng);
+        checkHierarchy("hierarchy" + suffix, rng);
+
+        // an L sticking out of the points on two sides, a clockwise square
+        // inside them, and a triangle inside a single cell
+        checkClippedCells("L clip" + suffix, random, {{-100, -100},
+                {600, -100}, {600, 400}, {300, 400}, {300, 1100},
+                {-100, 1100}});
+        checkClippedCells("square clip" + suffix, random, {{200, 200},
+                {200, 800}, {800, 800}, {800, 200}});
+        Point inside = random[0] + Vector(0.5f, 0.25f);
+        checkClippedCells("one cell clip" + suffix, random, {inside,
+                inside + Vector(0.5f, 0), inside + Vector(0, 0.5f)});
+
+        checkLargestCircles("largest" + suffix, random, rng);
+        checkLargestCircles("grid largest" + suffix, grid, rng);
+
+        checkSkeletonDistance("skeleton" + suffix, 20 + cell(rng), 5 + cell(rng));
+    }
+}
+
+}
 
 int main()
 {
@@ -41,4 +1129,10 @@ int main()
     }
 
     doc.save();
+
+    checkDiagrams();
+    if(failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
 }
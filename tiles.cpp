@@ -0,0 +1,389 @@
+#include "tiles.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <cmath>
+#include <cerrno>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "std_ext.h"
+#include "voronoi.h"
+
+namespace
+{
+
+const float INF = std::numeric_limits<float>::infinity();
+
+struct Rect
+{
+    float min_x, min_y, max_x, max_y;
+
+    // half open so that each position belongs to exactly one tile
+    bool contains(float x, float y) const
+    {
+        return x >= min_x && x < max_x && y >= min_y && y < max_y;
+    }
+
+    bool contains(const FlatDiagram::Node& node) const
+    {
+        return node.x - node.radius >= min_x && node.x + node.radius <= max_x &&
+            node.y - node.radius >= min_y && node.y + node.radius <= max_y;
+    }
+};
+
+// Messages between driver and workers
+
+struct JobHeader
+{
+    uint32_t job;
+    uint32_t count;
+    Rect core;
+    Rect halo;
+};
+
+struct SitePoint
+{
+    uint32_t id;
+    float x, y;
+};
+
+struct ResultHeader
+{
+    uint32_t job;
+
+    // 0 if some kept node has an empty circle that leaves the halo
+    uint32_t complete;
+};
+
+struct Job
+{
+    Rect core;
+    Rect halo;
+    float margin;
+    std::vector<SitePoint> sites;
+};
+
+struct Worker
+{
+    pid_t pid;
+    int fd;
+
+    // index of the running job or -1 if idle
+    long job;
+};
+
+/**
+ * Keep the part of a worker's diagram that belongs to its tile: the edges
+ * whose midpoint lies in the core, their nodes, and any other nodes in the
+ * core. Parents are translated from local to global point indices.
+ */
+FlatDiagram clipToTile(const FlatDiagram& local,
+        const std::vector<SitePoint>& sites, const JobHeader& header,
+        bool& complete)
+{
+    FlatDiagram out;
+    std::vector<uint32_t> remap(local.nodes.size(), NO_PARENT);
+
+    auto globalize = [&](uint32_t* parents, size_t count) {
+        for(size_t ii = 0; ii < count; ii++) {
+            if(parents[ii] != NO_PARENT)
+                parents[ii] = sites[parents[ii]].id;
+        }
+        std::sort(parents, parents + count);
+    };
+
+    auto keep = [&](uint32_t ii) {
+        if(remap[ii] == NO_PARENT) {
+            remap[ii] = out.nodes.size();
+            out.nodes.push_back(local.nodes[ii]);
+            globalize(out.nodes.back().parents, 3);
+        }
+        return remap[ii];
+    };
+
+    for(uint32_t ii = 0; ii < local.nodes.size(); ii++) {
+        if(header.core.contains(local.nodes[ii].x, local.nodes[ii].y))
+            keep(ii);
+    }
+
+    for(const auto& edge : local.edges) {
+        const auto& node0 = local.nodes[edge.nodes[0]];
+        const auto& node1 = local.nodes[edge.nodes[1]];
+        if(!header.core.contains((node0.x + node1.x)*0.5f,
+                    (node0.y + node1.y)*0.5f))
+            continue;
+
+        FlatDiagram::Edge kept = edge;
+        kept.nodes[0] = keep(edge.nodes[0]);
+        kept.nodes[1] = keep(edge.nodes[1]);
+        globalize(kept.parents, 2);
+        out.edges.push_back(kept);
+    }
+
+    complete = true;
+    for(const auto& node : out.nodes)
+        complete = complete && header.halo.contains(node);
+
+    return out;
+}
+
+void runWorker(int fd)
+{
+    JobHeader header;
+    while(readAll(fd, &header, sizeof(header))) {
+        std::vector<SitePoint> sites(header.count);
+        if(!readAll(fd, sites.data(), sites.size()*sizeof(SitePoint)))
+            break;
+
+        std::vector<Point> points;
+        points.reserve(sites.size());
+        for(const auto& site : sites)
+            points.push_back(Point(site.x, site.y));
+
+        FlatDiagram local;
+        if(!points.empty()) {
+            Voronoi voronoi(points);
+            local = flatten(voronoi);
+        }
+
+        bool complete;
+        FlatDiagram tile = clipToTile(local, sites, header, complete);
+
+        ResultHeader result{header.job, complete};
+        if(!writeAll(fd, &result, sizeof(result)) || !writeDiagram(fd, tile))
+            break;
+    }
+}
+
+bool sendJob(const Worker& worker, uint32_t index, const Job& job)
+{
+    JobHeader header;
+    header.job = index;
+    header.count = job.sites.size();
+    header.core = job.core;
+    header.halo = job.halo;
+    return sendAll(worker.fd, &header, sizeof(header)) &&
+        sendAll(worker.fd, job.sites.data(), job.sites.size()*sizeof(SitePoint));
+}
+
+}
+
+bool computeTiled(const std::vector<Point>& points, const TileOptions& options,
+        FlatDiagram& out)
+{
+    out = FlatDiagram();
+    if(points.empty())
+        return true;
+
+    Rect bounds{INF, INF, -INF, -INF};
+    for(const auto& pt : points) {
+        bounds.min_x = std::min(bounds.min_x, pt.x);
+        bounds.min_y = std::min(bounds.min_y, pt.y);
+        bounds.max_x = std::max(bounds.max_x, pt.x);
+        bounds.max_y = std::max(bounds.max_y, pt.y);
+    }
+
+    size_t tiles_x = std::max<size_t>(1, options.tiles_x);
+    size_t tiles_y = std::max<size_t>(1, options.tiles_y);
+    float width = std::max(bounds.max_x - bounds.min_x, 1e-6f) / tiles_x;
+    float height = std::max(bounds.max_y - bounds.min_y, 1e-6f) / tiles_y;
+    float margin = options.halo > 0 ? options.halo : 0.5f*std::max(width, height);
+
+    // bucket points by tile so that gathering a halo only looks at nearby
+    // tiles
+    auto column = [&](float x) {
+        return std::min<size_t>(tiles_x - 1,
+                std::max<float>(0, (x - bounds.min_x) / width));
+    };
+    auto row = [&](float y) {
+        return std::min<size_t>(tiles_y - 1,
+                std::max<float>(0, (y - bounds.min_y) / height));
+    };
+    std::vector<std::vector<uint32_t>> buckets(tiles_x*tiles_y);
+    for(uint32_t ii = 0; ii < points.size(); ii++)
+        buckets[row(points[ii].y)*tiles_x + column(points[ii].x)].push_back(ii);
+
+    // The outer tiles extend to infinity so that nodes outside of the
+    // bounding box still belong to a tile. The halo is also infinite on any
+    // side where it covers all of the points.
+    auto gather = [&](Job& job) {
+        Rect& halo = job.halo;
+        halo.min_x = job.core.min_x - job.margin;
+        halo.min_y = job.core.min_y - job.margin;
+        halo.max_x = job.core.max_x + job.margin;
+        halo.max_y = job.core.max_y + job.margin;
+        if(halo.min_x <= bounds.min_x) halo.min_x = -INF;
+        if(halo.min_y <= bounds.min_y) halo.min_y = -INF;
+        if(halo.max_x > bounds.max_x) halo.max_x = INF;
+        if(halo.max_y > bounds.max_y) halo.max_y = INF;
+
+        job.sites.clear();
+        size_t col0 = std::isinf(halo.min_x) ? 0 : column(halo.min_x);
+        size_t col1 = std::isinf(halo.max_x) ? tiles_x - 1 : column(halo.max_x);
+        size_t row0 = std::isinf(halo.min_y) ? 0 : row(halo.min_y);
+        size_t row1 = std::isinf(halo.max_y) ? tiles_y - 1 : row(halo.max_y);
+        for(size_t yy = row0; yy <= row1; yy++) {
+            for(size_t xx = col0; xx <= col1; xx++) {
+                for(uint32_t ii : buckets[yy*tiles_x + xx]) {
+                    const Point& pt = points[ii];
+                    if(pt.x >= halo.min_x && pt.x <= halo.max_x &&
+                            pt.y >= halo.min_y && pt.y <= halo.max_y)
+                        job.sites.push_back(SitePoint{ii, pt.x, pt.y});
+                }
+            }
+        }
+    };
+
+    auto unbounded = [](const Rect& rect) {
+        return std::isinf(rect.min_x) && std::isinf(rect.min_y) &&
+            std::isinf(rect.max_x) && std::isinf(rect.max_y);
+    };
+
+    std::vector<Job> jobs(tiles_x*tiles_y);
+    for(size_t yy = 0; yy < tiles_y; yy++) {
+        for(size_t xx = 0; xx < tiles_x; xx++) {
+            Job& job = jobs[yy*tiles_x + xx];
+            job.core.min_x = xx == 0 ? -INF : bounds.min_x + xx*width;
+            job.core.max_x = xx + 1 == tiles_x ? INF : bounds.min_x + (xx + 1)*width;
+            job.core.min_y = yy == 0 ? -INF : bounds.min_y + yy*height;
+            job.core.max_y = yy + 1 == tiles_y ? INF : bounds.min_y + (yy + 1)*height;
+            job.margin = margin;
+            gather(job);
+        }
+    }
+
+    // Idle workers pull the next job, biggest tiles first, so that uneven
+    // tiles don't leave workers waiting at the end
+    std::deque<uint32_t> pending;
+    for(uint32_t ii = 0; ii < jobs.size(); ii++)
+        pending.push_back(ii);
+    std::sort(pending.begin(), pending.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return jobs[lhs].sites.size() > jobs[rhs].sites.size();
+    });
+
+    std::vector<Worker> workers;
+    size_t worker_count = std::max<size_t>(1,
+            std::min(options.workers, jobs.size()));
+    for(size_t ii = 0; ii < worker_count; ii++) {
+        int fds[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            break;
+
+        pid_t pid = fork();
+        if(pid == 0) {
+            ::close(fds[0]);
+            for(const auto& worker : workers)
+                ::close(worker.fd);
+            runWorker(fds[1]);
+            _exit(0);
+        }
+
+        ::close(fds[1]);
+        if(pid < 0) {
+            ::close(fds[0]);
+            break;
+        }
+        workers.push_back(Worker{pid, fds[0], -1});
+    }
+
+    bool success = !workers.empty();
+    std::vector<FlatDiagram> results(jobs.size());
+    size_t running = 0;
+    while(success && (running > 0 || !pending.empty())) {
+        for(auto& worker : workers) {
+            if(worker.job >= 0 || pending.empty())
+                continue;
+            worker.job = pending.front();
+            pending.pop_front();
+            running++;
+            if(!sendJob(worker, worker.job, jobs[worker.job]))
+                success = false;
+        }
+
+        std::vector<pollfd> fds;
+        std::vector<Worker*> busy;
+        for(auto& worker : workers) {
+            if(worker.job >= 0) {
+                fds.push_back(pollfd{worker.fd, POLLIN, 0});
+                busy.push_back(&worker);
+            }
+        }
+        if(!success || poll(fds.data(), fds.size(), -1) < 0) {
+            success = success && errno == EINTR;
+            continue;
+        }
+
+        for(size_t ii = 0; ii < fds.size() && success; ii++) {
+            if(!fds[ii].revents)
+                continue;
+
+            Worker& worker = *busy[ii];
+            ResultHeader result;
+            FlatDiagram tile;
+            if(!readAll(worker.fd, &result, sizeof(result)) ||
+                    !readDiagram(worker.fd, tile) ||
+                    result.job != uint32_t(worker.job)) {
+                success = false;
+                break;
+            }
+
+            Job& job = jobs[worker.job];
+            if(!result.complete && !unbounded(job.halo)) {
+                job.margin *= 2;
+                gather(job);
+                pending.push_front(worker.job);
+            } else {
+                results[worker.job].nodes.swap(tile.nodes);
+                results[worker.job].edges.swap(tile.edges);
+            }
+
+            worker.job = -1;
+            running--;
+        }
+    }
+
+    for(const auto& worker : workers) {
+        ::close(worker.fd);
+        waitpid(worker.pid, nullptr, 0);
+    }
+
+    if(!success)
+        return false;
+
+    // Stitch, nodes from different tiles with the same parents are the same
+    // node and edges between the same nodes are the same edge
+    std::unordered_map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> node_index;
+    std::unordered_set<std::tuple<uint32_t, uint32_t>> edge_index;
+    for(const auto& tile : results) {
+        std::vector<uint32_t> remap(tile.nodes.size());
+        for(size_t ii = 0; ii < tile.nodes.size(); ii++) {
+            const auto& node = tile.nodes[ii];
+            auto key = std::make_tuple(node.parents[0], node.parents[1],
+                    node.parents[2]);
+            auto result = node_index.emplace(key, out.nodes.size());
+            if(result.second)
+                out.nodes.push_back(node);
+            remap[ii] = result.first->second;
+        }
+
+        for(const auto& edge : tile.edges) {
+            uint32_t a = remap[edge.nodes[0]];
+            uint32_t b = remap[edge.nodes[1]];
+            if(edge_index.insert(std::make_tuple(std::min(a, b), std::max(a, b))).second) {
+                FlatDiagram::Edge stitched = edge;
+                stitched.nodes[0] = a;
+                stitched.nodes[1] = b;
+                out.edges.push_back(stitched);
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "geometry.h"
+#include "diagram_io.h"
+
+/**
+ * Compute the diagram of a large point set with a pool of local worker
+ * processes.
+ *
+ * The bounding box of the points is cut into a grid of tiles. Each tile is
+ * sent to a worker along with every point within a halo margin around it, and
+ * the worker sends back the part of its diagram that belongs to the tile as a
+ * serialized FlatDiagram. Nodes are identified by their parents, so the
+ * pieces from neighboring tiles are stitched by merging nodes with the same
+ * parents. A tile whose nodes have empty circles that poke out of the halo is
+ * run again with a wider halo.
+ *
+ * Workers talk to the driver over socket pairs and never share memory with it,
+ * so they stand in for processes on other machines.
+ */
+struct TileOptions
+{
+    TileOptions() : tiles_x(4), tiles_y(4), halo(0), workers(4) {};
+
+    size_t tiles_x, tiles_y;
+
+    // margin around each tile, 0 uses half the tile size
+    float halo;
+
+    size_t workers;
+};
+
+// Returns false if a worker failed, in which case out is left empty
+bool computeTiled(const std::vector<Point>& points, const TileOptions& options,
+        FlatDiagram& out);
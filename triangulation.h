@@ -0,0 +1,791 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+
+#include "geometry.h"
+#include "voronoi.h"
+
+/**
+ * Incremental (Bowyer-Watson) triangulation of sites 0..count-1, with the
+ * geometry supplied by Predicates:
+ *
+ *  double orient(size_t a, size_t b, size_t c)
+ *      > 0 if a, b, c turn counterclockwise, 0 if collinear
+ *  bool conflict(size_t a, size_t b, size_t c, size_t p)
+ *      true if p violates the empty circle of counterclockwise triangle abc
+ *  double beyond(size_t a, size_t b, size_t p)
+ *      > 0 if p reaches past hull edge ab (hull on the right), 0 if it just
+ *      touches, for points the same as orient
+ *  bool coincident(size_t a, size_t b)
+ *      true if a and b sit at the same position
+ *  bool face(size_t a, size_t b, size_t c)
+ *      true if a, b and c on their own have a diagram with a single node,
+ *      that of counterclockwise triangle abc
+ *  bool hidden(size_t p, size_t near)
+ *      true if p has no cell, given that it conflicts with nothing and near
+ *      is the site nearest to it
+ *  double distance(size_t site, size_t p)
+ *      distance from p's position to site
+ *  bool edgeConflict(size_t a, size_t b, size_t c, size_t d, size_t p)
+ *      true if p violates the empty circle somewhere along the bisector of a
+ *      and b strictly between the nodes of triangles abc and bad (d may be
+ *      INFINITE for a hull edge, and c too if a and b are the whole hull
+ *      there), when neither node is in conflict itself.
+ *      b is INFINITE for the edge between two hull triangles, where a is
+ *      nearest far out, and c and d are a's neighbors along the hull (hull
+ *      on the right going from c to a to d).
+ *  bool edgeClear(size_t a, size_t b, size_t c, size_t d, size_t p)
+ *      the other way around: true if some of that bisector is clear of p
+ *      when both nodes are in conflict
+ *
+ * Each site is inserted by removing every triangle it conflicts with and
+ * connecting the boundary of that cavity to the new site. Beyond the convex
+ * hull there is one triangle per hull edge whose third vertex is INFINITE, so
+ * sites outside the hull are inserted the same way.
+ *
+ * Sites are first located by walking the triangles. When that lands on a
+ * triangle the site doesn't conflict with, which the empty circle tests of
+ * weighted and circle sites allow, the site's nearest neighbor is found by
+ * walking the neighbor graph and its triangles are tried instead. A site can
+ * also only conflict with the middle of a curved bisector, then it gets two
+ * triangles squeezed in along that edge, or conflict with both ends of one
+ * but not all of it, then the edge stays with the site on both sides.
+ *
+ * A hidden site, one that conflicts with nothing, is left out, and a site
+ * whose triangles are all removed by a later insertion drops out with them.
+ * This can't happen with plain points but does with weighted ones and with
+ * circles, where a site can be hidden by heavier or bigger neighbors. A site
+ * that conflicts with nothing but isn't hidden, or whose conflicts don't
+ * make a cavity with a single boundary, means the predicates disagree with
+ * each other, and throws Voronoi::Error rather than leaving a site out.
+ */
+template <typename Predicates>
+class Triangulation
+{
+public:
+    static const size_t INFINITE = size_t(-1);
+
+    struct Triangle
+    {
+        // counterclockwise, at most one INFINITE
+        size_t v[3];
+
+        // n[i] is the triangle across the edge opposite v[i]
+        size_t n[3];
+
+        bool dead;
+    };
+
+    Triangulation(Predicates predicates) : m_predicates(predicates), m_last(0)
+    {
+    }
+
+    /**
+     * Insert the sites in the given order, nearby sites in a row make point
+     * location cheap. If the order has to be something else, rank gives each
+     * site's place in one that keeps nearby sites together, like
+     * hilbertOrder's, and locating a site starts from the inserted site next
+     * to it there.
+     *
+     * @return false if no three sites make a face, e.g. they're all collinear
+     */
+    bool build(const std::vector<size_t>& order,
+            const std::vector<size_t>& rank = std::vector<size_t>());
+
+    // Includes dead and infinite triangles, see finite()
+    const std::vector<Triangle>& triangles() const
+    {
+        return m_triangles;
+    }
+
+    static bool finite(const Triangle& triangle)
+    {
+        return !triangle.dead && triangle.v[0] != INFINITE &&
+            triangle.v[1] != INFINITE && triangle.v[2] != INFINITE;
+    }
+
+private:
+    void insert(size_t site);
+    size_t locate(size_t site);
+    bool retry(size_t site, size_t& start);
+    size_t nearest(size_t site, size_t from);
+    void split(size_t triangle, int index, size_t site);
+    int opposite(size_t triangle, int index) const;
+    int corner(size_t triangle, size_t vertex) const;
+    void edgeSites(size_t triangle, int index, size_t (&sites)[4]) const;
+    bool keep(size_t triangle, int index, size_t site);
+    bool conflict(size_t triangle, size_t site);
+    size_t create(size_t v0, size_t v1, size_t v2);
+    void link(size_t triangle, size_t index, size_t other);
+
+    static int infiniteIndex(const Triangle& triangle)
+    {
+        for(int ii = 0; ii < 3; ii++) {
+            if(triangle.v[ii] == INFINITE)
+                return ii;
+        }
+        return -1;
+    }
+
+    Predicates m_predicates;
+    std::vector<Triangle> m_triangles;
+    std::vector<size_t> m_free;
+
+    // cavity membership, m_visit[t] == m_stamp for triangles in the cavity
+    std::vector<size_t> m_visit;
+    size_t m_stamp;
+
+    // recently created triangle to start locating from
+    size_t m_last;
+
+    // some live triangle around each site
+    std::vector<size_t> m_incident;
+};
+
+template <typename Predicates>
+const size_t Triangulation<Predicates>::INFINITE;
+
+/**
+ * Indices of points sorted along a Hilbert curve over their bounding box, an
+ * insertion order that keeps consecutive sites close together without
+ * building long thin triangles the way a plain sort by x does
+ */
+inline
+std::vector<size_t> hilbertOrder(const std::vector<Point>& points)
+{
+    const uint32_t SIDE = 1 << 16;
+    float min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+    for(size_t ii = 0; ii < points.size(); ii++) {
+        min_x = ii == 0 ? points[ii].x : std::min(min_x, points[ii].x);
+        max_x = ii == 0 ? points[ii].x : std::max(max_x, points[ii].x);
+        min_y = ii == 0 ? points[ii].y : std::min(min_y, points[ii].y);
+        max_y = ii == 0 ? points[ii].y : std::max(max_y, points[ii].y);
+    }
+    double scale = (SIDE - 1) / std::max<double>(
+            std::max(max_x - min_x, max_y - min_y), 1e-30);
+
+    std::vector<std::pair<uint64_t, size_t>> keys(points.size());
+    for(size_t ii = 0; ii < points.size(); ii++) {
+        uint32_t x = uint32_t((points[ii].x - min_x)*scale);
+        uint32_t y = uint32_t((points[ii].y - min_y)*scale);
+
+        // classic xy to Hilbert distance, rotating the quadrant each level
+        uint64_t key = 0;
+        for(uint32_t side = SIDE / 2; side > 0; side /= 2) {
+            uint32_t rx = (x & side) > 0;
+            uint32_t ry = (y & side) > 0;
+            key += uint64_t(side)*side*((3*rx) ^ ry);
+            if(ry == 0) {
+                if(rx == 1) {
+                    x = SIDE - 1 - x;
+                    y = SIDE - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        keys[ii] = std::make_pair(key, ii);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<size_t> order(points.size());
+    for(size_t ii = 0; ii < points.size(); ii++)
+        order[ii] = keys[ii].second;
+    return order;
+}
+
+template <typename Predicates>
+bool Triangulation<Predicates>::build(const std::vector<size_t>& order,
+        const std::vector<size_t>& rank)
+{
+    // Start from three sites that make a face on their own. Sites next to
+    // each other in the order are close together and usually do. Otherwise
+    // try the first site with every pair, unless the sites are all collinear
+    // and no three of them do.
+    size_t first = 0, second = 0, third = 0;
+    bool found = false;
+    auto tryFace = [&](size_t a, size_t b, size_t c) {
+        if(m_predicates.face(a, b, c)) {
+            first = a; second = b; third = c;
+            found = true;
+        } else if(m_predicates.face(a, c, b)) {
+            first = a; second = c; third = b;
+            found = true;
+        }
+    };
+    for(size_t ii = 2; ii < order.size() && !found; ii++)
+        tryFace(order[ii - 2], order[ii - 1], order[ii]);
+
+    size_t other = 1;
+    while(other < order.size() && m_predicates.coincident(order[0], order[other]))
+        other++;
+    bool collinear = true;
+    for(size_t ii = other + 1; ii < order.size() && collinear; ii++)
+        collinear = m_predicates.orient(order[0], order[other], order[ii]) == 0;
+
+    for(size_t ii = 1; ii < order.size() && !found && !collinear; ii++) {
+        for(size_t jj = ii + 1; jj < order.size() && !found; jj++)
+            tryFace(order[0], order[ii], order[jj]);
+    }
+    if(!found)
+        return false;
+
+    m_stamp = 0;
+    size_t center = create(first, second, third);
+    size_t outside[3] = {
+        create(INFINITE, third, second),
+        create(INFINITE, first, third),
+        create(INFINITE, second, first),
+    };
+    for(int ii = 0; ii < 3; ii++) {
+        link(center, ii, outside[ii]);
+        link(outside[ii], 0, center);
+
+        // INFINITE, v[1] is shared with the next hull triangle's INFINITE, v[2]
+        link(outside[ii], 2, outside[(ii + 1) % 3]);
+        link(outside[(ii + 1) % 3], 1, outside[ii]);
+    }
+    m_last = center;
+
+    // inserted sites by rank, those that dropped out since are skipped when
+    // their triangle no longer has them
+    std::map<size_t, size_t> inserted;
+    auto present = [&](size_t site) {
+        const Triangle& triangle = m_triangles[m_incident[site]];
+        return !triangle.dead && (triangle.v[0] == site ||
+                triangle.v[1] == site || triangle.v[2] == site);
+    };
+    if(!rank.empty()) {
+        for(size_t site : {first, second, third})
+            inserted[rank[site]] = site;
+    }
+
+    for(size_t site : order) {
+        if(site == first || site == second || site == third)
+            continue;
+        if(rank.empty()) {
+            insert(site);
+            continue;
+        }
+
+        auto after = inserted.lower_bound(rank[site]);
+        auto before = after;
+        while(after != inserted.end() && !present(after->second))
+            after = inserted.erase(after);
+        while(before != inserted.begin() && !present(std::prev(before)->second))
+            before = inserted.erase(std::prev(before));
+        if(before != inserted.begin() && (after == inserted.end() ||
+                    rank[site] - std::prev(before)->first < after->first - rank[site]))
+            after = std::prev(before);
+        if(after != inserted.end())
+            m_last = m_incident[after->second];
+
+        insert(site);
+        if(site < m_incident.size() && m_incident[site] != INFINITE &&
+                present(site))
+            inserted[rank[site]] = site;
+    }
+    return true;
+}
+
+template <typename Predicates>
+void Triangulation<Predicates>::insert(size_t site)
+{
+    size_t start = locate(site);
+    if(!conflict(start, site) && !retry(site, start))
+        return;
+
+    // grow the cavity across edges to conflicting triangles
+    m_stamp++;
+    m_visit.resize(m_triangles.size(), 0);
+    std::vector<size_t> cavity(1, start);
+    m_visit[start] = m_stamp;
+    for(size_t jj = 0; jj < cavity.size(); jj++) {
+        for(size_t next : m_triangles[cavity[jj]].n) {
+            if(m_visit[next] != m_stamp && conflict(next, site)) {
+                m_visit[next] = m_stamp;
+                cavity.push_back(next);
+            }
+        }
+    }
+
+    // The boundary is every edge to a triangle that stays, as (inside
+    // triangle, edge index), plus both sides of any edge inside the cavity
+    // whose bisector the site doesn't cover all of. That edge stays, with a
+    // fan triangle on each side.
+    std::vector<std::pair<size_t, int>> boundary;
+    for(size_t triangle : cavity) {
+        for(int ii = 0; ii < 3; ii++) {
+            size_t next = m_triangles[triangle].n[ii];
+            if(m_visit[next] != m_stamp) {
+                boundary.push_back(std::make_pair(triangle, ii));
+            } else if(triangle < next && keep(triangle, ii, site)) {
+                boundary.push_back(std::make_pair(triangle, ii));
+                boundary.push_back(std::make_pair(next, opposite(triangle, ii)));
+            }
+        }
+    }
+
+    // every site left is hidden by this one, and there's nothing to join it
+    // to
+    if(boundary.empty())
+        throw Voronoi::Error("site hides every other site");
+
+    // Walk the boundary: the edge after (e0, e1) is found by turning around
+    // e1 through the cavity until reaching a boundary edge. Going by the
+    // triangles rather than the vertex ids copes with a boundary that passes
+    // a vertex more than once. A cavity that wraps around a triangle that
+    // stays has a boundary in several pieces, and can't be filled with a fan.
+    std::vector<size_t> following(boundary.size());
+    for(size_t ii = 0; ii < boundary.size(); ii++) {
+        size_t current = boundary[ii].first;
+        size_t e1 = m_triangles[current].v[(boundary[ii].second + 2) % 3];
+        for(size_t steps = 0; ; steps++) {
+            if(steps > cavity.size())
+                throw Voronoi::Error("cavity of a site has a broken boundary");
+
+            const Triangle& triangle = m_triangles[current];
+            int index = (corner(current, e1) + 2) % 3;
+            auto found = std::find(boundary.begin(), boundary.end(),
+                    std::make_pair(current, index));
+            if(found != boundary.end()) {
+                following[ii] = found - boundary.begin();
+                break;
+            }
+            current = triangle.n[index];
+        }
+    }
+    size_t length = 1;
+    for(size_t ii = following[0]; ii != 0 && length <= boundary.size(); ii = following[ii])
+        length++;
+    if(length != boundary.size())
+        throw Voronoi::Error("cavity of a site has more than one boundary");
+
+    // Fan from the site to every boundary edge. created[ii] is the triangle
+    // (site, e0, e1) built on the ii'th boundary edge.
+    std::vector<size_t> created;
+    for(const auto& edge : boundary) {
+        const Triangle& inside = m_triangles[edge.first];
+        created.push_back(create(site, inside.v[(edge.second + 1) % 3],
+                    inside.v[(edge.second + 2) % 3]));
+    }
+
+    for(size_t ii = 0; ii < boundary.size(); ii++) {
+        // across the edge: the triangle that stays, or the fan triangle on
+        // the other side of an edge that stays
+        size_t other = m_triangles[boundary[ii].first].n[boundary[ii].second];
+        if(m_visit[other] != m_stamp) {
+            size_t other_index = opposite(boundary[ii].first, boundary[ii].second);
+            link(created[ii], 0, other);
+            link(other, other_index, created[ii]);
+        } else {
+            auto found = std::find(boundary.begin(), boundary.end(),
+                    std::make_pair(other, opposite(boundary[ii].first,
+                            boundary[ii].second)));
+            link(created[ii], 0, created[found - boundary.begin()]);
+        }
+
+        // around the site: the edge (e1, site) of one fan triangle is the
+        // edge (site, e0) of the next
+        link(created[ii], 1, created[following[ii]]);
+        link(created[following[ii]], 2, created[ii]);
+    }
+
+    for(size_t triangle : cavity) {
+        m_triangles[triangle].dead = true;
+        m_free.push_back(triangle);
+    }
+    m_last = created.front();
+}
+
+// Index of the edge in the neighbor across edge index of triangle
+template <typename Predicates>
+int Triangulation<Predicates>::opposite(size_t triangle, int index) const
+{
+    const Triangle& inside = m_triangles[triangle];
+    const Triangle& other = m_triangles[inside.n[index]];
+    size_t e0 = inside.v[(index + 1) % 3];
+    size_t e1 = inside.v[(index + 2) % 3];
+    for(int other_index = 0; other_index < 3; other_index++) {
+        if(other.v[(other_index + 1) % 3] == e1 &&
+                other.v[(other_index + 2) % 3] == e0)
+            return other_index;
+    }
+    throw Voronoi::Error("triangles don't share the edge between them");
+}
+
+// Index of vertex in triangle
+template <typename Predicates>
+int Triangulation<Predicates>::corner(size_t triangle, size_t vertex) const
+{
+    for(int ii = 0; ii < 3; ii++) {
+        if(m_triangles[triangle].v[ii] == vertex)
+            return ii;
+    }
+    throw Voronoi::Error("triangle around a site doesn't have the site");
+}
+
+// Sites of the edge opposite v[index] of triangle as edgeConflict and
+// edgeClear take them
+template <typename Predicates>
+void Triangulation<Predicates>::edgeSites(size_t triangle, int index,
+        size_t (&sites)[4]) const
+{
+    const Triangle& inside = m_triangles[triangle];
+    const Triangle& other = m_triangles[inside.n[index]];
+    size_t a = inside.v[(index + 1) % 3];
+    size_t b = inside.v[(index + 2) % 3];
+    size_t c = inside.v[index];
+    size_t d = other.v[opposite(triangle, index)];
+
+    // an edge to INFINITE is between hull triangles (INFINITE, c, a) and
+    // (INFINITE, a, d)
+    if(a == INFINITE || (c == INFINITE && d != INFINITE)) {
+        std::swap(a, b);
+        std::swap(c, d);
+    }
+    sites[0] = a;
+    sites[1] = b;
+    sites[2] = c;
+    sites[3] = d;
+}
+
+// True if the edge between two triangles in conflict with site should stay
+template <typename Predicates>
+bool Triangulation<Predicates>::keep(size_t triangle, int index, size_t site)
+{
+    size_t sites[4];
+    edgeSites(triangle, index, sites);
+    return m_predicates.edgeClear(sites[0], sites[1], sites[2], sites[3],
+            site);
+}
+
+/**
+ * Find a triangle in conflict with site among the triangles around its
+ * nearest neighbor. Failing that, squeeze the site in along one of the
+ * neighbor's edges if it conflicts with the middle of it.
+ *
+ * @return true if start was set to a conflicting triangle, false if the site
+ * was inserted along an edge or is hidden
+ */
+template <typename Predicates>
+bool Triangulation<Predicates>::retry(size_t site, size_t& start)
+{
+    const Triangle& located = m_triangles[start];
+    size_t from = located.v[0] != INFINITE ? located.v[0] : located.v[1];
+    size_t near = nearest(site, from);
+
+    std::vector<std::pair<size_t, int>> edges;
+    size_t current = m_incident[near];
+    do {
+        const Triangle& triangle = m_triangles[current];
+        int kk = corner(current, near);
+        if(conflict(current, site)) {
+            start = current;
+            return true;
+        }
+
+        // edge (near, v[kk + 1]) is opposite v[kk + 2]
+        edges.push_back(std::make_pair(current, (kk + 2) % 3));
+        current = triangle.n[(kk + 1) % 3];
+    } while(current != m_incident[near]);
+
+    for(const auto& edge : edges) {
+        size_t sites[4];
+        edgeSites(edge.first, edge.second, sites);
+        if(m_predicates.edgeConflict(sites[0], sites[1], sites[2], sites[3],
+                    site)) {
+            split(edge.first, edge.second, site);
+            return false;
+        }
+    }
+
+    if(!m_predicates.hidden(site, near))
+        throw Voronoi::Error("site that isn't hidden conflicts with nothing");
+    return false;
+}
+
+// Greedy walk over the neighbor graph towards the site nearest to site
+template <typename Predicates>
+size_t Triangulation<Predicates>::nearest(size_t site, size_t from)
+{
+    size_t best = from;
+    double best_distance = m_predicates.distance(from, site);
+    bool moved = true;
+    while(moved) {
+        moved = false;
+        size_t current = m_incident[best];
+        size_t center = best;
+        do {
+            const Triangle& triangle = m_triangles[current];
+            int kk = corner(current, center);
+
+            size_t neighbor = triangle.v[(kk + 1) % 3];
+            if(neighbor != INFINITE) {
+                double distance = m_predicates.distance(neighbor, site);
+                if(distance < best_distance) {
+                    best = neighbor;
+                    best_distance = distance;
+                    moved = true;
+                }
+            }
+            current = triangle.n[(kk + 1) % 3];
+        } while(current != m_incident[center]);
+    }
+    return best;
+}
+
+/**
+ * Insert site in the middle of the edge opposite v[index] of triangle: the
+ * edge becomes two, with a triangle on each side joining them to site
+ */
+template <typename Predicates>
+void Triangulation<Predicates>::split(size_t triangle, int index, size_t site)
+{
+    size_t e0 = m_triangles[triangle].v[(index + 1) % 3];
+    size_t e1 = m_triangles[triangle].v[(index + 2) % 3];
+    size_t other = m_triangles[triangle].n[index];
+    int other_index = opposite(triangle, index);
+
+    size_t inside = create(site, e1, e0);
+    size_t outside = create(site, e0, e1);
+    link(inside, 0, triangle);
+    link(triangle, index, inside);
+    link(outside, 0, other);
+    link(other, other_index, outside);
+    link(inside, 1, outside);
+    link(inside, 2, outside);
+    link(outside, 1, inside);
+    link(outside, 2, inside);
+    m_last = inside;
+}
+
+template <typename Predicates>
+size_t Triangulation<Predicates>::locate(size_t site)
+{
+    // walk towards the site, crossing any edge that has it on the far side
+    size_t current = m_last;
+    for(size_t steps = 0; steps < m_triangles.size(); steps++) {
+        const Triangle& triangle = m_triangles[current];
+        int inf = infiniteIndex(triangle);
+        if(inf >= 0) {
+            size_t a = triangle.v[(inf + 1) % 3];
+            size_t b = triangle.v[(inf + 2) % 3];
+            if(m_predicates.orient(a, b, site) > 0)
+                return current;
+            current = triangle.n[inf];
+            continue;
+        }
+
+        // start from a different edge each step so degenerate walks can't
+        // cycle forever
+        size_t next = current;
+        for(int jj = 0; jj < 3; jj++) {
+            int ii = (jj + steps) % 3;
+            if(m_predicates.orient(triangle.v[(ii + 1) % 3],
+                        triangle.v[(ii + 2) % 3], site) < 0) {
+                next = triangle.n[ii];
+                break;
+            }
+        }
+        if(next == current)
+            return current;
+        current = next;
+    }
+
+    // the walk got stuck, look at everything
+    for(size_t ii = 0; ii < m_triangles.size(); ii++) {
+        const Triangle& triangle = m_triangles[ii];
+        if(triangle.dead)
+            continue;
+
+        int inf = infiniteIndex(triangle);
+        if(inf >= 0) {
+            if(m_predicates.orient(triangle.v[(inf + 1) % 3],
+                        triangle.v[(inf + 2) % 3], site) > 0)
+                return ii;
+        } else if(m_predicates.orient(triangle.v[0], triangle.v[1], site) >= 0 &&
+                m_predicates.orient(triangle.v[1], triangle.v[2], site) >= 0 &&
+                m_predicates.orient(triangle.v[2], triangle.v[0], site) >= 0) {
+            return ii;
+        }
+    }
+    return m_last;
+}
+
+template <typename Predicates>
+bool Triangulation<Predicates>::conflict(size_t index, size_t site)
+{
+    const Triangle& triangle = m_triangles[index];
+    int inf = infiniteIndex(triangle);
+    if(inf < 0) {
+        return m_predicates.conflict(triangle.v[0], triangle.v[1],
+                triangle.v[2], site);
+    }
+
+    // beyond the hull edge, or on it when the triangle inside is in conflict
+    size_t a = triangle.v[(inf + 1) % 3];
+    size_t b = triangle.v[(inf + 2) % 3];
+    double side = m_predicates.beyond(a, b, site);
+    if(side != 0)
+        return side > 0;
+
+    const Triangle& inside = m_triangles[triangle.n[inf]];
+    return m_predicates.conflict(inside.v[0], inside.v[1], inside.v[2], site);
+}
+
+template <typename Predicates>
+size_t Triangulation<Predicates>::create(size_t v0, size_t v1, size_t v2)
+{
+    Triangle triangle;
+    triangle.v[0] = v0;
+    triangle.v[1] = v1;
+    triangle.v[2] = v2;
+    triangle.n[0] = triangle.n[1] = triangle.n[2] = INFINITE;
+    triangle.dead = false;
+
+    size_t index = m_triangles.size();
+    if(!m_free.empty()) {
+        index = m_free.back();
+        m_free.pop_back();
+        m_triangles[index] = triangle;
+    } else {
+        m_triangles.push_back(triangle);
+    }
+
+    for(size_t vertex : triangle.v) {
+        if(vertex == INFINITE)
+            continue;
+        if(vertex >= m_incident.size())
+            m_incident.resize(vertex + 1, INFINITE);
+        m_incident[vertex] = index;
+    }
+    return index;
+}
+
+template <typename Predicates>
+void Triangulation<Predicates>::link(size_t triangle, size_t index,
+        size_t other)
+{
+    m_triangles[triangle].n[index] = other;
+}
+
+namespace detail
+{
+
+inline
+Voronoi::Edge::Ptr connect(Voronoi::Node::Ptr nodeA, Voronoi::Node::Ptr nodeB)
+{
+    auto edge = std::make_shared<Voronoi::Edge>();
+    std::set_intersection(
+            nodeA->parents.begin(), nodeA->parents.end(),
+            nodeB->parents.begin(), nodeB->parents.end(),
+            std::inserter(edge->parents, edge->parents.begin()));
+    edge->nodes[0] = nodeA;
+    edge->nodes[1] = nodeB;
+
+    nodeA->edges.insert(edge);
+    nodeB->edges.insert(edge);
+    nodeA->neighbors.insert(nodeB);
+    nodeB->neighbors.insert(nodeA);
+    return edge;
+}
+
+// position of node along direction (dx, dy), relative to from
+inline
+double along(const Voronoi::Node::Ptr& node, const Voronoi::Node::Ptr& from,
+        double dx, double dy)
+{
+    return (double(node->x) - from->x)*dx + (double(node->y) - from->y)*dy;
+}
+
+}
+
+/**
+ * Fill nodes and edges with the diagram dual to a finished triangulation, in
+ * the same form the sweep produces.
+ *
+ * center(const size_t (&sites)[3]) makes the node of a finite triangle and
+ * pair(a, b) the node where the bisector of a and b crosses the segment
+ * between them, positions[] are the site positions. Each triangulation edge
+ * is a bisector between its two triangles' nodes, or a ray out of the hull.
+ * Like the sweep, the pair node is kept when it lies between the two, and
+ * marks the end of rays. A bisector between two hull triangles, with no node
+ * at either end, is just its pair node without edges, as for sites that are
+ * all collinear.
+ */
+template <typename Predicates, typename CenterFunc, typename PairFunc>
+void dualGraph(const Triangulation<Predicates>& triangulation,
+        const std::vector<Point>& positions, CenterFunc center, PairFunc pair,
+        std::vector<Voronoi::Node::Ptr>& nodes,
+        std::vector<Voronoi::Edge::Ptr>& edges)
+{
+    using detail::connect;
+    using detail::along;
+
+    const auto& triangles = triangulation.triangles();
+    std::vector<Voronoi::Node::Ptr> centers(triangles.size());
+    for(size_t ii = 0; ii < triangles.size(); ii++) {
+        if(Triangulation<Predicates>::finite(triangles[ii])) {
+            centers[ii] = center(triangles[ii].v);
+            nodes.push_back(centers[ii]);
+        }
+    }
+
+    for(size_t ii = 0; ii < triangles.size(); ii++) {
+        const auto& triangle = triangles[ii];
+        if(!centers[ii]) {
+            int inf = Triangulation<Predicates>::INFINITE == triangle.v[0] ? 0 :
+                Triangulation<Predicates>::INFINITE == triangle.v[1] ? 1 : 2;
+            size_t a = triangle.v[(inf + 1) % 3];
+            size_t b = triangle.v[(inf + 2) % 3];
+            if(!triangle.dead && !centers[triangle.n[inf]] && a < b)
+                nodes.push_back(pair(a, b));
+            continue;
+        }
+
+        for(int jj = 0; jj < 3; jj++) {
+            size_t a = triangle.v[(jj + 1) % 3];
+            size_t b = triangle.v[(jj + 2) % 3];
+            size_t other = triangle.n[jj];
+            if(centers[other] && other < ii)
+                continue;
+
+            auto middle = pair(a, b);
+            if(!centers[other]) {
+                nodes.push_back(middle);
+                edges.push_back(connect(centers[ii], middle));
+                continue;
+            }
+
+            // direction of the bisector, perpendicular to the pair's segment
+            double dx = double(positions[a].y) - positions[b].y;
+            double dy = double(positions[b].x) - positions[a].x;
+            double here = along(centers[ii], middle, dx, dy);
+            double there = along(centers[other], middle, dx, dy);
+            if((here <= 0 && there >= 0) || (here >= 0 && there <= 0)) {
+                nodes.push_back(middle);
+                edges.push_back(connect(centers[ii], middle));
+                edges.push_back(connect(middle, centers[other]));
+            } else {
+                edges.push_back(connect(centers[ii], centers[other]));
+            }
+        }
+    }
+
+    for(const auto& edge : edges) {
+        for(const auto& neighbor : edge->nodes[0]->edges) {
+            if(neighbor != edge)
+                edge->neighbors.insert(neighbor);
+        }
+        for(const auto& neighbor : edge->nodes[1]->edges) {
+            if(neighbor != edge)
+                edge->neighbors.insert(neighbor);
+        }
+    }
+}
@@ -2,25 +2,57 @@
 #include "debug.h"
 
 #include <unordered_map>
+#include <atomic>
 #include <cmath>
 #include <iterator>
+#include <string>
 
 #include "std_ext.h"
 #include "geometry.h"
+#include "btree_set.h"
+#include "parallel.h"
+#include "event_log.h"
+#include "fixed_point.h"
+
+// Unlike assert this is checked in every build, and fails with an exception
+// the caller can recover from instead of aborting its process
+#define VORONOI_CHECK(cond) \
+    do { \
+        if(!(cond)) \
+            throw Voronoi::Error("voronoi.cpp:" + std::to_string(__LINE__) + \
+                    ": " #cond); \
+    } while(0)
 
 // Types
 struct Intersection;
 struct BeachCompare;
-struct Circle;
-typedef std::set<Intersection, BeachCompare> BeachLineT;
+typedef BTreeSet<Intersection, BeachCompare> BeachLineT;
+
+// Events and sites this close in height, relative to the size of the input,
+// may be handled in either order. That's where an event takes out several
+// arcs at once or a site lands on a breakpoint, and rounding decides which
+// goes first.
+const double COINCIDENT = 1e-6;
+
+// Below this many circle events the graph is built on the calling thread
+const size_t PARALLEL_TRIPLETS = 4096;
+
+// nodes are built this many at a time, so that fixed point output converts
+// a chunk's positions straight after computing them
+const size_t NODE_CHUNK = 1024;
 
 // Helper Functions
 Circle solveCircle(const Point& p, const Point& q, const Point& r);
+double circleBottom(const Point& p, const Point& q, const Point& r);
 Point getIntersection(float sweep_y, const Intersection& inter);
 Point getIntersection(float sweep_y, const Point& p, const Point& r, float sign);
 Point getIntersection(float sweep_y, const Point& p, double x);
+int compareBreakpoint(double x, float sweep_y, const Intersection& inter);
+int compareBreakpoints(float sweep_y, const Intersection& lhs,
+        const Intersection& rhs);
 float getSign(const Intersection& intersection);
 double sqr(double v);
+double breakpointX(float sweep_y, const Intersection& inter);
 
 inline
 float perp(const Point& pt, const Point& v0, const Point& v1)
@@ -46,12 +78,6 @@ void orderPoints(const Point*& ptA, const Point*& ptB,
 
 
 // Helper Structures
-struct Circle
-{
-    Point center;
-    float radius;
-};
-
 struct Intersection
 {
     Intersection(const Point* pt_left, const Point* pt_right) :
@@ -98,18 +124,18 @@ struct BeachCompare
         // is missing (nullptr), there is no intersection (or intersection is at
         // positive or negative infinity, if right or left point is nullptr,
         // respectively)
-        std::cerr << "<<<Comparing: ("
+        DEBUG_LOG("<<<Comparing: ("
             << lhs.pt_left << ", " << lhs.pt_right << ", " << ") to ("
-            << rhs.pt_left << ", " << rhs.pt_right << ", " << ")" << std::endl;
+            << rhs.pt_left << ", " << rhs.pt_right << ", " << ")" << std::endl);
         if(lhs.pt_left)
-            std::cerr << "<<<Left Point 0: " << *lhs.pt_left << std::endl;
+            DEBUG_LOG("<<<Left Point 0: " << *lhs.pt_left << std::endl);
         if(lhs.pt_right)
-            std::cerr << "<<<Left Point 1: " << *lhs.pt_right << std::endl;
+            DEBUG_LOG("<<<Left Point 1: " << *lhs.pt_right << std::endl);
         if(rhs.pt_left)
-            std::cerr << "<<<Right Point 0: " << *rhs.pt_left << std::endl;
+            DEBUG_LOG("<<<Right Point 0: " << *rhs.pt_left << std::endl);
         if(rhs.pt_right)
-            std::cerr << "<<<Right Point 1: " << *rhs.pt_right << std::endl;
-        std::cerr << "<<<Using sweep = " << *sweep_y << std::endl;
+            DEBUG_LOG("<<<Right Point 1: " << *rhs.pt_right << std::endl);
+        DEBUG_LOG("<<<Using sweep = " << *sweep_y << std::endl);
         bool lhs_n_infinite = lhs.pt_left == nullptr;
         bool lhs_p_infinite = lhs.pt_right == nullptr;
         bool rhs_n_infinite = rhs.pt_left == nullptr;
@@ -141,31 +167,24 @@ struct BeachCompare
         } else if(lhs.pt_left == lhs.pt_right) {
             // Special case, intersection of two identical points is assumed to
             // be just the x value of the double-point intersection
-            assert(rhs.pt_left != rhs.pt_right);
-            assert(!(lhs_n_infinite || lhs_p_infinite || rhs_n_infinite ||
+            VORONOI_CHECK(rhs.pt_left != rhs.pt_right);
+            VORONOI_CHECK(!(lhs_n_infinite || lhs_p_infinite || rhs_n_infinite ||
                         rhs_p_infinite));
-            Point right = getIntersection(*sweep_y, rhs);
-            result = lhs.pt_left->x < right.x;
+            result = compareBreakpoint(lhs.pt_left->x, *sweep_y, rhs) < 0;
         } else if(rhs.pt_left == rhs.pt_right) {
             // Special case, intersection of two identical points is assumed to
             // be just the x value of the double-point intersection
-            assert(lhs.pt_left != lhs.pt_right);
-            assert(!(lhs_n_infinite || lhs_p_infinite || rhs_n_infinite ||
+            VORONOI_CHECK(lhs.pt_left != lhs.pt_right);
+            VORONOI_CHECK(!(lhs_n_infinite || lhs_p_infinite || rhs_n_infinite ||
                         rhs_p_infinite));
-            Point left  = getIntersection(*sweep_y, lhs);
-            result = left.x < rhs.pt_left->x;
+            result = compareBreakpoint(rhs.pt_left->x, *sweep_y, lhs) > 0;
         } else {
-            // get intersection of left two parabolas, and compare x with
-            // intersection of right two
-            assert(!(lhs_n_infinite || lhs_p_infinite || rhs_n_infinite || rhs_p_infinite));
-            std::cerr << "<<<Computing intersections" << std::endl;
-            Point left  = getIntersection(*sweep_y, lhs);
-            Point right = getIntersection(*sweep_y, rhs);
-            std::cerr << "<<<" << (left.x < right.x) << std::endl;
-            result = left.x < right.x;
+            // order of two proper breakpoints, neither needs solving
+            VORONOI_CHECK(!(lhs_n_infinite || lhs_p_infinite || rhs_n_infinite || rhs_p_infinite));
+            result = compareBreakpoints(*sweep_y, lhs, rhs) < 0;
         }
 
-        std::cerr << "<<<" << result << std::endl;
+        DEBUG_LOG("<<<" << result << std::endl);
         return result;
     }
 };
@@ -177,10 +196,18 @@ struct CircleEvent
     Intersection right_int;
     Circle circle;
 
+    // height of the bottom of the circle, where the sweep meets it
+    double y;
+
+    // by height, events at the same height by their sites so that they're
+    // all kept
     bool operator<(const CircleEvent& rhs) const
     {
-        return circle.center.y - circle.radius <
-            rhs.circle.center.y - rhs.circle.radius;
+        if(y != rhs.y)
+            return y < rhs.y;
+        return std::make_tuple(left_int.pt_left, left_int.pt_right,
+                right_int.pt_right) < std::make_tuple(rhs.left_int.pt_left,
+                rhs.left_int.pt_right, rhs.right_int.pt_right);
     }
 };
 
@@ -188,6 +215,18 @@ struct CircleEvent
 class CircleQueue
 {
 public:
+    // The breakpoints either side of the middle arc only meet if the sites
+    // turn clockwise, otherwise they move apart. Differences of floats and
+    // their products are exact in double, so only the final subtraction
+    // rounds and the sign is exact. Meeting breakpoints meet below the
+    // sweep, so no height check is needed either.
+    static bool converges(const Point& ptA, const Point& ptB, const Point& ptC)
+    {
+        double cross = (double(ptB.x) - ptA.x)*(double(ptC.y) - ptB.y) -
+            (double(ptB.y) - ptA.y)*(double(ptC.x) - ptB.x);
+        return cross < 0;
+    }
+
     bool empty() const
     {
         return m_queue.empty();
@@ -198,6 +237,11 @@ public:
         return m_queue.size();
     }
 
+    void clear()
+    {
+        m_queue.clear();
+    }
+
     const CircleEvent& front() const
     {
         auto it = m_queue.begin();
@@ -224,7 +268,7 @@ public:
         m_queue.erase(it);
     };
 
-    void insert(double sweep_y, const Intersection& left_int, const Intersection& right_int)
+    void insert(const Intersection& left_int, const Intersection& right_int)
     {
         if(left_int.pt_left == nullptr) return;
         if(right_int.pt_right == nullptr) return;
@@ -236,50 +280,32 @@ public:
             return;
         }
 
-        std::cerr << "<<<Inserting Event: ("
+        DEBUG_LOG("<<<Inserting Event: ("
             << left_int.pt_left << ", " << left_int.pt_right << ") and ("
             << right_int.pt_left << ", " << right_int.pt_right << ")"
-            << std::endl;
-        assert(left_int.pt_left);
-        assert(left_int.pt_right);
-        assert(right_int.pt_left);
-        assert(right_int.pt_right);
-        std::cerr << "<<<Left Point 0: " << *left_int.pt_left << std::endl;
-        std::cerr << "<<<Left Point 1: " << *left_int.pt_right << std::endl;
-        std::cerr << "<<<Right Point 0: " << *right_int.pt_left << std::endl;
-        std::cerr << "<<<Right Point 1: " << *right_int.pt_right << std::endl;
+            << std::endl);
+        VORONOI_CHECK(left_int.pt_left);
+        VORONOI_CHECK(left_int.pt_right);
+        VORONOI_CHECK(right_int.pt_left);
+        VORONOI_CHECK(right_int.pt_right);
+        DEBUG_LOG("<<<Left Point 0: " << *left_int.pt_left << std::endl);
+        DEBUG_LOG("<<<Left Point 1: " << *left_int.pt_right << std::endl);
+        DEBUG_LOG("<<<Right Point 0: " << *right_int.pt_left << std::endl);
+        DEBUG_LOG("<<<Right Point 1: " << *right_int.pt_right << std::endl);
 
         //assert(left_int.pt_right == right_int.pt_left);
         auto ptA = left_int.pt_left;
         auto ptB = left_int.pt_right;
         auto ptC = right_int.pt_right;
 
+        if(!converges(*ptA, *ptB, *ptC))
+            return;
+
         CircleEvent evt;
         evt.circle = solveCircle(*ptA, *ptB, *ptC);
+        evt.y = circleBottom(*ptA, *ptB, *ptC);
         evt.left_int = left_int;
         evt.right_int = right_int;
-
-        // if this is going to happen behind the current sweep, then don't
-        // insert. This is effectively a new event behind the beach
-        if(evt.circle.center.y - evt.circle.radius > sweep_y)
-            return;
-
-        // There can only be 1 circle point for 3 points, ensure that these two
-        // intersection actually meet at the circle, othwise don't creat the
-        // event
-        auto left_int_pt = getIntersection(
-                evt.circle.center.y - evt.circle.radius, left_int);
-        auto right_int_pt = getIntersection(
-                evt.circle.center.y - evt.circle.radius, left_int);
-        double d1 = distance2d(left_int_pt, evt.circle.center);
-        double d2 = distance2d(right_int_pt, evt.circle.center);
-        if(d1 > evt.circle.radius|| d2 > evt.circle.radius) {
-            // the intersections should essentially be at the center of the
-            // center of the circle. In diverging intersections the distances
-            // from the center to intersections will far exceed the radius of
-            // the circle.
-            return;
-        }
         m_queue.insert(evt);
     }
 
@@ -290,26 +316,22 @@ public:
         const Point* ptA = left_int.pt_left;
         const Point* ptB = left_int.pt_right;
         const Point* ptC = right_int.pt_right;
-        assert(ptB != nullptr);
+        VORONOI_CHECK(ptB != nullptr);
 
         // no event to erase since one of the "intersections" is the null
-        // intersection
-        if(ptA == nullptr || ptC == nullptr)
+        // intersection, or there are only two sites or the breakpoints move
+        // apart (insert makes no event for those, and the circle of sites in
+        // a line is all NaN, which would match any event)
+        if(ptA == nullptr || ptC == nullptr || ptA == ptC ||
+                !converges(*ptA, *ptB, *ptC))
             return;
 
+        // the circle comes out the same as when the event was inserted
         dummy.circle = solveCircle(*ptA, *ptB, *ptC);
-        float end_y = dummy.circle.center.y - dummy.circle.radius;
-
-        for(auto it = m_queue.lower_bound(dummy); it != m_queue.end() &&
-                !(it->circle.center.y - it->circle.radius < end_y); ++it) {
-            if(left_int.pt_left == it->left_int.pt_left &&
-                    left_int.pt_right == it->left_int.pt_right &&
-                    right_int.pt_left == it->right_int.pt_left &&
-                    right_int.pt_right == it->right_int.pt_right) {
-                it = m_queue.erase(it);
-                break;
-            }
-        }
+        dummy.y = circleBottom(*ptA, *ptB, *ptC);
+        dummy.left_int = left_int;
+        dummy.right_int = right_int;
+        m_queue.erase(dummy);
     }
 
     typedef std::set<CircleEvent>::iterator iterator;
@@ -330,43 +352,80 @@ class Voronoi::Implementation
 {
     public:
     Implementation() : m_beach_compare(&sweep_y), m_beach(m_beach_compare),
+        m_record(nullptr),
         m_min_x(std::numeric_limits<double>::infinity()),
         m_max_x(-std::numeric_limits<double>::infinity()),
         m_min_y(std::numeric_limits<double>::infinity()),
-        m_max_y(-std::numeric_limits<double>::infinity())
+        m_max_y(-std::numeric_limits<double>::infinity()),
+        m_coincident(0)
     {
     }
 
-    void compute(const std::vector<Point>& points);
+    // Empty the sweep state for another diagram, the log of circle events
+    // and the order of the points keep their storage
+    void reset();
+
+    void compute(const std::vector<Point>& points, PerfCounters& counters,
+            Stats& stats);
+
+    // Handle the events of a recorded log in its order instead
+    void replay(const EventLog& log, PerfCounters& counters, Stats& stats);
+
+    // Append the events handled from here on to log
+    void record(EventLog* log)
+    {
+        m_record = log;
+    }
+
+    // Build the nodes and edges from the log once the sweep is done, on
+    // threads as for Options::threads, and write the node positions to
+    // fixed if it's set
+    void materialize(std::vector<Node::Ptr>& nodes,
+            std::vector<Edge::Ptr>& edges, size_t threads,
+            const FixedOutput* fixed) const;
 
     private:
+    // A circle event's three sites, in the order of their arcs on the beach
+    // line, and its circle. The sweep only appends these, everything else
+    // about the diagram follows from them.
+    struct Triplet
+    {
+        uint32_t sites[3];
+        Circle circle;
+    };
+
     void processPoint(const Point& pt);
     void processEvent(const CircleEvent& event);
 
-    Node::Ptr getNode(const Point* ptA, const Point* ptB);
-    Node::Ptr getNode(const Point* ptA, const Point* ptB, const Point* ptC);
+    // Find inter on the beach line, or end() if it isn't there
+    BeachLineT::iterator locate(const Intersection& inter) const;
 
-    std::shared_ptr<Edge> addEdge(
-            Node::Ptr nodeA,
-            Node::Ptr nodeB);
+    // Throws unless lhs comes no later than rhs on the beach line
+    void checkOrder(const Intersection& lhs, const Intersection& rhs) const;
 
-    void addTriplet(Node::Ptr center,
-            Node::Ptr nodeA,
-            Node::Ptr nodeB,
-            Node::Ptr nodeC);
+    // Extent of the points and the tolerance that follows from it
+    void setBounds(const std::vector<Point>& points);
+
+    // Append the event about to be handled to m_record, if set
+    void recordPoint(const Point& pt);
+    void recordEvent(const CircleEvent& event);
 
     float sweep_y;
     BeachCompare m_beach_compare;
     BeachLineT m_beach;
     CircleQueue m_events;
+    EventLog* m_record;
 
     double m_min_x, m_max_x, m_min_y, m_max_y;
+    // how far apart breakpoints that coincide can come out, see COINCIDENT
+    double m_coincident;
 
-    std::unordered_map<std::tuple<const Point*, const Point*, const Point*>,
-        Node::Ptr> m_nodes;
-    std::vector<Edge::Ptr> m_edges;
+    std::vector<Triplet> m_log;
     const std::vector<Point>* m_points;
 
+    // indices of the points by decreasing y
+    std::vector<size_t> m_order;
+
 	friend Voronoi;
 };
 
@@ -462,7 +521,7 @@ bool points_match(std::tuple<const Point*, const Point*, const Point*> lhs,
  */
 float getSign(const Intersection& intersection)
 {
-    assert(intersection.pt_left && intersection.pt_right);
+    VORONOI_CHECK(intersection.pt_left && intersection.pt_right);
 
     const Point& left_parab = *intersection.pt_left;
     const Point& right_parab = *intersection.pt_right;
@@ -479,10 +538,182 @@ float getSign(const Intersection& intersection)
     }
 }
 
+/**
+ * Side of the breakpoint between the arcs of inter that x is on: -1 left, 0
+ * on it, 1 right, decided without solving for the breakpoint.
+ *
+ * With p the left parabola, r the right one and a, b the heights of their
+ * foci above the sweep, the difference of the parabolas times 2ab is
+ *
+ * g(x) = b (x - p.x)^2 - a (x - r.x)^2 + ab (p.y - r.y)
+ *
+ * which is negative where p is lower. Moving right the beach line leaves p
+ * for r where g turns positive, so the breakpoint is the root where g is
+ * increasing (the same root getIntersection picks with getSign). Whether x is
+ * left of it follows from the signs of g(x) and g'(x) alone, so there are no
+ * square roots or divisions and the only rounding is in the products.
+ */
+int compareBreakpoint(double x, float sweep_y, const Intersection& inter)
+{
+    VORONOI_CHECK(inter.pt_left != nullptr);
+    VORONOI_CHECK(inter.pt_right != nullptr);
+    const Point& p = *inter.pt_left;
+    const Point& r = *inter.pt_right;
+    auto compare = [](double lhs, double rhs) {
+        return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+    };
+
+    // same special cases as getIntersection, the breakpoint is straight
+    // below a focus on the sweep or halfway between foci at equal heights
+    if(std::abs(p.y - sweep_y) < 0.0000001)
+        return compare(x, p.x);
+    if(std::abs(r.y - sweep_y) < 0.0000001)
+        return compare(x, r.x);
+    if(std::abs(p.y - r.y) <= 0.0000001)
+        return compare(2*x, double(p.x) + r.x);
+
+    double a = double(p.y) - sweep_y;
+    double b = double(r.y) - sweep_y;
+    double dp = x - p.x;
+    double dr = x - r.x;
+    double g = b*dp*dp - a*dr*dr + a*b*(double(p.y) - r.y);
+    double slope = b*dp - a*dr;
+
+    // g crosses zero increasing at the breakpoint and decreasing at the
+    // other root. With the focus of p lower g opens upwards and the
+    // breakpoint is the right root, otherwise it opens downwards and it's
+    // the left one.
+    if(g == 0 && slope >= 0)
+        return 0;
+    if(getSign(inter) > 0)
+        return g < 0 || slope < 0 ? -1 : 1;
+    return g < 0 && slope > 0 ? -1 : 1;
+}
+
+namespace
+{
+
+// The polynomial g of compareBreakpoint as A x^2 + B x + C, or the breakpoint
+// itself where that is rational
+struct Breakpoint
+{
+    bool rational;
+    double x;
+    double A, B, C;
+};
+
+Breakpoint breakpointPolynomial(float sweep_y, const Intersection& inter)
+{
+    const Point& p = *inter.pt_left;
+    const Point& r = *inter.pt_right;
+    Breakpoint result{true, 0, 0, 0, 0};
+    if(std::abs(p.y - sweep_y) < 0.0000001) {
+        result.x = p.x;
+    } else if(std::abs(r.y - sweep_y) < 0.0000001) {
+        result.x = r.x;
+    } else if(std::abs(p.y - r.y) <= 0.0000001) {
+        result.x = (double(p.x) + r.x)*0.5;
+    } else {
+        double a = double(p.y) - sweep_y;
+        double b = double(r.y) - sweep_y;
+        result.rational = false;
+        result.A = b - a;
+        result.B = 2*(a*r.x - b*p.x);
+        result.C = b*p.x*p.x - a*r.x*r.x + a*b*(double(p.y) - r.y);
+    }
+    return result;
+}
+
+int sign(double v)
+{
+    return v < 0 ? -1 : (v > 0 ? 1 : 0);
+}
+
+// Sign of u + v sqrt(d), d >= 0. When the two terms have opposite signs it
+// compares their squares in double, which rounds, so it can come out wrong
+// or 0 when they're nearly equal
+int signWithRoot(double u, double v, double d)
+{
+    int su = sign(u);
+    int sv = d > 0 ? sign(v) : 0;
+    if(sv == 0)
+        return su;
+    if(su == 0 || su == sv)
+        return sv;
+
+    // opposite signs, the larger magnitude wins
+    return sign(u*u - v*v*d)*su;
+}
+
+}
+
+/**
+ * Order of two breakpoints at the sweep, the sign of the first's x minus the
+ * second's, again without solving for either.
+ *
+ * With g = A x^2 + B x + C as in compareBreakpoint, a breakpoint is always
+ * the root x1 = (-B + sqrt(D)) / 2A, D = B^2 - 4AC, as that is where g' =
+ * sqrt(D) is positive. Where either x is rational (a focus on the sweep or
+ * foci at equal heights) compareBreakpoint places it against the other.
+ * Otherwise the second breakpoint's g2 and g2' at x1 reduce, using g1(x1) =
+ * 0, to
+ *
+ * 2 A1^2 g2(x1) = (2 A1 Q - P B1) + P sqrt(D1)
+ * A1 g2'(x1) = P + A2 sqrt(D1)
+ *
+ * with P = A1 B2 - A2 B1 and Q = A1 C2 - A2 C1. The sign of each takes one
+ * squaring to decide, and those two signs place x1 against the second
+ * breakpoint the same way compareBreakpoint places x.
+ */
+int compareBreakpoints(float sweep_y, const Intersection& lhs,
+        const Intersection& rhs)
+{
+    VORONOI_CHECK(lhs.pt_left && lhs.pt_right && rhs.pt_left && rhs.pt_right);
+    Breakpoint first = breakpointPolynomial(sweep_y, lhs);
+    if(first.rational)
+        return compareBreakpoint(first.x, sweep_y, rhs);
+    Breakpoint second = breakpointPolynomial(sweep_y, rhs);
+    if(second.rational)
+        return -compareBreakpoint(second.x, sweep_y, lhs);
+
+    double root2 = std::max(0.0, first.B*first.B - 4*first.A*first.C);
+    double P = first.A*second.B - second.A*first.B;
+    double Q = first.A*second.C - second.A*first.C;
+    int g = signWithRoot(2*first.A*Q - P*first.B, P, root2);
+    int slope = signWithRoot(P, second.A, root2)*sign(first.A);
+
+    if(g == 0 && slope >= 0)
+        return 0;
+    if(getSign(rhs) > 0)
+        return g < 0 || slope < 0 ? -1 : 1;
+    return g < 0 && slope > 0 ? -1 : 1;
+}
+
+/**
+ * Where a breakpoint is at the sweep, in double, or -/+ infinity for the ends
+ * of the beach line. The root of compareBreakpoints is taken in whichever
+ * form doesn't subtract nearly equal terms.
+ */
+double breakpointX(float sweep_y, const Intersection& inter)
+{
+    if(inter.pt_left == nullptr)
+        return -std::numeric_limits<double>::infinity();
+    if(inter.pt_right == nullptr)
+        return std::numeric_limits<double>::infinity();
+
+    Breakpoint bp = breakpointPolynomial(sweep_y, inter);
+    if(bp.rational)
+        return bp.x;
+    double root = std::sqrt(std::max(0.0, bp.B*bp.B - 4*bp.A*bp.C));
+    if(bp.B < 0)
+        return (root - bp.B)/(2*bp.A);
+    return 2*bp.C/(-bp.B - root);
+}
+
 Point getIntersection(float sweep_y, const Intersection& inter)
 {
-    assert(inter.pt_left != nullptr);
-    assert(inter.pt_right != nullptr);
+    VORONOI_CHECK(inter.pt_left != nullptr);
+    VORONOI_CHECK(inter.pt_right != nullptr);
     return getIntersection(sweep_y, *inter.pt_left, *inter.pt_right, getSign(inter));
 }
 
@@ -509,8 +740,8 @@ Point getIntersection(float sweep_y, const Point& p, const Point& r, float sign)
     // and
     //
     // sqrt( sqr(q_x - r_x) + sqr(q_y - r_y) ) == q_y - sweep_y
-    std::cerr << "<<<<Intersection of:\n<<<<" << p << "\n<<<<" << r << "\n<<<<" <<
-        sweep_y << std::endl;
+    DEBUG_LOG("<<<<Intersection of:\n<<<<" << p << "\n<<<<" << r << "\n<<<<" <<
+        sweep_y << std::endl);
 
     // Solve for x first
     float y_s = sweep_y;
@@ -518,13 +749,13 @@ Point getIntersection(float sweep_y, const Point& p, const Point& r, float sign)
     if(std::abs(p.y - sweep_y) < 0.0000001) {
         // parabola around p has no width, just select point on parabola r at
         // p.x
-        std::cerr << "<<<<p_y == sweep_y" << std::endl;
+        DEBUG_LOG("<<<<p_y == sweep_y" << std::endl);
         q.x = p.x;
         q.y = 0.5*( sqr(q.x) - 2*q.x*r.x + sqr(r.x) + sqr(r.y) - sqr(y_s))/(r.y - y_s);
     } else if(std::abs(r.y - sweep_y) < 0.0000001) {
         // parabola around r has no width, just select point on parabola q at
         // r.x
-        std::cerr << "<<<<r_y == sweep_y" << std::endl;
+        DEBUG_LOG("<<<<r_y == sweep_y" << std::endl);
         q.x = r.x;
         q.y = 0.5*(p.x*p.x + p.y*p.y - 2*p.x*q.x + q.x*q.x - y_s*y_s)/(p.y - y_s);
     } else {
@@ -534,10 +765,10 @@ Point getIntersection(float sweep_y, const Point& p, const Point& r, float sign)
                 sqrt(p.x*p.x + p.y*p.y - 2*p.x*r.x + r.x*r.x - 2*p.y*r.y + r.y*r.y)*
                 sqrt(p.y - y_s)*sqrt(r.y - y_s)/(p.y - r.y);
 
-            std::cerr << "<<<<"
+            DEBUG_LOG("<<<<"
                 << sqrt(p.x*p.x + p.y*p.y - 2*p.x*r.x + r.x*r.x - 2*p.y*r.y + r.y*r.y)
-                << ", " << sqrt( p.y - y_s) << ", " << sqrt(r.y - y_s)/(p.y - r.y) << std::endl;;
-            std::cerr << "<<<<" << term1 << " + " << sign << " * " << rad << std::endl;
+                << ", " << sqrt( p.y - y_s) << ", " << sqrt(r.y - y_s)/(p.y - r.y) << std::endl);
+            DEBUG_LOG("<<<<" << term1 << " + " << sign << " * " << rad << std::endl);
             // choose +- radical to be between
             q.x = term1 + sign*std::abs(rad);
 
@@ -551,17 +782,17 @@ Point getIntersection(float sweep_y, const Point& p, const Point& r, float sign)
         }
     }
 
-    assert(!std::isinf(q.x));
-    assert(!std::isinf(q.y));
-    assert(!std::isnan(q.x));
-    assert(!std::isnan(q.y));
-    std::cerr << "<<<<Solution: " << q << std::endl;
-    std::cerr << "<<<<Sweep line distance0: " << (q.y - sweep_y) << "\n"
+    VORONOI_CHECK(!std::isinf(q.x));
+    VORONOI_CHECK(!std::isinf(q.y));
+    VORONOI_CHECK(!std::isnan(q.x));
+    VORONOI_CHECK(!std::isnan(q.y));
+    DEBUG_LOG("<<<<Solution: " << q << std::endl);
+    DEBUG_LOG("<<<<Sweep line distance0: " << (q.y - sweep_y) << "\n"
         << "<<<<Solution distance0: "
-        << std::sqrt( sqr(p.x - q.x ) + sqr( p.y - q.y )) << std::endl;
-    std::cerr << "<<<<Sweep line distance1: " << (q.y - sweep_y) << "\n"
+        << std::sqrt( sqr(p.x - q.x ) + sqr( p.y - q.y )) << std::endl);
+    DEBUG_LOG("<<<<Sweep line distance1: " << (q.y - sweep_y) << "\n"
         << "<<<<Solution distance1: "
-        << std::sqrt( sqr(r.x - q.x ) + sqr( r.y - q.y )) << std::endl;
+        << std::sqrt( sqr(r.x - q.x ) + sqr( r.y - q.y )) << std::endl);
     return q;
 }
 
@@ -570,36 +801,58 @@ double sqr(double v) {
     return v*v;
 }
 
+// Center of the circle through p, q and r, relative to p so that the products
+// are of small differences rather than of whole coordinates, which cancel
+// badly
+void circleOffset(const Point& p, const Point& q, const Point& r, double& ux,
+        double& uy)
+{
+    double ax = double(q.x) - p.x, ay = double(q.y) - p.y;
+    double bx = double(r.x) - p.x, by = double(r.y) - p.y;
+    double det = 2*(ax*by - ay*bx);
+    ux = (by*(sqr(ax) + sqr(ay)) - ay*(sqr(bx) + sqr(by)))/det;
+    uy = (ax*(sqr(bx) + sqr(by)) - bx*(sqr(ax) + sqr(ay)))/det;
+}
+
 Circle solveCircle(const Point& p, const Point& q, const Point& r)
 {
-    // find minimal point
+    double ux, uy;
+    circleOffset(p, q, r, ux, uy);
+
     Circle circle;
-    circle.center.x =
-        0.5*(p.y*sqr(q.x) + p.y*sqr(q.y) - (p.y - q.y)*sqr(r.x) -
-                (p.y - q.y)*sqr(r.y) - (sqr(p.x) + sqr(p.y))*q.y +
-                (sqr(p.x) + sqr(p.y) - sqr(q.x) - sqr(q.y))*r.y) /
-        (p.y*q.x - p.x*q.y - (p.y - q.y)*r.x + (p.x - q.x)*r.y);
-
-    circle.center.y =
-        -0.5*(p.x*sqr(q.x) + p.x*sqr(q.y) - (p.x - q.x)*sqr(r.x) -
-                (p.x - q.x)*sqr(r.y) - (sqr(p.x) + sqr(p.y))*q.x +
-                (sqr(p.x) + sqr(p.y) - sqr(q.x) - sqr(q.y))*r.x) /
-        (p.y*q.x - p.x*q.y - (p.y - q.y)*r.x + (p.x - q.x)*r.y);
-
-    circle.radius = sqrt(sqr(p.x - circle.center.x) + sqr(p.y - circle.center.y));
+    circle.center.x = p.x + ux;
+    circle.center.y = p.y + uy;
+    circle.radius = sqrt(sqr(ux) + sqr(uy));
     return circle;
-};
+}
+
+/**
+ * Height of the bottom of the circle through p, q and r, in double. Sites
+ * nearly in a line have a huge circle, and a center far above them with a
+ * radius nearly as large, so that in float their difference is mostly
+ * rounding. Above p the difference is taken as ux^2 / (uy + radius) instead,
+ * which subtracts nothing.
+ */
+double circleBottom(const Point& p, const Point& q, const Point& r)
+{
+    double ux, uy;
+    circleOffset(p, q, r, ux, uy);
+    double radius = std::sqrt(sqr(ux) + sqr(uy));
+    if(uy > 0)
+        return p.y - sqr(ux)/(uy + radius);
+    return p.y + uy - radius;
+}
 
 // Voronoi::implementation Implementation
 void Voronoi::Implementation::processEvent(const CircleEvent& event)
 {
-    assert(event.left_int.pt_right == event.right_int.pt_left);
-    assert(event.left_int.pt_right == event.right_int.pt_left);
-    std::cerr << "--------\nProcessing Event at "
-        << (event.circle.center.y - event.circle.radius)
+    VORONOI_CHECK(event.left_int.pt_right == event.right_int.pt_left);
+    VORONOI_CHECK(event.left_int.pt_right == event.right_int.pt_left);
+    DEBUG_LOG("--------\nProcessing Event at "
+        << event.y
         << " for: [" << event.left_int.pt_left << " -- "
         << event.left_int.pt_right << "], [" << event.right_int.pt_left << " -- "
-        << event.right_int.pt_right << "]\n";
+        << event.right_int.pt_right << "]\n");
 
     // This essentially locks in the results of a single point (the middle part
     // of the two intersections, that means we must remove all events related to
@@ -636,42 +889,40 @@ void Voronoi::Implementation::processEvent(const CircleEvent& event)
 
     // find intersections to the left and right on the beach line, so we can
     // create a new event for when they meet
-    {
+#ifdef VORONOI_DEBUG
     for(auto it1 = m_beach.begin(); it1 != m_beach.end(); ++it1) {
         auto it2 = it1;
         it2++;
         if(it2 != m_beach.end() && !m_beach_compare(*it1, *it2)) {
-            std::cerr << it1->pt_left << ", " << it1->pt_right
+            DEBUG_LOG(it1->pt_left << ", " << it1->pt_right
                 << " comes before " << it2->pt_left << ", " << it2->pt_right
-                << "but it is not less!" << std::endl;
-            throw -1;
+                << "but it is not less!" << std::endl);
+            throw Voronoi::Error("beach line out of order");
         }
     }
-    }
+#endif
 
-    bool success;
-    BeachLineT::iterator it_new;
-    std::cerr << "Looking up event location" << std::endl;
-    auto it = m_beach.find(event.left_int);
-    assert(it != m_beach.begin());
-    assert(it != m_beach.end());
+    DEBUG_LOG("Looking up event location" << std::endl);
+    auto it = locate(event.left_int);
+    if(it == m_beach.end())
+        throw Voronoi::Error("circle event for arcs that aren't on the beach line");
+    VORONOI_CHECK(it != m_beach.begin());
 
-    std::cerr << "Left Int: [" << *(*it).pt_left << " -- " << *(*it).pt_right << std::endl;
+    DEBUG_LOG("Left Int: [" << *(*it).pt_left << " -- " << *(*it).pt_right << std::endl);
     it--;
     auto left_neighbor = *it;
     it++;
     auto left_it = it;
-    assert(left_it->pt_right == event.left_int.pt_right);
-    assert(left_it->pt_left == event.left_int.pt_left);
     it++;
-    auto right_it = it;
-    assert(right_it->pt_right == event.right_int.pt_right);
-    assert(right_it->pt_left == event.right_int.pt_left);
-    std::cerr << "Right Int: [" << *(*it).pt_left << " -- " << *(*it).pt_right << std::endl;
+    VORONOI_CHECK(it != m_beach.end());
+    VORONOI_CHECK(it->pt_right == event.right_int.pt_right);
+    VORONOI_CHECK(it->pt_left == event.right_int.pt_left);
+    DEBUG_LOG("Right Int: [" << *(*it).pt_left << " -- " << *(*it).pt_right << std::endl);
     it++;
+    VORONOI_CHECK(it != m_beach.end());
     auto right_neighbor = *it;
-    assert(left_neighbor.pt_right == event.left_int.pt_left);
-    assert(right_neighbor.pt_left == event.right_int.pt_right);
+    VORONOI_CHECK(left_neighbor.pt_right == event.left_int.pt_left);
+    VORONOI_CHECK(right_neighbor.pt_left == event.right_int.pt_right);
 
     // Find the 3 unique points so that we can create the necessary boundary
     // lines
@@ -684,23 +935,27 @@ void Voronoi::Implementation::processEvent(const CircleEvent& event)
     m_events.erase(event.right_int, right_neighbor);
 
     // delete arc (i.e. erase both intersections related to the current event)
-    std::cerr << "Erasing from beach" << std::endl;
-    m_beach.erase(left_it);
-    m_beach.erase(right_it);
+    DEBUG_LOG("Erasing from beach" << std::endl);
+    // erasing invalidates iterators, but the right intersection is the one
+    // after the left and the new one goes where they were
+    auto it_new = m_beach.erase(m_beach.erase(left_it));
 
     // Update sweep location so that our beach inserts go in the correct
     // location. Note we do this after the beach erase because technically at
     // this event the left and right intersections meet so there might be a
     // little strangeness with the ordering at sweep_y. Therefore just erase the
-    // points first (above)
-    *m_beach_compare.sweep_y = event.circle.center.y - event.circle.radius;
+    // points first (above). Rounding can put the event a hair above a site
+    // already swept past, and the sweep must not move back up over it.
+    *m_beach_compare.sweep_y = std::min(*m_beach_compare.sweep_y,
+            float(event.y));
 
     // create new intersection of the outtermost arcs (left point of left
     // intersection and right point of right intersection)
-    std::cerr << "Creating new beach point" << std::endl;
-    std::tie(it_new, success) = m_beach.emplace(event.left_int.pt_left,
-            event.right_int.pt_right);
-    assert(success);
+    DEBUG_LOG("Creating new beach point" << std::endl);
+    it_new = m_beach.insert(it_new, Intersection(event.left_int.pt_left,
+            event.right_int.pt_right));
+    checkOrder(left_neighbor, *it_new);
+    checkOrder(*it_new, right_neighbor);
 
     // create new event(s) for the meeting of the new intersection and its
     // neighors, excepting the cases where 1) there is no neighboring
@@ -713,7 +968,7 @@ void Voronoi::Implementation::processEvent(const CircleEvent& event)
         auto event_points = std::make_tuple(left_neighbor.pt_left,
                 it_new->pt_left, it_new->pt_right);
         if(!points_match(event_points, std::make_tuple(ptA, ptB, ptC)))
-            m_events.insert(*m_beach_compare.sweep_y, left_neighbor, *it_new);
+            m_events.insert(left_neighbor, *it_new);
     }
     if(right_neighbor.pt_right != nullptr) {
         // Make sure that we aren't creating a new event for the points we just
@@ -721,7 +976,7 @@ void Voronoi::Implementation::processEvent(const CircleEvent& event)
         auto event_points = std::make_tuple(it_new->pt_left, it_new->pt_right,
                 right_neighbor.pt_right);
         if(!points_match(event_points, std::make_tuple(ptA, ptB, ptC)))
-            m_events.insert(*m_beach_compare.sweep_y, *it_new, right_neighbor);
+            m_events.insert(*it_new, right_neighbor);
     }
 
 //    Line line0{*event.left_int.pt_left, *event.left_int.pt_right};
@@ -737,66 +992,92 @@ void Voronoi::Implementation::processEvent(const CircleEvent& event)
 //    itb = m_bounds.find(right_neighbor.pt_left, right_neighbor.pt_right);
 //    assert(itb != m_bounds.end());
 //    itb->circle_pt = left_neighbor.pt_left;
-        for(const auto& tup_node: m_nodes) {
-            assert(tup_node.second != nullptr);
-            std::cerr << tup_node.second->x << ", "
-                << tup_node.second->y << std::endl;
-        }
+    // The nodes and edges this event adds are worked out from the log
+    // after the sweep
+    Triplet triplet;
+    triplet.sites[0] = ptA - m_points->data();
+    triplet.sites[1] = ptB - m_points->data();
+    triplet.sites[2] = ptC - m_points->data();
+    triplet.circle = event.circle;
+    m_log.push_back(triplet);
+}
 
-    // The new center point connects to bisectors of each of the individual
-    // pairs of points, these are rays from the center of the event circle to
-    // each of the bisectors. Note that the first two points define the line
-    // beginning, so all 3 possible pairs of the 3 points must show up
-    Node::Ptr nodeCenter = getNode(ptA, ptB, ptC);
-    Node::Ptr nodeAB = getNode(ptA, ptB);
-    Node::Ptr nodeBC = getNode(ptB, ptC);
-    Node::Ptr nodeCA = getNode(ptA, ptC);
-    assert(nodeCenter != nullptr);
-    assert(nodeAB != nullptr);
-    assert(nodeBC != nullptr);
-    assert(nodeCA != nullptr);
-
-        for(const auto& tup_node: m_nodes) {
-            assert(tup_node.second != nullptr);
-            std::cerr << tup_node.second->x << ", "
-                << tup_node.second->y << std::endl;
-        }
-    float distAB = perp(event.circle.center, *ptA, *ptB);
-    float distBC = perp(event.circle.center, *ptB, *ptC);
-    float distCA = perp(event.circle.center, *ptC, *ptA);
-    if((distAB <= 0 && distBC <= 0 && distCA <= 0) ||
-            (distAB >= 0 && distBC >= 0 && distCA >= 0)) {
-        // point inside triangle
-        addTriplet(nodeCenter, nodeAB, nodeBC, nodeCA);
-    } else {
-        // Whichever ever side of the triangle had the opposite sign as the
-        // other two, is the one that we need to connect with
-        std::cerr << "center = ["<< event.circle.center << "]"
-            << "\n\ttriangle = [" << *ptA << ";"
-            << "\n\t" << *ptB << ";"
-            << "\n\t" << *ptC << "]"
-            << std::endl;
-        if((distBC <= 0 && (distCA >= 0 && distAB >=0)) ||
-                (distBC >= 0 && (distCA <= 0 && distAB <=0))) {
-            // distBC is the odd man out, move ptC into ptA so that A, B are
-            // nearest
-            addTriplet(nodeBC, nodeCenter, nodeCA, nodeAB);
-        } else if((distCA <= 0 && (distAB >= 0 && distBC >=0)) ||
-                (distCA >= 0 && (distAB <= 0 && distBC <=0))) {
-            // distCA is the odd man out, swap nodeAB and nodeCA
-            addTriplet(nodeCA, nodeCenter, nodeAB, nodeBC);
-        } else {
-            addTriplet(nodeAB, nodeCenter, nodeBC, nodeCA);
-        }
 
+BeachLineT::iterator Voronoi::Implementation::locate(
+        const Intersection& inter) const
+{
+    // Where arcs vanish together their breakpoints meet and may be in either
+    // order, so look through those for the one with inter's sites. A pair
+    // of arcs meets at most once on the beach line, so its sites identify
+    // it. Anything further off means the beach line is broken.
+    auto matches = [&inter](const Intersection& other) {
+        return other.pt_left == inter.pt_left &&
+            other.pt_right == inter.pt_right;
+    };
+    auto it = m_beach.lower_bound(inter);
+    if(it != m_beach.end() && matches(*it))
+        return it;
+
+    double x = breakpointX(sweep_y, inter);
+    for(auto back = it; back != m_beach.begin(); ) {
+        --back;
+        if(breakpointX(sweep_y, *back) < x - m_coincident)
+            break;
+        if(matches(*back))
+            return back;
+    }
+    for(; it != m_beach.end(); ++it) {
+        if(matches(*it))
+            return it;
+        if(breakpointX(sweep_y, *it) > x + m_coincident)
+            break;
     }
+    return m_beach.end();
 }
 
+void Voronoi::Implementation::checkOrder(const Intersection& lhs,
+        const Intersection& rhs) const
+{
+    // Inserts go where the sweep says rather than where the comparator does,
+    // so catch the two disagreeing instead of building a wrong diagram
+    if(m_beach_compare(rhs, lhs) && breakpointX(sweep_y, lhs) -
+            breakpointX(sweep_y, rhs) > m_coincident)
+        throw Voronoi::Error("beach line out of order");
+}
+
+void Voronoi::Implementation::reset()
+{
+    m_beach.clear();
+    m_events.clear();
+    m_record = nullptr;
+    m_min_x = m_min_y = std::numeric_limits<double>::infinity();
+    m_max_x = m_max_y = -std::numeric_limits<double>::infinity();
+    m_coincident = 0;
+    m_log.clear();
+    m_points = nullptr;
+    m_order.clear();
+}
+
+void Voronoi::Implementation::setBounds(const std::vector<Point>& points)
+{
+    double size = 1;
+    for(const auto& pt : points) {
+        m_min_x = std::min<double>(pt.x, m_min_x);
+        m_max_x = std::max<double>(pt.x, m_max_x);
+        m_min_y = std::min<double>(pt.y, m_min_y);
+        m_max_y = std::max<double>(pt.y, m_max_y);
+        size = std::max<double>({size, std::abs(pt.x), std::abs(pt.y)});
+    }
+
+    // A sweep off by d moves breakpoints by up to sqrt(2 d size), at the
+    // arc of a site just above it
+    m_coincident = size*std::sqrt(2*COINCIDENT);
+}
 
 void Voronoi::Implementation::processPoint(const Point& pt)
 {
-    std::cerr << "<----------------------" << std::endl;
-    std::cerr << "<Processing point: " << pt << std::endl;
+    DEBUG_LOG("<----------------------" << std::endl);
+    DEBUG_LOG("<Processing point: " << pt << std::endl);
 
     // Update sweep location in beach line so that insertion takes place at the
     // right location
@@ -805,18 +1086,15 @@ void Voronoi::Implementation::processPoint(const Point& pt)
 
     // insert two new intersections in between existing intersections
     Intersection dummy{&pt, &pt};
-    bool success;
     BeachLineT::iterator it1, it2, it_new;
-    const Point* ptA = nullptr;
     const Point* ptB = nullptr;
-    const Point* ptC = nullptr;
     const Point* ptD = nullptr;
     if(m_beach.empty()) {
-        std::cerr << "<<<Beach empty, inserting special" << std::endl;
+        DEBUG_LOG("<<<Beach empty, inserting special" << std::endl);
         // add null intersection
         // no intersections to erase
-        m_beach.emplace(nullptr, &pt);
-        m_beach.emplace(&pt, nullptr);
+        m_beach.insert(m_beach.end(), Intersection(nullptr, &pt));
+        m_beach.insert(m_beach.end(), Intersection(&pt, nullptr));
     } else {
         // In between two previous intersections, on the parabolar for the
         // shared point
@@ -826,287 +1104,507 @@ void Voronoi::Implementation::processPoint(const Point& pt)
         //  points:         A   B     B   C
         //  new inter:          B  D  B
         // intersection >= so take the first point
-        std::cerr << "<<Finding beach location" << std::endl;
+        DEBUG_LOG("<<Finding beach location" << std::endl);
         it1 = m_beach.lower_bound(dummy);
-        std::cerr << "<<Lower bound: (" << it1->pt_left << " -- "
-            << it1->pt_right << ")" << std::endl;
+        DEBUG_LOG("<<Lower bound: (" << it1->pt_left << " -- "
+            << it1->pt_right << ")" << std::endl);
         if(it1->pt_left) {
-            std::cerr << "<<pt_left: " << *it1->pt_left << std::endl;
+            DEBUG_LOG("<<pt_left: " << *it1->pt_left << std::endl);
         }
         if(it1->pt_right) {
-            std::cerr << "<<pt_right: " << *it1->pt_right << std::endl;
+            DEBUG_LOG("<<pt_right: " << *it1->pt_right << std::endl);
         }
-        std::cerr << "<<Done" << std::endl;
+        DEBUG_LOG("<<Done" << std::endl);
+        // the beach line always starts and ends with an infinite intersection
+        VORONOI_CHECK(it1 != m_beach.begin() && it1 != m_beach.end());
         it2 = it1; it1--;
-        ptB = it1->pt_right;
+
+        // inserting invalidates the iterators, keep the neighbors themselves
+        Intersection left = *it1;
+        Intersection right = *it2;
+        VORONOI_CHECK(left.pt_right == right.pt_left);
+        ptB = left.pt_right;
         ptD = &pt;
 
-        std::cerr << "B: " << ptB << std::endl
-            << "D: " << ptD << std::endl;
-        // Insert new intersection into beach, then create an event for the old
-        // left and the new intersection point
-        std::cerr << "Inserting " << ptB << ", " << ptD << " into beach" << std::endl;
-        std::tie(it_new, success) = m_beach.emplace(ptB, ptD);
-        assert(success);
-        if(it1->pt_left != nullptr)
-            m_events.insert(*m_beach_compare.sweep_y, *it1, *it_new);
-
-        // Insert new intersection int beach, then create a new event for the
-        // old upper intersection and the new one
-        std::cerr << "Inserting " << ptD << ", " << ptB << " into beach" << std::endl;
-        std::tie(it_new, success) = m_beach.emplace(ptD, ptB);
-        assert(success);
-        if(it2->pt_right != nullptr)
-            m_events.insert(*m_beach_compare.sweep_y, *it_new, *it2);
-
-        // Erase the event that involved the meeting of our previous left and
-        // right intersections (since we got in the middle)
-        if(it1->pt_left != nullptr && it2->pt_right != nullptr) {
-            m_events.erase(*it1, *it2);
+        DEBUG_LOG("B: " << ptB << std::endl
+            << "D: " << ptD << std::endl);
+        if(std::abs(ptB->y - pt.y) < 0.0000001) {
+            // Sites level with the first one. B's arc is still a ray straight
+            // up from B, so it isn't split, D's arc goes beside it with one
+            // breakpoint between them. Anywhere but the ends of the beach
+            // line the breakpoints either side of a ray are at its x, and
+            // the site would have gone past them.
+            if(pt.x > ptB->x) {
+                VORONOI_CHECK(right.pt_right == nullptr);
+                it_new = m_beach.erase(it2);
+                it_new = m_beach.insert(it_new, Intersection(ptD, nullptr));
+                it_new = m_beach.insert(it_new, Intersection(ptB, ptD));
+            } else {
+                VORONOI_CHECK(left.pt_left == nullptr && pt.x < ptB->x);
+                it_new = m_beach.erase(it1);
+                it_new = m_beach.insert(it_new, Intersection(ptD, ptB));
+                it_new = m_beach.insert(it_new, Intersection(nullptr, ptD));
+            }
+        } else {
+            // Insert the new intersections between the old ones, the upper first
+            // so that the lower can go just before it, then create events for
+            // each with its old neighbor
+            DEBUG_LOG("Inserting " << ptD << ", " << ptB << " into beach" << std::endl);
+            it_new = m_beach.insert(it2, Intersection(ptD, ptB));
+            if(right.pt_right != nullptr)
+                m_events.insert(*it_new, right);
+
+            DEBUG_LOG("Inserting " << ptB << ", " << ptD << " into beach" << std::endl);
+            it_new = m_beach.insert(it_new, Intersection(ptB, ptD));
+            if(left.pt_left != nullptr)
+                m_events.insert(left, *it_new);
+
+            // Erase the event that involved the meeting of our previous left and
+            // right intersections (since we got in the middle)
+            if(left.pt_left != nullptr && right.pt_right != nullptr) {
+                m_events.erase(left, right);
+            }
         }
     }
 
 
-    std::cerr << "<......................" << std::endl;
+    DEBUG_LOG("<......................" << std::endl);
 }
 
-void Voronoi::Implementation::compute(const std::vector<Point>& points)
+void Voronoi::Implementation::compute(const std::vector<Point>& points,
+        PerfCounters& counters, Stats& stats)
 {
+    counters.start();
     m_points = &points;
-    for(const auto& pt : points) {
-        m_min_x = std::min<double>(pt.x, m_min_x);
-        m_max_x = std::max<double>(pt.x, m_max_x);
-        m_min_y = std::min<double>(pt.y, m_min_y);
-        m_max_y = std::max<double>(pt.y, m_max_y);
-    }
+    if(m_record)
+        m_record->points = points;
+    setBounds(points);
 
-    std::cerr << "Sorting points" << std::endl;
+    DEBUG_LOG("Sorting points" << std::endl);
     // Sort by decreasing y
-    std::vector<size_t> ordered(points.size());
+    std::vector<size_t>& ordered = m_order;
+    ordered.resize(points.size());
     for(size_t ii = 0; ii < points.size(); ii++) ordered[ii] = ii;
     std::sort(ordered.begin(), ordered.end(),
-            [&](size_t ii, size_t jj) { return points[ii].y > points[jj].y; });
-
-    // stop when circle event's centers are after this
-    double last_y = points[ordered.back()].y;
-
-    std::cerr << "Ordered points: " << std::endl;
+            [&](size_t ii, size_t jj) {
+                // level sites left to right, see processPoint
+                if(points[ii].y != points[jj].y)
+                    return points[ii].y > points[jj].y;
+                return points[ii].x < points[jj].x;
+            });
+    counters.stop(stats.sort);
+
+#ifdef VORONOI_DEBUG
+    DEBUG_LOG("Ordered points: " << std::endl);
     for(size_t ii : ordered) {
-        std::cerr << points[ii] << std::endl;
+        DEBUG_LOG(points[ii] << std::endl);
     }
-    std::cerr << std::endl;
+    DEBUG_LOG(std::endl);
+#endif
 
     // Travel downward so at each step take
+    counters.start();
     size_t ii = 0;
     double prev_sweep = NAN;
     double sweep = NAN;
     while(!m_events.empty() || ii < ordered.size()) {
-        std::cerr << "Remaining Points: " << (ordered.size() - ii) << std::endl;
-        std::cerr << "Remaining Events: " << m_events.size() << std::endl;
+        DEBUG_LOG("Remaining Points: " << (ordered.size() - ii) << std::endl);
+        DEBUG_LOG("Remaining Events: " << m_events.size() << std::endl);
 
         if(m_events.empty()) {
-            std::cerr << "Events Empty, processing next point" << std::endl;
+            DEBUG_LOG("Events Empty, processing next point" << std::endl);
             sweep = points[ordered[ii]].y;
             draw_state(m_beach, m_events, prev_sweep, sweep);
             prev_sweep = sweep;
+            recordPoint(points[ordered[ii]]);
             processPoint(points[ordered[ii]]);
             ii++;
         } else if(ii == ordered.size()) {
-            std::cerr << "Points Done, processing next event" << std::endl;
+            DEBUG_LOG("Points Done, processing next event" << std::endl);
             auto evt = m_events.back(); // greater y's first (decreasing y)
-            std::cerr << evt.circle.center.y << std::endl;
-            sweep = evt.circle.center.y - evt.circle.radius;
+            DEBUG_LOG(evt.circle.center.y << std::endl);
+            sweep = evt.y;
             draw_state(m_beach, m_events, prev_sweep, sweep);
             prev_sweep = sweep;
+            recordEvent(evt);
             m_events.pop_back();
             processEvent(evt);
         } else {
             auto evt = m_events.back(); // greater y's first (decreasing y)
-            std::cerr << "Next point: " << points[ordered[ii]].y
-                << ", Next Event: " << evt.circle.center.y - evt.circle.radius
-                << std::endl;
-            if(points[ordered[ii]].y > evt.circle.center.y - evt.circle.radius) {
+            DEBUG_LOG("Next point: " << points[ordered[ii]].y
+                << ", Next Event: " << evt.y
+                << std::endl);
+            if(points[ordered[ii]].y > evt.y) {
                 sweep = points[ordered[ii]].y;
                 draw_state(m_beach, m_events, prev_sweep, sweep);
                 prev_sweep = sweep;
+                recordPoint(points[ordered[ii]]);
                 processPoint(points[ordered[ii]]);
                 ii++;
             } else {
-                sweep = evt.circle.center.y - evt.circle.radius;
+                sweep = evt.y;
                 draw_state(m_beach, m_events, prev_sweep, sweep);
-                    prev_sweep = sweep;
+                prev_sweep = sweep;
+                recordEvent(evt);
                 m_events.pop_back();
                 processEvent(evt);
             }
         }
 
-        std::cerr << "Final Beach: " << std::endl;
+#ifdef VORONOI_DEBUG
+        DEBUG_LOG("Final Beach: " << std::endl);
         for(const auto& inter: m_beach) {
-            std::cerr << "(" << inter.pt_left << ", " << inter.pt_right << ")";
-            if(inter.pt_left) std::cerr << "Point 0: " << *inter.pt_left << " ";
-            if(inter.pt_right) std::cerr << "Point 1: " << *inter.pt_right << " ";
-            std::cerr << std::endl;
+            DEBUG_LOG("(" << inter.pt_left << ", " << inter.pt_right << ")");
+            if(inter.pt_left) DEBUG_LOG("Point 0: " << *inter.pt_left << " ");
+            if(inter.pt_right) DEBUG_LOG("Point 1: " << *inter.pt_right << " ");
+            DEBUG_LOG(std::endl);
         }
 
-        std::cerr << "Final Events: " << std::endl;
+        DEBUG_LOG("Final Events: " << std::endl);
         for(const auto& evt: m_events) {
-            std::cerr << "at " << (evt.circle.center.y - evt.circle.radius)
+            DEBUG_LOG("at " << evt.y
                 << "( "
                 << evt.left_int.pt_left << ", "
                 << evt.left_int.pt_right << ")"
                 << " -- "
                 << evt.right_int.pt_left << ", ("
                 << evt.right_int.pt_right << ")"
-                << std::endl;
-        }
-
-        for(const auto& tup_node: m_nodes) {
-            assert(tup_node.second != nullptr);
-            std::cerr << tup_node.second->x << ", "
-                << tup_node.second->y << std::endl;
+                << std::endl);
         }
+#endif
     }
+    counters.stop(stats.sweep);
 
     //return voronoi;
 }
 
 
-Voronoi::Node::Ptr Voronoi::Implementation::getNode(
-        const Point* ptA, const Point* ptB, const Point* ptC)
+void Voronoi::Implementation::recordPoint(const Point& pt)
 {
-    orderPoints(ptA, ptB, ptC);
-    auto result = m_nodes.emplace(std::make_tuple(ptA, ptB, ptC), nullptr);
-
-    // if node exists, just return it
-    if(!result.second) {
-        assert(result.first->second != nullptr);
-        return result.first->second;
-    }
-
-    // create and fill out the new node
-    auto circle = solveCircle(*ptA, *ptB, *ptC);
+    if(!m_record)
+        return;
+    EventRecord record;
+    record.type = EVENT_SITE;
+    record.sites[0] = &pt - m_points->data();
+    record.sites[1] = NO_EVENT_SITE;
+    record.sites[2] = NO_EVENT_SITE;
+    record.y = pt.y;
+    record.queue_size = m_events.size();
+    record.beach_size = m_beach.size();
+    m_record->events.push_back(record);
+}
 
-    // need to construct a new node and add its parents and location
-    auto new_node = std::make_shared<Node>();
-    result.first->second = new_node;
+void Voronoi::Implementation::recordEvent(const CircleEvent& event)
+{
+    if(!m_record)
+        return;
+    EventRecord record;
+    record.type = EVENT_CIRCLE;
+    record.sites[0] = event.left_int.pt_left - m_points->data();
+    record.sites[1] = event.left_int.pt_right - m_points->data();
+    record.sites[2] = event.right_int.pt_right - m_points->data();
+    record.y = event.y;
+    record.queue_size = m_events.size();
+    record.beach_size = m_beach.size();
+    m_record->events.push_back(record);
+}
 
-    // Add parents
-    new_node->parents.insert((ptA - m_points->data()) / sizeof(Point));
-    new_node->parents.insert((ptB - m_points->data()) / sizeof(Point));
-    new_node->parents.insert((ptC - m_points->data()) / sizeof(Point));
+/**
+ * The events are handed to processPoint and processEvent as they were in
+ * compute. A circle event is rebuilt from its sites: its intersections are
+ * those of the left and middle arcs and of the middle and right arcs, and its
+ * circle is solved from the sites in the same order as when it was queued, so
+ * the beach line sees exactly what it saw when recording. The queue is kept
+ * as it was, the event is taken out of it before being handled, but it's
+ * never asked what comes next.
+ */
+void Voronoi::Implementation::replay(const EventLog& log,
+        PerfCounters& counters, Stats& stats)
+{
+    const std::vector<Point>& points = log.points;
+
+    // a log built in memory hasn't been through readEventLog, so check its
+    // records the same way before any of them is handled
+    for(const auto& record : log.events) {
+        VORONOI_CHECK(record.type == EVENT_SITE || record.type == EVENT_CIRCLE);
+        size_t count = record.type == EVENT_SITE ? 1 : 3;
+        for(size_t ii = 0; ii < count; ii++)
+            VORONOI_CHECK(record.sites[ii] < points.size());
+    }
 
-    // Add position
-    new_node->x = circle.center.x;
-    new_node->y = circle.center.y;
+    if(m_record)
+        m_record->points = points;
+    m_points = &points;
+    setBounds(points);
 
-    return new_node;
+    counters.start();
+    for(const auto& record : log.events) {
+        if(record.type == EVENT_SITE) {
+            recordPoint(points[record.sites[0]]);
+            processPoint(points[record.sites[0]]);
+        } else {
+            const Point* ptA = &points[record.sites[0]];
+            const Point* ptB = &points[record.sites[1]];
+            const Point* ptC = &points[record.sites[2]];
+            CircleEvent evt;
+            evt.left_int = Intersection(ptA, ptB);
+            evt.right_int = Intersection(ptB, ptC);
+            evt.circle = solveCircle(*ptA, *ptB, *ptC);
+            evt.y = circleBottom(*ptA, *ptB, *ptC);
+            recordEvent(evt);
+            m_events.erase(evt.left_int, evt.right_int);
+            processEvent(evt);
+        }
+    }
+    counters.stop(stats.sweep);
 }
 
-Voronoi::Node::Ptr Voronoi::Implementation::getNode(
-        const Point* ptA, const Point* ptB)
+/**
+ * Every triplet in the log stands for a node at its circle's center and the
+ * nodes halfway between each pair of its sites, joined by three edges. The
+ * same node turns up in many triplets, so the nodes are keyed by their sites
+ * and the keys sorted to give each one a single index. Edges are then made
+ * per triplet, and the adjacency of each node is filled from the edges
+ * sorted by node. Each step is split across threads, nothing is shared
+ * between them but the finished arrays.
+ */
+void Voronoi::Implementation::materialize(std::vector<Node::Ptr>& nodes,
+        std::vector<Edge::Ptr>& edges, size_t threads,
+        const FixedOutput* fixed) const
 {
-    if(ptA > ptB) std::swap(ptA, ptB);
-    auto result = m_nodes.emplace(std::make_tuple(ptA, ptB, nullptr), nullptr);
+    const uint32_t NO_SITE = 0xffffffff;
+    const std::vector<Point>& points = *m_points;
+
+    // small diagrams aren't worth starting threads for
+    if(m_log.size() < PARALLEL_TRIPLETS)
+        threads = 1;
+    auto forEach = [threads](size_t begin, size_t end,
+            const std::function<void(size_t)>& func) {
+        parallelFor(begin, end, func, threads);
+    };
+
+    // the circle's center, then the pairs AB, BC and CA
+    struct Key
+    {
+        uint32_t sites[3];
+        uint32_t index;
 
-    // if node exists, just return it
-    if(!result.second) {
-        assert(result.first->second != nullptr);
-        return result.first->second;
+        bool operator<(const Key& rhs) const
+        {
+            return std::lexicographical_compare(sites, sites + 3,
+                    rhs.sites, rhs.sites + 3);
+        }
+    };
+    std::vector<Key> keys(4*m_log.size());
+    forEach(0, m_log.size(), [&](size_t ii) {
+        const uint32_t* sites = m_log[ii].sites;
+        Key* key = &keys[4*ii];
+        key[0] = Key{{sites[0], sites[1], sites[2]}, uint32_t(4*ii)};
+        key[1] = Key{{sites[0], sites[1], NO_SITE}, uint32_t(4*ii + 1)};
+        key[2] = Key{{sites[1], sites[2], NO_SITE}, uint32_t(4*ii + 2)};
+        key[3] = Key{{sites[0], sites[2], NO_SITE}, uint32_t(4*ii + 3)};
+        for(size_t jj = 0; jj < 4; jj++)
+            std::sort(key[jj].sites, key[jj].sites + 3);
+    });
+    parallelSort(keys.begin(), keys.end(), std::less<Key>(), threads);
+
+    // a node per distinct key
+    std::vector<uint32_t> node_of(keys.size());
+    std::vector<size_t> firsts;
+    for(size_t ii = 0; ii < keys.size(); ii++) {
+        if(ii == 0 || keys[ii - 1] < keys[ii])
+            firsts.push_back(ii);
+        node_of[keys[ii].index] = firsts.size() - 1;
     }
 
-    // need to construct a new node and add its parents and location
-    auto new_node = std::make_shared<Node>();
-    result.first->second = new_node;
+    nodes.resize(firsts.size());
+    if(fixed)
+        fixed->resize(nodes.size());
+    std::atomic<size_t> clipped(0);
+    size_t chunks = (nodes.size() + NODE_CHUNK - 1) / NODE_CHUNK;
+    forEach(0, chunks, [&](size_t chunk) {
+        size_t begin = chunk*NODE_CHUNK;
+        size_t count = std::min(NODE_CHUNK, nodes.size() - begin);
+        float xs[NODE_CHUNK], ys[NODE_CHUNK];
+        for(size_t ii = begin; ii < begin + count; ii++) {
+            const uint32_t* sites = keys[firsts[ii]].sites;
+            auto node = std::make_shared<Node>();
+            const Point& ptA = points[sites[0]];
+            const Point& ptB = points[sites[1]];
+            if(sites[2] == NO_SITE) {
+                node->x = (ptA.x + ptB.x)*0.5;
+                node->y = (ptA.y + ptB.y)*0.5;
+                node->radius = distance2d(ptA, ptB)*0.5;
+                node->parents.insert(sites, sites + 2);
+            } else {
+                auto circle = solveCircle(ptA, ptB, points[sites[2]]);
+                node->x = circle.center.x;
+                node->y = circle.center.y;
+                node->radius = circle.radius;
+                node->parents.insert(sites, sites + 3);
+            }
+            xs[ii - begin] = node->x;
+            ys[ii - begin] = node->y;
+            nodes[ii] = node;
+        }
+        if(fixed)
+            clipped += fixed->convert(begin, count, xs, ys);
+    });
+    if(fixed)
+        fixed->setClipped(clipped);
+
+    // The center joins to the bisector of each pair of sites, but where
+    // the center is outside the triangle of the sites the pair facing it
+    // is the hub instead
+    edges.resize(3*m_log.size());
+    std::vector<uint32_t> edge_nodes(2*edges.size());
+    forEach(0, m_log.size(), [&](size_t ii) {
+        const Triplet& triplet = m_log[ii];
+        const Point& ptA = points[triplet.sites[0]];
+        const Point& ptB = points[triplet.sites[1]];
+        const Point& ptC = points[triplet.sites[2]];
+        const uint32_t* node = &node_of[4*ii];
+        uint32_t center = node[0], nodeAB = node[1], nodeBC = node[2],
+                 nodeCA = node[3];
+
+        float distAB = perp(triplet.circle.center, ptA, ptB);
+        float distBC = perp(triplet.circle.center, ptB, ptC);
+        float distCA = perp(triplet.circle.center, ptC, ptA);
+        uint32_t hub, spokes[3];
+        if((distAB <= 0 && distBC <= 0 && distCA <= 0) ||
+                (distAB >= 0 && distBC >= 0 && distCA >= 0)) {
+            // point inside triangle
+            hub = center;
+            spokes[0] = nodeAB; spokes[1] = nodeBC; spokes[2] = nodeCA;
+        } else if((distBC <= 0 && (distCA >= 0 && distAB >=0)) ||
+                (distBC >= 0 && (distCA <= 0 && distAB <=0))) {
+            // distBC is the odd man out
+            hub = nodeBC;
+            spokes[0] = center; spokes[1] = nodeCA; spokes[2] = nodeAB;
+        } else if((distCA <= 0 && (distAB >= 0 && distBC >=0)) ||
+                (distCA >= 0 && (distAB <= 0 && distBC <=0))) {
+            hub = nodeCA;
+            spokes[0] = center; spokes[1] = nodeAB; spokes[2] = nodeBC;
+        } else {
+            hub = nodeAB;
+            spokes[0] = center; spokes[1] = nodeBC; spokes[2] = nodeCA;
+        }
+
+        for(size_t jj = 0; jj < 3; jj++) {
+            // the edges parents are the parents in common between its nodes
+            const Node::Ptr& nodeA = nodes[spokes[jj]];
+            const Node::Ptr& nodeB = nodes[hub];
+            auto edge = std::make_shared<Edge>();
+            std::set_intersection(
+                    nodeA->parents.begin(), nodeA->parents.end(),
+                    nodeB->parents.begin(), nodeB->parents.end(),
+                    std::inserter(edge->parents, edge->parents.begin()));
+            edge->nodes[0] = nodeA;
+            edge->nodes[1] = nodeB;
+            edges[3*ii + jj] = edge;
+            edge_nodes[2*(3*ii + jj)] = spokes[jj];
+            edge_nodes[2*(3*ii + jj) + 1] = hub;
+        }
+    });
+
+    // the ends of every edge grouped by node, so each node's sets are only
+    // touched by one thread
+    std::vector<std::pair<uint32_t, uint32_t>> ends(edge_nodes.size());
+    forEach(0, ends.size(), [&](size_t ii) {
+        ends[ii] = std::make_pair(edge_nodes[ii], uint32_t(ii / 2));
+    });
+    parallelSort(ends.begin(), ends.end(),
+            std::less<std::pair<uint32_t, uint32_t>>(), threads);
+
+    std::vector<size_t> offsets(nodes.size() + 1, 0);
+    for(const auto& end : ends)
+        offsets[end.first + 1]++;
+    for(size_t ii = 0; ii < nodes.size(); ii++)
+        offsets[ii + 1] += offsets[ii];
+
+    forEach(0, nodes.size(), [&](size_t ii) {
+        Node& node = *nodes[ii];
+        for(size_t jj = offsets[ii]; jj < offsets[ii + 1]; jj++) {
+            const Edge::Ptr& edge = edges[ends[jj].second];
+            node.edges.insert(edge);
+            node.neighbors.insert(edge->nodes[0].get() == &node ?
+                    edge->nodes[1] : edge->nodes[0]);
+        }
+    });
 
-    // Add parents
-    new_node->parents.insert((ptA - m_points->data()) / sizeof(Point));
-    new_node->parents.insert((ptB - m_points->data()) / sizeof(Point));
+    // add edge's neighbors by copying the neighbors of its nodes
+    forEach(0, edges.size(), [&](size_t ii) {
+        const Edge::Ptr& edge = edges[ii];
+        for(const auto& neighbor : edge->nodes[0]->edges) {
+            if(neighbor != edge)
+                edge->neighbors.insert(neighbor);
+        }
+        for(const auto& neighbor : edge->nodes[1]->edges) {
+            if(neighbor != edge)
+                edge->neighbors.insert(neighbor);
+        }
+    });
+}
 
-    // Add position
-    new_node->x = (ptA->x + ptB->x)*0.5;
-    new_node->y = (ptA->y + ptB->y)*0.5;
+Voronoi::Workspace::Workspace() : m_impl(new Implementation)
+{
+}
 
-    return new_node;
+Voronoi::Workspace::~Workspace()
+{
 }
 
-Voronoi::Edge::Ptr Voronoi::Implementation::addEdge(
-        Node::Ptr nodeA,
-        Node::Ptr nodeB)
+Voronoi::Implementation& Voronoi::Workspace::reset()
 {
-    // the edges parents are the parents in common between the two input nodes
-    std::set<size_t> common;
-    std::set_intersection(
-            nodeA->parents.begin(), nodeA->parents.end(),
-            nodeB->parents.begin(), nodeB->parents.end(),
-            std::inserter(common, common.begin()));
-
-    auto out = std::make_shared<Edge>();
-    out->parents = common;
-    out->nodes[0] = nodeA;
-    out->nodes[1] = nodeB;
-    std::cerr << "adding edge!" << std::endl;
-    std::cerr << "edge = [" << nodeA->x << ", " << nodeA->y << ";"
-        << nodeB->x << ", " << nodeB->y << "]" << std::endl;
-    m_edges.push_back(out);
-    return out;
+    m_impl->reset();
+    return *m_impl;
 }
 
-void Voronoi::Implementation::addTriplet(Node::Ptr center, Node::Ptr nodeA,
-        Node::Ptr nodeB, Node::Ptr nodeC)
+Voronoi::Voronoi(const std::vector<Point>& points) :
+    Voronoi(points, Options())
 {
-    // edges
-    std::shared_ptr<Edge> edgeA = addEdge(nodeA, center);
-    std::shared_ptr<Edge> edgeB = addEdge(nodeB, center);
-    std::shared_ptr<Edge> edgeC = addEdge(nodeC, center);
-
-    nodeA->edges.insert(edgeA);
-    nodeB->edges.insert(edgeB);
-    nodeC->edges.insert(edgeC);
-
-    center->edges.insert(edgeA);
-    center->edges.insert(edgeB);
-    center->edges.insert(edgeC);
-
-    // neighbors
-    nodeA->neighbors.insert(center);
-    nodeB->neighbors.insert(center);
-    nodeC->neighbors.insert(center);
-
-    center->neighbors.insert(nodeA);
-    center->neighbors.insert(nodeB);
-    center->neighbors.insert(nodeC);
 }
 
-Voronoi::Voronoi(const std::vector<Point>& points)
+Voronoi::Voronoi(const std::vector<Point>& points, const Options& options)
 {
     using std::unordered_map;
     using std::tuple;
     using std::make_tuple;
 
-    Implementation impl;
-    impl.compute(points);
+    PerfCounters counters;
+    m_stats.counters = options.perf_counters && counters.open();
+    SerialScope serial(m_stats.counters);
 
-    std::cerr << "Done with computation" << std::endl;
-    m_nodes.clear();
-    m_nodes.reserve(impl.m_nodes.size());
-    for(const auto& tup_node: impl.m_nodes) {
-        assert(tup_node.second != nullptr);
-        m_nodes.push_back(tup_node.second);
-        std::cerr << m_nodes.back()->x << ", " << m_nodes.back()->y << std::endl;
-    }
-    m_edges = impl.m_edges;
+    Workspace own;
+    Implementation& impl = (options.workspace ? *options.workspace : own).reset();
+    impl.record(options.event_log);
+    impl.compute(points, counters, m_stats);
 
-    // add edge's neighbors by copying the neighbors of
-    for(Edge::Ptr edge : m_edges) {
-        std::cerr << edge->nodes[0]->x << ", " << edge->nodes[0]->y << " -- "
-            << edge->nodes[1]->x << ", " << edge->nodes[1]->y << std::endl;
-        for(const auto& neighbor : edge->nodes[0]->edges) {
-            if(neighbor != edge)
-                edge->neighbors.insert(neighbor);
-        }
-        for(const auto& neighbor : edge->nodes[1]->edges) {
-            if(neighbor != edge)
-                edge->neighbors.insert(neighbor);
-        }
-    }
+    DEBUG_LOG("Done with computation" << std::endl);
+    counters.start();
+    impl.materialize(m_nodes, m_edges,
+            m_stats.counters ? 1 : options.threads, options.fixed);
+    counters.stop(m_stats.assembly);
+}
+
+Voronoi::Voronoi(const EventLog& log) :
+    Voronoi(log, Options())
+{
+}
+
+Voronoi::Voronoi(const EventLog& log, const Options& options)
+{
+    PerfCounters counters;
+    m_stats.counters = options.perf_counters && counters.open();
+    SerialScope serial(m_stats.counters);
+
+    Workspace own;
+    Implementation& impl = (options.workspace ? *options.workspace : own).reset();
+    impl.record(options.event_log);
+    impl.replay(log, counters, m_stats);
+
+    counters.start();
+    impl.materialize(m_nodes, m_edges,
+            m_stats.counters ? 1 : options.threads, options.fixed);
+    counters.stop(m_stats.assembly);
 }
@@ -7,8 +7,14 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 #include "geometry.h"
+#include "perf_counters.h"
+
+struct EventLog;
+class FixedOutput;
 
 using std::sqrt;
 using std::tuple;
@@ -26,6 +32,39 @@ public:
 
     struct Node;
 
+    // Thrown when a diagram can't be computed, e.g. the input is inconsistent
+    // or the sweep loses track of its beach line on degenerate points
+    class Error : public std::runtime_error
+    {
+    public:
+        explicit Error(const std::string& what) : std::runtime_error(what) {}
+    };
+
+    /**
+     * State of the sweep kept from one diagram to the next: the beach line,
+     * the event queue and the log of circle events. A diagram built with
+     * Options::workspace resets it instead of setting up its own, so a thread
+     * that builds one diagram after another, like a server's worker, keeps
+     * the log and the order of the points allocated between them. Only one
+     * diagram at a time may use a workspace.
+     */
+    class Workspace
+    {
+    public:
+        Workspace();
+        ~Workspace();
+
+        Workspace(const Workspace&) = delete;
+        Workspace& operator=(const Workspace&) = delete;
+
+    private:
+        friend Voronoi;
+
+        Implementation& reset();
+
+        std::unique_ptr<Implementation> m_impl;
+    };
+
     class Edge
     {
     public:
@@ -49,6 +88,12 @@ public:
         // position
         float x, y;
 
+        // distance from the position to each of the parents. With three
+        // parents that is the radius of the largest circle around the node
+        // that contains no points. With two the node is the midpoint between
+        // them, and its circle may contain other points.
+        float radius;
+
         // original points that this node separates (2 or 3)
         std::set<size_t> parents;
 
@@ -62,7 +107,79 @@ public:
         friend Voronoi::Implementation;
     };
 
+    struct Options
+    {
+        // sample hardware counters around each phase, see Stats. They only
+        // count the calling thread, so while they're open the whole diagram
+        // is built on it and threads is ignored.
+        bool perf_counters;
+
+        // if set, every event the sweep of points handles is appended to it,
+        // see event_log.h (weighted points and circles aren't swept)
+        EventLog* event_log;
+
+        // if set, the sweep of points runs in it rather than in state of its
+        // own, see Workspace
+        Workspace* workspace;
+
+        // if set, the sweep of points writes the positions of the nodes to
+        // it as fixed point while it builds them, see fixed_point.h
+        const FixedOutput* fixed;
+
+        // threads to build the node and edge lists on once the sweep is done,
+        // 0 for one per core, or just the calling thread if it's a worker of
+        // a pool already (see parallel.h)
+        size_t threads;
+
+        Options() : perf_counters(false), event_log(nullptr),
+            workspace(nullptr), fixed(nullptr), threads(0) {}
+    };
+
+    // Time spent in each phase of the computation
+    struct Stats
+    {
+        // true if the phases also carry hardware counters
+        bool counters;
+
+        // sorting the points, the sweep itself, and building the node and
+        // edge lists once the sweep is done
+        PerfSample sort;
+        PerfSample sweep;
+        PerfSample assembly;
+    };
+
     Voronoi(const std::vector<Point>& points);
+    Voronoi(const std::vector<Point>& points, const Options& options);
+
+    /**
+     * Power diagram of weighted points, each point's cell holds the positions
+     * x where |x - p|^2 - w is smallest. Node radii are sqrt(|x - p|^2 - w)
+     * (0 where that's negative). A point can be hidden by heavier neighbors
+     * and then has no cell, so doesn't show up in any parents.
+     */
+    Voronoi(const std::vector<Point>& points, const std::vector<float>& weights);
+    Voronoi(const std::vector<Point>& points, const std::vector<float>& weights,
+            const Options& options);
+
+    /**
+     * Diagram of circle sites (additively weighted), the distance to a site
+     * is the distance to its center minus its radius. Node radii are the
+     * clearance to the nearest circles. A circle inside another has no cell.
+     * See apollonius.h for the curved edges.
+     */
+    Voronoi(const std::vector<Circle>& circles);
+    Voronoi(const std::vector<Circle>& circles, const Options& options);
+
+    /**
+     * Diagram of the points of a recorded log, handling its events in the
+     * recorded order rather than working the order out with the event queue.
+     * Gives the same nodes and edges as the run that recorded it, so runs of
+     * the same log time the same beach line and graph work. Stats::sort is
+     * left at zero. Throws Error if an event has an unknown type or names a
+     * site that isn't one of the log's points.
+     */
+    explicit Voronoi(const EventLog& log);
+    Voronoi(const EventLog& log, const Options& options);
 
     const std::vector<Edge::Ptr> getEdges() const
     {
@@ -74,10 +191,16 @@ public:
         return m_nodes;
     }
 
+    const Stats& getStats() const
+    {
+        return m_stats;
+    }
+
 private:
 
     std::vector<Edge::Ptr> m_edges;
     std::vector<Node::Ptr> m_nodes;
+    Stats m_stats;
 
 };
 